@@ -0,0 +1,49 @@
+// Differential testing of every engine on random programs. Each program is
+// generated from its own seed, and every definition in it is called on a
+// few random arguments; a program on which an engine disagrees with the
+// reference interpreter is printed along with the calls it got wrong.
+//
+//     ./bench_differential [programs] [seed] [fuel]
+
+#include <iostream>
+#include "differential.h"
+#include "generator.h"
+
+int main(int argc, char* argv[])
+{
+    size_t programs = argc > 1 ? std::stoull(argv[1]) : 200;
+    natural seed = argc > 2 ? std::stoull(argv[2]) : 1;
+    natural fuel = argc > 3 ? std::stoull(argv[3]) : 20000;
+    differential harness(all_engines(std::make_shared<scheduler>(2)), fuel);
+    size_t compared = 0, skipped = 0, failed = 0;
+    for(size_t i = 0; i < programs; i++)
+    {
+        program_generator gen(seed + i);
+        std::string source = gen.generate();
+        auto p = parser::create(source);
+        p->parse();
+        std::vector<call> calls;
+        for(const auto& v : p->variables())
+        {
+            for(int k = 0; k < 4; k++)
+            {
+                calls.push_back({v->name, gen.arguments(v->dim(), 6)});
+            }
+        }
+        auto found = harness.compare(source, calls);
+        compared += harness.compared();
+        skipped += harness.skipped();
+        if(!found.empty())
+        {
+            failed++;
+            std::cout << "seed " << seed + i << ":\n" << source;
+            for(const auto& m : found)
+            {
+                std::cout << "  " << m.to_string() << "\n";
+            }
+        }
+    }
+    std::cout << programs << " programs, " << compared << " results compared, " << skipped
+              << " out of fuel, " << failed << " programs with mismatches" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+// Prints a random program, to benchmark the parser and the evaluator on
+// inputs of any size, e.g. with `kleene --eager --opt-stats big.kl`.
+//
+//     ./bench_generate [definitions] [seed] [depth] [loops] > big.kl
+
+#include <iostream>
+#include "generator.h"
+
+int main(int argc, char* argv[])
+{
+    program_generator::options opts;
+    opts.definitions = argc > 1 ? std::stoul(argv[1]) : 1000;
+    natural seed = argc > 2 ? std::stoull(argv[2]) : 1;
+    opts.max_depth = argc > 3 ? std::stoul(argv[3]) : 4;
+    opts.max_loops = argc > 4 ? std::stoul(argv[4]) : 2;
+    program_generator gen(seed, opts);
+    std::cout << gen.generate();
+    return 0;
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Latency and throughput of `kleene --serve`.
+
+Starts a server on the given program (or connects to one listening on a
+Unix domain socket with --socket), sends --requests requests keeping at most
+--inflight of them unanswered, and reports throughput and latency
+percentiles.
+
+    python3 bench/loadtest.py build/kleene docs/ex/isprime.kl isprime 1000 2000
+"""
+
+import argparse
+import json
+import random
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("kleene", help="path to the kleene executable")
+    ap.add_argument("file", help="program to serve")
+    ap.add_argument("entry", help="variable to evaluate")
+    ap.add_argument("lo", type=int, help="arguments are drawn from lo..hi")
+    ap.add_argument("hi", type=int)
+    ap.add_argument("--arity", type=int, default=1)
+    ap.add_argument("--requests", type=int, default=2000)
+    ap.add_argument("--inflight", type=int, default=64)
+    ap.add_argument("--threads", type=int, default=0, help="server threads, 0 for one per core")
+    ap.add_argument("--budget", type=int, default=None)
+    ap.add_argument("--socket", default=None, help="connect to a running server instead")
+    opts = ap.parse_args()
+
+    if opts.socket is None:
+        cmd = [opts.kleene, "--serve", "--threads", str(opts.threads), opts.file]
+        proc = subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE, bufsize=0)
+        send, recv = proc.stdin, proc.stdout
+    else:
+        proc = None
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(opts.socket)
+        send, recv = sock.makefile("wb", buffering=0), sock.makefile("rb")
+
+    slots = threading.Semaphore(opts.inflight)
+    sent = {}
+    latencies = []
+    errors = []
+
+    def reader():
+        for line in recv:
+            done = time.perf_counter()
+            response = json.loads(line)
+            latencies.append(done - sent.pop(response["id"]))
+            if "error" in response:
+                errors.append(response["error"])
+            slots.release()
+            if len(latencies) == opts.requests:
+                return
+
+    t = threading.Thread(target=reader)
+    t.start()
+    start = time.perf_counter()
+    for i in range(opts.requests):
+        request = {"id": i, "entry": opts.entry,
+                   "args": [random.randint(opts.lo, opts.hi) for _ in range(opts.arity)]}
+        if opts.budget is not None:
+            request["budget"] = opts.budget
+        slots.acquire()
+        sent[i] = time.perf_counter()
+        send.write((json.dumps(request) + "\n").encode())
+    t.join()
+    elapsed = time.perf_counter() - start
+    send.close()
+    if proc is not None:
+        proc.wait()
+
+    latencies.sort()
+    def pct(p):
+        return latencies[min(len(latencies) - 1, int(p / 100 * len(latencies)))] * 1000
+    print(f"{opts.requests} requests in {elapsed:.3f} s: {opts.requests / elapsed:.0f} req/s")
+    print(f"latency ms: p50 {pct(50):.3f}  p90 {pct(90):.3f}  p99 {pct(99):.3f}  max {latencies[-1] * 1000:.3f}")
+    if errors:
+        print(f"{len(errors)} errors, e.g. {errors[0]}")
+
+
+if __name__ == "__main__":
+    sys.exit(main())
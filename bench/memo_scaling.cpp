@@ -0,0 +1,86 @@
+// Scaling of a program evaluated by 1 to 32 threads, with and without the
+// shared memo table. Every thread takes an equal share of a fixed batch of
+// queries, so with perfect scaling the time halves as threads double.
+//
+//     ./bench_memo [file.kl] [entry] [queries] [max_argument]
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "parser.h"
+
+static std::shared_ptr<const program> load(const std::string& code, bool memo)
+{
+    auto p = parser::create(code);
+    p->set_memo(memo);
+    p->parse();
+    return p->build();
+}
+
+static double run(const program& prog, const std::string& entry,
+                  const std::vector<natural>& queries, unsigned int threads)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(unsigned int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]{
+            for(size_t i = t; i < queries.size(); i += threads)
+            {
+                prog.eval(entry, {queries[i]});
+            }
+        });
+    }
+    for(auto& w : workers)
+    {
+        w.join();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string file = argc > 1 ? argv[1] : "isprime.kl";
+    std::string entry = argc > 2 ? argv[2] : "isprime";
+    size_t count = argc > 3 ? std::stoull(argv[3]) : 2000;
+    natural max_arg = argc > 4 ? std::stoull(argv[4]) : 150;
+    std::ifstream in(file);
+    if(!in.good())
+    {
+        std::cerr << "Cannot open file: " << file << std::endl;
+        return 2;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::mt19937_64 rng(1);
+    std::vector<natural> queries(count);
+    for(auto& q : queries)
+    {
+        q = 2 + rng() % (max_arg - 1);
+    }
+    auto plain = load(buffer.str(), false), memoised = load(buffer.str(), true);
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << "\n";
+    std::cout << "threads   plain ms  eff.   memo ms  eff.  memo statistics\n";
+    double plain1 = 0, memo1 = 0;
+    for(unsigned int threads = 1; threads <= 32; threads *= 2)
+    {
+        double tp = run(*plain, entry, queries, threads);
+        memoised->memo_results()->clear();
+        double tm = run(*memoised, entry, queries, threads);
+        if(threads == 1)
+        {
+            plain1 = tp;
+            memo1 = tm;
+        }
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(1)
+                  << std::setw(11) << tp << std::setw(6) << 100 * plain1 / (tp * threads) << "%"
+                  << std::setw(10) << tm << std::setw(6) << 100 * memo1 / (tm * threads) << "%  "
+                  << memoised->memo_results()->statistics().to_string() << std::endl;
+    }
+    return 0;
+}
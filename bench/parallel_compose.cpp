@@ -0,0 +1,65 @@
+// Speedup of fork-join evaluation on a wide composition of heavy
+// arguments: wide(x) sums cube(x), cube(x+1), ..., cube(x+7), each a loop
+// of about x^3 steps. Serial evaluation is compared with the scheduler on
+// 1, 2, 4, ... threads. Each run is a phase of a perf_recorder, whose
+// counters are printed after the table and written to json if given.
+//
+//     ./bench_parallel [x] [max_threads] [json]
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "parser.h"
+
+static const std::string code = R"(
+add = P1_1 @ S(P3_2)
+mul = C1_0 @ add(P3_3, P3_2)
+cube = mul(mul(P1_1, P1_1), P1_1)
+sum4 = add(add(P4_1, P4_2), add(P4_3, P4_4))
+wide4 = sum4(cube(P1_1), cube(S(P1_1)), cube(S(S(P1_1))), cube(S(S(S(P1_1)))))
+wide = add(wide4(P1_1), wide4(add(P1_1, C1_4)))
+)";
+
+static double run(const program& prog, natural x, natural& result)
+{
+    auto start = std::chrono::steady_clock::now();
+    result = prog.eval("wide", {x});
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    natural x = argc > 1 ? std::stoull(argv[1]) : 60;
+    unsigned int max_threads = argc > 2 ? std::stoul(argv[2]) : 16;
+    perf_recorder perf;
+    auto p = parser::create(code);
+    p->parse();
+    natural expected;
+    double serial;
+    {
+        perf_recorder::scope phase(&perf, "serial");
+        serial = run(*p->build(), x, expected);
+    }
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << "\n";
+    std::cout << "serial: " << std::fixed << std::setprecision(1) << serial << " ms\n";
+    std::cout << "threads        ms  speedup\n";
+    for(unsigned int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        auto q = parser::create(code);
+        q->set_parallel(std::make_shared<scheduler>(threads), 10000);
+        q->parse();
+        natural result;
+        perf_recorder::scope phase(&perf, "threads " + std::to_string(threads));
+        double t = run(*q->build(), x, result);
+        std::cout << std::setw(7) << threads << std::setw(10) << t << std::setw(8) << std::setprecision(2)
+                  << serial / t << "x" << std::setprecision(1) << (result == expected ? "" : "  WRONG RESULT") << std::endl;
+    }
+    std::cout << perf.to_string();
+    if(argc > 3)
+    {
+        std::ofstream(argv[3]) << perf.to_json() << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Parsing a large program line by line, and with its lines parsed on a
+// scheduler of 1, 2, 4, ... threads before their names are resolved in
+// order. Both must define the same program. Each run is a phase of a
+// perf_recorder, whose counters are printed after the table and written to
+// json if given.
+//
+//     ./bench_generate 20000 > big.kl
+//     ./bench_parse big.kl [max_threads] [json]
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "parser.h"
+
+static double run(parser& p)
+{
+    auto start = std::chrono::steady_clock::now();
+    if(auto err = p.try_parse())
+    {
+        std::cerr << *err;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "usage: bench_parse file [max_threads] [json]" << std::endl;
+        return 2;
+    }
+    auto code = source_file::open(argv[1]);
+    unsigned int max_threads = argc > 2 ? std::stoul(argv[2]) : 16;
+    perf_recorder perf;
+    auto p = parser::create(code);
+    double serial;
+    {
+        perf_recorder::scope phase(&perf, "serial");
+        serial = run(*p);
+    }
+    std::string expected = p->to_string();
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << "\n";
+    std::cout << p->variables().size() << " definitions, serial: " << std::fixed << std::setprecision(1) << serial << " ms\n";
+    std::cout << "threads        ms  speedup\n";
+    for(unsigned int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        auto q = parser::create(code);
+        q->set_parallel_parse(std::make_shared<scheduler>(threads));
+        perf_recorder::scope phase(&perf, "threads " + std::to_string(threads));
+        double t = run(*q);
+        std::cout << std::setw(7) << threads << std::setw(10) << t << std::setw(8) << std::setprecision(2)
+                  << serial / t << "x" << std::setprecision(1) << (q->to_string() == expected ? "" : "  WRONG PROGRAM") << std::endl;
+    }
+    std::cout << perf.to_string();
+    if(argc > 3)
+    {
+        std::ofstream(argv[3]) << perf.to_json() << "\n";
+    }
+    return 0;
+}
@@ -1,10 +1,13 @@
 #!/bin/sh
 
-emcc docs/library.cpp src/parser.cpp \
+emcc docs/library.cpp src/parser.cpp src/optimizer.cpp src/analysis.cpp \
+  src/polynomial.cpp src/program.cpp src/memo.cpp src/scheduler.cpp src/tiering.cpp \
+  src/source.cpp src/machine.cpp src/session.cpp src/closed_form.cpp src/module.cpp src/progress.cpp \
   -std=c++20 \
   -I include \
+  -DKLEENE_NO_PERF_STATS \
   -o docs/library.js \
-  -s EXPORTED_FUNCTIONS='["_run_program"]' \
+  -s EXPORTED_FUNCTIONS='["_run_program","_create_session","_destroy_session","_update_code","_eval","_step","_cancel"]' \
   -s EXPORTED_RUNTIME_METHODS='["ccall","cwrap"]' \
   -s MODULARIZE=0 \
   -s EXPORT_NAME='Module' \
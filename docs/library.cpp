@@ -1,9 +1,25 @@
 
 #include <emscripten.h>
+#include <cmath>
 #include <sstream>
 #include <string>
 #include <exception>
+#include <map>
 #include "parser.h"
+#include "session.h"
+
+static std::vector<natural> read_operands(const char* input)
+{
+    std::vector<natural> operands;
+    std::istringstream iss(input);
+    natural x;
+    while (iss >> x)
+        operands.push_back(x);
+    return operands;
+}
+
+static std::map<int, std::unique_ptr<session>> sessions;
+static int last_session = 0;
 
 extern "C" {
     EMSCRIPTEN_KEEPALIVE
@@ -28,7 +44,8 @@ extern "C" {
                 std::string entry_point = entry;
                 if(entry_point.empty())
                     entry_point = "main";
-                auto v = p->get_variable(entry_point);
+                auto prog = p->build();
+                auto v = prog->get_variable(entry_point);
                 if(v == nullptr)
                 {
                     result = "Entry point '" + entry_point + "' not found\n";
@@ -42,7 +59,7 @@ extern "C" {
                     }
                     else
                     {
-                        natural output = p->eval_var(v, operands);
+                        natural output = prog->eval(*v, operands);
                         result = std::to_string(output);
                     }
                 }
@@ -60,6 +77,111 @@ extern "C" {
         }
         return result.c_str();
     }
-}
 
+    // Sessions keep a parsed program between calls and evaluate in slices,
+    // so that a web worker can report progress and cancel in between.
+    // Strings returned are valid until the next call.
+
+    EMSCRIPTEN_KEEPALIVE
+    int create_session()
+    {
+        sessions[++last_session] = std::make_unique<session>();
+        return last_session;
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    void destroy_session(int id)
+    {
+        sessions.erase(id);
+    }
+
+    // "" on success, or the parse error
+    EMSCRIPTEN_KEEPALIVE
+    const char* update_code(int id, const char* code)
+    {
+        static std::string result;
+        auto it = sessions.find(id);
+        if(it == sessions.end())
+        {
+            result = "No session " + std::to_string(id);
+        }
+        else
+        {
+            result = it->second->update_code(code).value_or("");
+        }
+        return result.c_str();
+    }
+
+    // "" if the evaluation has started, or the reason why not
+    EMSCRIPTEN_KEEPALIVE
+    const char* eval(int id, const char* entry, const char* input)
+    {
+        static std::string result;
+        std::string entry_point = entry;
+        if(entry_point.empty())
+            entry_point = "main";
+        auto it = sessions.find(id);
+        if(it == sessions.end())
+        {
+            result = "No session " + std::to_string(id);
+        }
+        else
+        {
+            try {
+                result = it->second->eval(entry_point, read_operands(input)).value_or("");
+            } catch (const std::exception& e) {
+                result = std::string("Exception: ") + e.what();
+            }
+        }
+        return result.c_str();
+    }
+
+    // runs at most budget steps, then reports as JSON:
+    // {"state": "running", "steps": 1000, "depth": 4}
+    // {"state": "done", "result": "42", "steps": 1234}
+    // {"state": "idle"} if nothing is being evaluated
+    // {"state": "error", "error": "..."} if budget is NaN or negative
+    // the result is a string since it may not fit a double; budgets past
+    // the largest natural run without limit
+    EMSCRIPTEN_KEEPALIVE
+    const char* step(int id, double budget)
+    {
+        static std::string result;
+        // converting a double out of range to an integer is undefined
+        if(std::isnan(budget) || budget < 0)
+        {
+            result = R"({"state": "error", "error": "Budget must be a non-negative number"})";
+            return result.c_str();
+        }
+        natural steps = budget >= 18446744073709551616.0 ? polynomial::infinity : static_cast<natural>(budget);
+        auto it = sessions.find(id);
+        const machine* m = it == sessions.end() ? nullptr : it->second->evaluation();
+        if(m == nullptr)
+        {
+            result = R"({"state": "idle"})";
+            return result.c_str();
+        }
+        it->second->step(steps);
+        if(m->done())
+        {
+            result = R"({"state": "done", "result": ")" + std::to_string(m->result()) + R"(", "steps": )"
+                     + std::to_string(m->steps()) + "}";
+        }
+        else
+        {
+            result = R"({"state": "running", "steps": )" + std::to_string(m->steps()) + R"(, "depth": )"
+                     + std::to_string(m->depth()) + "}";
+        }
+        return result.c_str();
+    }
 
+    EMSCRIPTEN_KEEPALIVE
+    void cancel(int id)
+    {
+        auto it = sessions.find(id);
+        if(it != sessions.end())
+        {
+            it->second->cancel();
+        }
+    }
+}
@@ -1,32 +1,52 @@
 
 // JavaScript interface with the WASM module (Mostly AI-generated)
 
-let moduleReady = false;
-let run_program_wasm = null;
-
-// Wait for the Emscripten module to be ready
-Module.onRuntimeInitialized = function() {
-    // Wrap the C function for easier calling
-    run_program_wasm = Module.cwrap('run_program', 'string', ['string', 'string', 'string']);
-    moduleReady = true;
-    console.log('WASM module loaded successfully');
-};
+// Programs run in a worker, so the page stays responsive and long
+// evaluations can be cancelled
+const worker = new Worker('worker.js');
+const runBtn = document.getElementById('runBtn');
+const cancelBtn = document.getElementById('cancelBtn');
+const outputBox = document.getElementById('output');
+
+function finish() {
+    runBtn.disabled = false;
+    cancelBtn.disabled = true;
+}
 
-// Wrapper function that calls the WASM function
-function run_program(code, entry, input) {
-    if (!moduleReady || !run_program_wasm) {
-        throw new Error('WASM module not yet loaded');
+worker.onmessage = function(e) {
+    const msg = e.data;
+    if (msg.type === 'progress') {
+        outputBox.textContent = `Running... ${msg.steps} steps, ${msg.depth} frames deep`;
+    } else if (msg.type === 'done') {
+        outputBox.textContent = msg.result;
+        outputBox.className = 'output-box success';
+        finish();
+    } else if (msg.type === 'error') {
+        outputBox.textContent = msg.message;
+        outputBox.className = 'output-box warning';
+        finish();
+    } else if (msg.type === 'cancelled') {
+        outputBox.textContent = 'Cancelled';
+        outputBox.className = 'output-box warning';
+        finish();
     }
-    return run_program_wasm(code, entry, input);
-}
+};
+
+worker.onerror = function(error) {
+    outputBox.textContent = `Client-side error: ${error.message}`;
+    outputBox.className = 'output-box error';
+    finish();
+};
+
+cancelBtn.addEventListener('click', function() {
+    worker.postMessage({ type: 'cancel' });
+});
 
 // Event listener for the Run button
 document.getElementById('runBtn').addEventListener('click', function() {
     const code = document.getElementById('code').value;
     const entry = document.getElementById('entry').value;
     const input = document.getElementById('input').value;
-    const outputBox = document.getElementById('output');
-    const runBtn = document.getElementById('runBtn');
 
     // Validate entry (no whitespaces)
     if (entry && entry.length !== 0 && !/^\S+$/.test(entry)) {
@@ -49,26 +69,10 @@ document.getElementById('runBtn').addEventListener('click', function() {
 
     // Disable button during execution
     runBtn.disabled = true;
+    cancelBtn.disabled = false;
     outputBox.textContent = 'Running...';
     outputBox.className = 'output-box';
-
-    // Simulate async execution
-    setTimeout(() => {
-        try {
-            const result = run_program(code, entry, input);
-            outputBox.textContent = result;
-            if (/^\d+$/.test(result)) {
-                outputBox.className = 'output-box success';
-            } else {
-                outputBox.className = 'output-box warning';
-            }
-        } catch (error) {
-            outputBox.textContent = `Client-side error: ${error.message}`;
-            outputBox.className = 'output-box error';
-        } finally {
-            runBtn.disabled = false;
-        }
-    }, 100);
+    worker.postMessage({ type: 'run', code: code, entry: entry, input: input });
 });
 
 // Allow Enter key in single-line inputs to trigger run
@@ -0,0 +1,59 @@
+// Headless check of the session API; run `node docs/test_session.js`
+// after ./compile_ems.sh.
+
+const assert = require('assert');
+const path = require('path');
+
+globalThis.Module = {
+    onRuntimeInitialized() {
+        const create_session = Module.cwrap('create_session', 'number', []);
+        const destroy_session = Module.cwrap('destroy_session', null, ['number']);
+        const update_code = Module.cwrap('update_code', 'string', ['number', 'string']);
+        const evaluate = Module.cwrap('eval', 'string', ['number', 'string', 'string']);
+        const step = Module.cwrap('step', 'string', ['number', 'number']);
+        const cancel = Module.cwrap('cancel', null, ['number']);
+
+        const s = create_session();
+        assert.notStrictEqual(update_code(s, 'f = $'), '');
+        assert.strictEqual(evaluate(s, 'main', ''), 'No program');
+
+        const code = 'add = P1_1 @ S(P3_2)\nmul = C1_0 @ add(P3_2, P3_3)\nmain = mul(6, 7)\n';
+        assert.strictEqual(update_code(s, code), '');
+        assert.notStrictEqual(evaluate(s, 'mul', '1'), '');
+        assert.notStrictEqual(evaluate(s, 'nothing', ''), '');
+
+        // small slices until done
+        assert.strictEqual(evaluate(s, '', ''), '');
+        let state, slices = 0;
+        do {
+            state = JSON.parse(step(s, 10));
+            slices++;
+        } while (state.state === 'running');
+        assert.strictEqual(state.state, 'done');
+        assert.strictEqual(state.result, '42');
+        assert.ok(slices > 1);
+
+        // the program is kept for the next evaluation
+        assert.strictEqual(evaluate(s, 'mul', '12 12'), '');
+        assert.strictEqual(JSON.parse(step(s, 1e9)).result, '144');
+
+        assert.strictEqual(evaluate(s, 'mul', '1000 1000'), '');
+        assert.strictEqual(JSON.parse(step(s, 10)).state, 'running');
+        assert.strictEqual(JSON.parse(step(s, NaN)).state, 'error');
+        assert.strictEqual(JSON.parse(step(s, -1)).state, 'error');
+        assert.strictEqual(JSON.parse(step(s, 0)).state, 'running');
+        cancel(s);
+
+        assert.strictEqual(evaluate(s, 'mul', '5 5'), '');
+        assert.strictEqual(JSON.parse(step(s, Infinity)).result, '25');
+        assert.strictEqual(evaluate(s, 'mul', '5 6'), '');
+        assert.strictEqual(JSON.parse(step(s, 1e30)).result, '30');
+        assert.strictEqual(JSON.parse(step(s, 10)).state, 'idle');
+
+        destroy_session(s);
+        assert.strictEqual(JSON.parse(step(s, 10)).state, 'idle');
+        console.log('session API: ok');
+    }
+};
+
+require(path.join(__dirname, 'library.js'));
@@ -0,0 +1,62 @@
+// Runs programs off the main thread, a slice of steps at a time, so that
+// the page can show progress and cancel long evaluations.
+
+importScripts('library.js');
+
+const SLICE = 200000;
+let api = null;
+let session = 0;
+let pending = [];
+// bumped on every run and cancel, so stale slices stop
+let generation = 0;
+
+Module.onRuntimeInitialized = function() {
+    api = {
+        create_session: Module.cwrap('create_session', 'number', []),
+        update_code: Module.cwrap('update_code', 'string', ['number', 'string']),
+        eval: Module.cwrap('eval', 'string', ['number', 'string', 'string']),
+        step: Module.cwrap('step', 'string', ['number', 'number']),
+        cancel: Module.cwrap('cancel', null, ['number']),
+    };
+    session = api.create_session();
+    pending.forEach(handle);
+    pending = [];
+};
+
+// one slice per task, so that cancel messages are handled in between
+function slice(gen) {
+    if (gen !== generation) return;
+    const state = JSON.parse(api.step(session, SLICE));
+    if (state.state === 'running') {
+        postMessage({ type: 'progress', steps: state.steps, depth: state.depth });
+        setTimeout(slice, 0, gen);
+    } else if (state.state === 'done') {
+        postMessage({ type: 'done', result: state.result, steps: state.steps });
+    }
+}
+
+function handle(msg) {
+    generation++;
+    if (msg.type === 'run') {
+        let error = api.update_code(session, msg.code);
+        if (error === '') {
+            error = api.eval(session, msg.entry, msg.input);
+        }
+        if (error !== '') {
+            postMessage({ type: 'error', message: error });
+            return;
+        }
+        slice(generation);
+    } else if (msg.type === 'cancel') {
+        api.cancel(session);
+        postMessage({ type: 'cancelled' });
+    }
+}
+
+onmessage = function(e) {
+    if (api === null) {
+        pending.push(e.data);
+    } else {
+        handle(e.data);
+    }
+};
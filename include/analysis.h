@@ -0,0 +1,111 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <map>
+#include "types.h"
+#include "polynomial.h"
+
+/*
+Static analyses of expressions. Results for variables are remembered, so an
+analyzer should live as long as the variables it has seen.
+*/
+
+// how an expression varies with one argument when the others are fixed;
+// increasing and decreasing are meant in the weak sense
+enum class trend { constant, increasing, decreasing, unknown };
+std::ostream& operator<<(std::ostream& os, trend t);
+
+// what is known about an expression e of dimension n, for i < n
+struct monotonicity
+{
+    std::vector<trend> trends;      // e as a function of x_i
+    std::vector<bool> extensive;    // e(x) >= x_i
+    std::vector<bool> strict;       // e(x) > x_i
+    std::vector<bool> reductive;    // e(x) <= x_i
+    bool zero = false;              // e(x) = 0
+    explicit monotonicity(unsigned int n)
+        : trends(n, trend::constant), extensive(n, false), strict(n, false), reductive(n, false) {}
+};
+
+// upper bounds for an expression in terms of its arguments x1, x2, ...
+struct estimate
+{
+    // nesting depth of '@', counting through the variables called
+    unsigned int depth = 0;
+    // whether a '$' is reachable
+    bool partial = false;
+    // false if no polynomial bound was found (exponential growth or '$')
+    bool value_bounded = true, steps_bounded = true;
+    // the result
+    polynomial value;
+    // iterations of '@' loops and probes of '$'
+    polynomial steps;
+    // an upper bound on the level of the Grzegorczyk hierarchy
+    unsigned int grzegorczyk() const noexcept;
+    // steps taken for the given operands, saturating; the largest
+    // natural if unbounded
+    natural cost(const std::vector<natural>& operands) const noexcept;
+};
+
+// the values of an expression when each argument is within its range;
+// wraps is set when S may have been applied to the largest natural on the
+// way to them, so that they need not be those of the natural numbers
+struct value_range
+{
+    natural lo = 0, hi = polynomial::infinity;
+    bool wraps = false;
+    static value_range point(natural n) noexcept
+    {
+        return {n, n, false};
+    }
+    // nothing known
+    static value_range any() noexcept
+    {
+        return {0, polynomial::infinity, true};
+    }
+    value_range hull(const value_range& r) const noexcept;
+    // the least of 8, 16, 32 and 64 that holds every value in bits
+    unsigned int bits() const noexcept;
+    std::string to_string() const;
+    auto operator<=>(const value_range&) const = default;
+};
+
+class analyzer
+{
+public:
+    // built from the known shapes of constants, projections, S and loops
+    // that only ever increase (like add) or decrease (like sub) their
+    // accumulator
+    monotonicity monotone(const std::shared_ptr<expression>& e);
+    // whether f(n, xs) = 0 implies f(m, xs) = 0 for all m >= n, so that
+    // $f may search by galloping and bisection
+    bool is_upward_closed(const std::shared_ptr<expression>& f);
+    estimate cost(const std::shared_ptr<expression>& e);
+    // by intervals, through constants, projections, S and compositions;
+    // '@' loops of few iterations are followed one by one and longer ones
+    // bounded by their value estimate, '$[b]' by its bound
+    value_range range(const std::shared_ptr<expression>& e, const std::vector<value_range>& xs);
+    // the variables reached from v on arguments in xs, callees first, one
+    // per line with the ranges of their arguments and values
+    std::string annotate_ranges(const std::shared_ptr<const variable>& v, const std::vector<value_range>& xs);
+    // the definitions with their estimates, one per line
+    std::string annotate(const std::vector<std::shared_ptr<const variable>>& vs);
+    // the definition trees as a Graphviz digraph
+    std::string annotate_dot(const std::vector<std::shared_ptr<const variable>>& vs);
+private:
+    std::map<const variable*, monotonicity> monotonicities;
+    std::map<const variable*, estimate> estimates;
+    std::map<std::pair<const variable*, std::vector<value_range>>, value_range> ranges;
+    // of each variable range() went through, callees before callers: the
+    // hull of its arguments and of its values
+    struct ranged
+    {
+        const variable* v;
+        std::vector<value_range> xs;
+        value_range value;
+    };
+    std::vector<ranged> reached;
+    std::map<const variable*, size_t> reached_at;
+};
+
+#endif // ANALYSIS_H
@@ -0,0 +1,97 @@
+#ifndef CLOSED_FORM_H
+#define CLOSED_FORM_H
+
+#include <map>
+#include <optional>
+#include "types.h"
+#include "polynomial.h"
+
+/*
+Closed forms of arithmetic definitions. Sums and products of the arguments
+are kept as polynomials with coefficients modulo 2^64, which is exactly
+what the interpreter computes since S wraps around; add and mul, however
+deep, become polynomials evaluated by Horner's rule. Truncated subtraction
+and the test for zero of '@' stay as nodes above the polynomials:
+
+    polynomial  p(x1, ..., xn)
+    apply       p(a1, ..., ak) for closed forms a1, ..., ak
+    monus       a - b, or 0 if b > a, where b is a polynomial with small
+                non-negative coefficients, evaluated without wrapping
+    branch      if c = 0 then z else nz
+
+eval() declines, so that the caller falls back on the definition, when the
+subtrahend of a monus does not fit a natural: the interpreter would have
+wrapped values that are summed here. The subtrahend only needs checking
+when some operand exceeds the largest value for which the subtrahend on
+equal operands stays below that limit, found once when built; the ranges
+of analyzer play no part.
+*/
+
+class closed_form
+{
+public:
+    using terms = std::map<polynomial::monomial, natural>;
+    enum class kind { polynomial, apply, monus, branch };
+    const kind k;
+    const unsigned int dim;
+    // polynomial, apply: the polynomial; monus: the subtrahend
+    const terms p;
+    // apply: the arguments; monus: the minuend; branch: c, z, nz
+    const std::vector<std::shared_ptr<const closed_form>> args;
+    closed_form(kind k, unsigned int dim, terms p, std::vector<std::shared_ptr<const closed_form>> args);
+    std::optional<natural> eval(const std::vector<natural>& xs) const;
+    // whether the value depends on x_i
+    bool reads(unsigned int i) const;
+    std::string to_string() const;
+private:
+    // p as nested Horner schemes, x_var first
+    struct horner
+    {
+        unsigned int var = 0;
+        natural constant = 0;
+        std::vector<horner> coeffs;
+        natural eval(const std::vector<natural>& xs) const noexcept;
+        natural eval_saturating(const std::vector<natural>& xs) const noexcept;
+    };
+    horner scheme;
+    // monus: operands at most this keep the subtrahend from overflowing
+    natural exact_below = 0;
+    static horner compile(const terms& p, unsigned int from);
+};
+
+std::optional<natural> closed_eval(const closed_form& c, const std::vector<natural>& operands);
+
+/*
+Derives closed forms of definitions, and checks each against the
+interpreter on random arguments before trusting it.
+*/
+
+class normalizer
+{
+public:
+    // samples checked for each definition, and the steps each may take
+    struct options
+    {
+        unsigned int samples = 32;
+        natural sample_steps = 100000;
+        natural sample_max = 24;
+    };
+    normalizer() noexcept : normalizer(options()) {}
+    explicit normalizer(options opts) noexcept : opts(opts) {}
+    // none if no closed form was found, or if it failed a check
+    std::shared_ptr<const closed_form> derive(const variable& v);
+    std::shared_ptr<const closed_form> derive(const std::shared_ptr<expression>& e);
+    // one line per definition tried
+    std::string report() const;
+private:
+    using form = std::shared_ptr<const closed_form>;
+    options opts;
+    std::map<const variable*, form> forms;
+    std::vector<std::string> log;
+    form compose(const form& f, const std::vector<form>& gs, unsigned int dim);
+    form recursion(const form& f, const form& g, unsigned int dim);
+    // the number of samples that agreed, or none on a mismatch
+    std::optional<unsigned int> check(const variable& v, const closed_form& c);
+};
+
+#endif // CLOSED_FORM_H
@@ -0,0 +1,73 @@
+#ifndef DIFFERENTIAL_H
+#define DIFFERENTIAL_H
+
+#include <functional>
+#include <optional>
+#include "parser.h"
+
+/*
+Differential testing of the evaluation engines. Every engine parses the
+same source with its own options and evaluates the same calls, each under
+the same step budget. Engines take different numbers of steps, so a call
+is only compared when both the reference (the definitions as written, on
+expression::eval) and the engine finish within the budget; any other
+difference in results, or an error one side raises and the other does
+not, is a mismatch.
+*/
+
+struct engine
+{
+    std::string name;
+    // sets the options of the engine on a fresh parser
+    std::function<void(parser&)> configure;
+    // evaluates on the explicit-frame machine instead of expression::eval
+    bool on_machine = false;
+};
+
+// every engine of the interpreter; forks go to pool
+std::vector<engine> all_engines(std::shared_ptr<scheduler> pool);
+
+struct call
+{
+    std::string name;
+    std::vector<natural> args;
+};
+
+struct mismatch
+{
+    std::string engine;
+    call at;
+    // the result, or what was thrown
+    std::string expected, got;
+    std::string to_string() const;
+};
+
+class differential
+{
+public:
+    differential(std::vector<engine> engines, natural fuel) noexcept
+        : engines(std::move(engines)), fuel(fuel) {}
+    // one entry per call that some engine got wrong; errors in parsing
+    // the reference are thrown
+    std::vector<mismatch> compare(const std::string& source, const std::vector<call>& calls) const;
+    // calls compared by the last compare(), and those skipped because an
+    // engine ran out of steps
+    size_t compared() const noexcept
+    {
+        return done;
+    }
+    size_t skipped() const noexcept
+    {
+        return out_of_fuel;
+    }
+private:
+    std::vector<engine> engines;
+    natural fuel;
+    mutable size_t done = 0, out_of_fuel = 0;
+    // the result, none if the budget ran out, or the error message
+    using outcome = std::variant<natural, std::monostate, std::string>;
+    outcome run(const engine& e, const std::shared_ptr<const program>& prog, const call& c) const;
+    static std::string show(const outcome& o);
+};
+
+#endif // DIFFERENTIAL_H
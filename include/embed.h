@@ -0,0 +1,519 @@
+#ifndef EMBED_H
+#define EMBED_H
+
+#include <cstddef>
+#include <utility>
+
+/*
+Kleene programs compiled with the C++ program that embeds them. The source
+is a string literal, parsed at compile time with the grammar of parser.h;
+each definition becomes a constexpr function object whose body is a tree
+of templates, one per node, so that calls inline to plain loops and no
+interpreter is left at run time:
+
+    using lib = embed::program<R"(
+    add = P1_1 @ S(P3_2)
+    mul = C1_0 @ add(P3_3, P3_2)
+    )">;
+    static_assert(lib::function<"mul">(6, 7) == 42);
+
+Syntax errors, undefined variables and dimension mismatches stop the
+compilation at a call to the function named after the problem, such as
+embed::error::undefined_variable. Calls with the wrong number of arguments
+fail a static_assert. This header does not depend on the interpreter.
+*/
+
+namespace embed
+{
+
+using natural = unsigned long long;
+
+template<size_t N>
+struct fixed_string
+{
+    char text[N]{};
+    constexpr fixed_string(const char (&s)[N])
+    {
+        for(size_t i = 0; i < N; i++)
+        {
+            text[i] = s[i];
+        }
+    }
+    constexpr size_t size() const
+    {
+        return N - 1;
+    }
+};
+
+// not constexpr: reaching one during compilation is a compile error
+namespace error
+{
+    inline void syntax_error(const char*) {}
+    inline void undefined_variable() {}
+    inline void redefinition_of_variable() {}
+    inline void invalid_projection_indices() {}
+    inline void arity_mismatch_in_composition() {}
+    inline void dimension_mismatch_in_composition() {}
+    inline void dimension_mismatch_in_primitive_recursion() {}
+    inline void insufficient_dimension_in_minimization() {}
+    inline void dimension_mismatch_in_bounded_minimization() {}
+}
+
+enum class kind : unsigned char { constant, projection, successor, composition, recursion, minimization, bisection, bounded };
+
+struct node
+{
+    kind k = kind::constant;
+    unsigned int dim = 0;
+    // constant: its value; projection: the index of the argument;
+    // bounded: whether the search bisects
+    natural value = 0;
+    // composition: f, and gs at args[first], ..., args[first+count-1];
+    // recursion: f @ g; minimization: $f; bounded: $[g] f
+    unsigned int f = 0, g = 0, first = 0, count = 0;
+};
+
+struct definition
+{
+    unsigned int name = 0, length = 0, root = 0;
+};
+
+// the parsed program; a variable is its definition's node. No part of a
+// line is shorter than a character, so N bounds every table
+template<size_t N>
+struct tree
+{
+    char text[N]{};
+    node nodes[N]{};
+    unsigned int args[N]{};
+    definition defs[N]{};
+    unsigned int node_count = 0, arg_count = 0, def_count = 0;
+
+    constexpr bool names(const definition& d, const char* s, size_t length) const
+    {
+        if(d.length != length) return false;
+        for(size_t i = 0; i < length; i++)
+        {
+            if(text[d.name + i] != s[i]) return false;
+        }
+        return true;
+    }
+    constexpr const definition& find(const char* s, size_t length) const
+    {
+        for(unsigned int i = 0; i < def_count; i++)
+        {
+            if(names(defs[i], s, length)) return defs[i];
+        }
+        error::undefined_variable();
+        return defs[0];
+    }
+};
+
+template<size_t N>
+class reader
+{
+    tree<N>& t;
+    size_t pos = 0;
+
+    constexpr char peek() const
+    {
+        return pos < N - 1 ? t.text[pos] : '\0';
+    }
+    static constexpr bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+    static constexpr bool is_name(char c)
+    {
+        return is_digit(c) || c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+    // skips blanks and comments, but not newlines
+    constexpr void skip()
+    {
+        while(peek() == ' ' || peek() == '\t' || peek() == '\r') pos++;
+        if(peek() == ';')
+        {
+            while(peek() != '\n' && peek() != '\0') pos++;
+        }
+    }
+    constexpr bool accept(char c)
+    {
+        skip();
+        if(peek() != c) return false;
+        pos++;
+        return true;
+    }
+    constexpr void expect(char c, const char* what)
+    {
+        if(!accept(c))
+        {
+            error::syntax_error(what);
+        }
+    }
+    constexpr natural number()
+    {
+        if(!is_digit(peek()))
+        {
+            error::syntax_error("expected digit");
+        }
+        natural n = 0;
+        while(is_digit(peek()))
+        {
+            n = n * 10 + (peek() - '0');
+            pos++;
+        }
+        return n;
+    }
+    constexpr unsigned int add(node n)
+    {
+        t.nodes[t.node_count] = n;
+        return t.node_count++;
+    }
+
+    constexpr unsigned int identifier()
+    {
+        skip();
+        char c = peek();
+        if(c == 'C' || c == 'P')
+        {
+            pos++;
+            natural n = number();
+            if(peek() != '_')
+            {
+                error::syntax_error("expected '_'");
+            }
+            pos++;
+            natural k = number();
+            if(c == 'P' && (n == 0 || k == 0 || k > n))
+            {
+                error::invalid_projection_indices();
+            }
+            return add({c == 'C' ? kind::constant : kind::projection, static_cast<unsigned int>(n), k});
+        }
+        if(c == 'S')
+        {
+            pos++;
+            return add({kind::successor, 1});
+        }
+        if(is_digit(c))
+        {
+            return add({kind::constant, 0, number()});
+        }
+        if(c >= 'a' && c <= 'z')
+        {
+            size_t start = pos;
+            while(is_name(peek())) pos++;
+            return t.find(t.text + start, pos - start).root;
+        }
+        error::syntax_error("expected an expression");
+        return 0;
+    }
+    // <primary-exp> ::= <identifier> | '(' <expression> ')'
+    constexpr unsigned int primary()
+    {
+        if(accept('('))
+        {
+            unsigned int e = expression();
+            expect(')', "expected ')'");
+            return e;
+        }
+        return identifier();
+    }
+    // <comp-exp> ::= <primary-exp> ['(' <expression> {',' <expression>}* ')']
+    constexpr unsigned int composition()
+    {
+        unsigned int f = primary();
+        if(!accept('(')) return f;
+        unsigned int gs[N]{};
+        unsigned int count = 0;
+        if(!accept(')'))
+        {
+            do
+            {
+                gs[count++] = expression();
+            }
+            while(accept(','));
+            expect(')', "expected ')' in composition");
+        }
+        if(count == 0)
+        {
+            error::syntax_error("no arguments in composition");
+        }
+        if(count != t.nodes[f].dim)
+        {
+            error::arity_mismatch_in_composition();
+        }
+        unsigned int dim = t.nodes[gs[0]].dim;
+        unsigned int first = t.arg_count;
+        for(unsigned int i = 0; i < count; i++)
+        {
+            if(t.nodes[gs[i]].dim != dim)
+            {
+                error::dimension_mismatch_in_composition();
+            }
+            t.args[t.arg_count++] = gs[i];
+        }
+        return add({kind::composition, dim, 0, f, 0, first, count});
+    }
+    // <expression> ::= <comp-exp> '@' <comp-exp> | '$' ['!'] ['[' <expression> ']'] <comp-exp>
+    //                | <comp-exp>
+    constexpr unsigned int expression()
+    {
+        if(accept('$'))
+        {
+            bool monotone = peek() == '!';
+            pos += monotone;
+            if(accept('['))
+            {
+                unsigned int bound = expression();
+                expect(']', "expected ']' in bounded minimization");
+                unsigned int f = composition();
+                if(t.nodes[bound].dim + 1 != t.nodes[f].dim)
+                {
+                    error::dimension_mismatch_in_bounded_minimization();
+                }
+                return add({kind::bounded, t.nodes[bound].dim, monotone, f, bound});
+            }
+            unsigned int f = composition();
+            if(t.nodes[f].dim < 1)
+            {
+                error::insufficient_dimension_in_minimization();
+            }
+            return add({monotone ? kind::bisection : kind::minimization, t.nodes[f].dim - 1, 0, f});
+        }
+        unsigned int f = composition();
+        if(!accept('@')) return f;
+        unsigned int g = composition();
+        if(t.nodes[f].dim + 2 != t.nodes[g].dim)
+        {
+            error::dimension_mismatch_in_primitive_recursion();
+        }
+        return add({kind::recursion, t.nodes[f].dim + 1, 0, f, g});
+    }
+public:
+    constexpr explicit reader(tree<N>& t) : t(t) {}
+    // <line> ::= <variable> '=' <expression>
+    constexpr void lines()
+    {
+        while(true)
+        {
+            skip();
+            if(peek() == '\0') return;
+            if(accept('\n')) continue;
+            size_t start = pos;
+            if(!(peek() >= 'a' && peek() <= 'z'))
+            {
+                error::syntax_error("expected a definition");
+            }
+            while(is_name(peek())) pos++;
+            unsigned int length = pos - start;
+            for(unsigned int i = 0; i < t.def_count; i++)
+            {
+                if(t.names(t.defs[i], t.text + start, length))
+                {
+                    error::redefinition_of_variable();
+                }
+            }
+            expect('=', "expected '='");
+            unsigned int root = expression();
+            t.defs[t.def_count++] = {static_cast<unsigned int>(start), length, root};
+            skip();
+            if(peek() != '\0' && !accept('\n'))
+            {
+                error::syntax_error("expected end of line");
+            }
+        }
+    }
+};
+
+template<fixed_string Source>
+constexpr auto parse()
+{
+    constexpr size_t n = sizeof(Source.text);
+    tree<n> t;
+    for(size_t i = 0; i < n; i++)
+    {
+        t.text[i] = Source.text[i];
+    }
+    reader<n>(t).lines();
+    return t;
+}
+
+// the code of node I of the tree T
+template<const auto& T, unsigned int I, kind K = T.nodes[I].k>
+struct code;
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::constant>
+{
+    static constexpr natural eval(const natural*)
+    {
+        return T.nodes[I].value;
+    }
+};
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::projection>
+{
+    static constexpr natural eval(const natural* xs)
+    {
+        return xs[T.nodes[I].value - 1];
+    }
+};
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::successor>
+{
+    static constexpr natural eval(const natural* xs)
+    {
+        return xs[0] + 1;
+    }
+};
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::composition>
+{
+    static constexpr node n = T.nodes[I];
+    template<size_t... k>
+    static constexpr natural apply(const natural* xs, std::index_sequence<k...>)
+    {
+        natural vs[] = {code<T, T.args[n.first + k]>::eval(xs)...};
+        return code<T, n.f>::eval(vs);
+    }
+    static constexpr natural eval(const natural* xs)
+    {
+        return apply(xs, std::make_index_sequence<n.count>{});
+    }
+};
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::recursion>
+{
+    static constexpr node n = T.nodes[I];
+    static constexpr natural eval(const natural* xs)
+    {
+        // (i, h(i, xs), xs)
+        natural ys[n.dim + 1]{};
+        for(unsigned int k = 1; k < n.dim; k++)
+        {
+            ys[k + 1] = xs[k];
+        }
+        ys[1] = code<T, n.f>::eval(xs + 1);
+        for(ys[0] = 0; ys[0] < xs[0]; ys[0]++)
+        {
+            ys[1] = code<T, n.g>::eval(ys);
+        }
+        return ys[1];
+    }
+};
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::minimization>
+{
+    static constexpr node n = T.nodes[I];
+    static constexpr natural eval(const natural* xs)
+    {
+        natural ys[n.dim + 1]{};
+        for(unsigned int k = 0; k < n.dim; k++)
+        {
+            ys[k + 1] = xs[k];
+        }
+        while(code<T, n.f>::eval(ys) != 0)
+        {
+            ys[0]++;
+        }
+        return ys[0];
+    }
+};
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::bisection>
+{
+    static constexpr node n = T.nodes[I];
+    static constexpr natural eval(const natural* xs)
+    {
+        // as minimization::eval_bisect: f(lo) != 0 and f(hi) == 0
+        natural ys[n.dim + 1]{};
+        for(unsigned int k = 0; k < n.dim; k++)
+        {
+            ys[k + 1] = xs[k];
+        }
+        if(code<T, n.f>::eval(ys) == 0)
+        {
+            return 0;
+        }
+        natural lo = 0, hi = 0;
+        for(natural step = 1; ; step *= 2)
+        {
+            ys[0] = hi = lo + step;
+            if(code<T, n.f>::eval(ys) == 0) break;
+            lo = hi;
+        }
+        while(hi - lo > 1)
+        {
+            ys[0] = lo + (hi - lo) / 2;
+            (code<T, n.f>::eval(ys) == 0 ? hi : lo) = ys[0];
+        }
+        return hi;
+    }
+};
+
+template<const auto& T, unsigned int I>
+struct code<T, I, kind::bounded>
+{
+    static constexpr node n = T.nodes[I];
+    static constexpr natural eval(const natural* xs)
+    {
+        // as bounded_minimization::eval
+        natural hi = code<T, n.g>::eval(xs);
+        natural ys[n.dim + 1]{};
+        for(unsigned int k = 0; k < n.dim; k++)
+        {
+            ys[k + 1] = xs[k];
+        }
+        if(n.value == 0)
+        {
+            while(ys[0] < hi && code<T, n.f>::eval(ys) != 0)
+            {
+                ys[0]++;
+            }
+            return ys[0];
+        }
+        if(hi == 0 || code<T, n.f>::eval(ys) == 0)
+        {
+            return 0;
+        }
+        natural lo = 0;
+        while(hi - lo > 1)
+        {
+            ys[0] = lo + (hi - lo) / 2;
+            (code<T, n.f>::eval(ys) == 0 ? hi : lo) = ys[0];
+        }
+        return hi;
+    }
+};
+
+template<const auto& T, unsigned int Root>
+struct compiled
+{
+    static constexpr unsigned int dim = T.nodes[Root].dim;
+    template<class... Xs>
+    constexpr natural operator()(Xs... xs) const
+    {
+        static_assert(sizeof...(Xs) == dim, "wrong number of arguments");
+        const natural operands[sizeof...(Xs) + 1] = {static_cast<natural>(xs)...};
+        return code<T, Root>::eval(operands);
+    }
+};
+
+template<fixed_string Source>
+struct program
+{
+    static constexpr auto parsed = parse<Source>();
+    template<fixed_string Name>
+    static constexpr compiled<parsed, parsed.find(Name.text, Name.size()).root> function{};
+};
+
+}
+
+#endif // EMBED_H
@@ -0,0 +1,65 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <random>
+#include "types.h"
+
+/*
+Random well-typed programs. Each definition is an expression over the
+primitives and the definitions before it, of a random dimension; the last
+one is named main. The nesting of '@' and '$' is bounded across
+definitions, so values grow at most as fast as that many nested loops
+allow, and evaluation under a step budget stays cheap. The same seed gives
+the same program.
+*/
+
+class program_generator
+{
+public:
+    struct options
+    {
+        unsigned int definitions = 8;
+        // nesting of compositions, '@' and '$' within one definition
+        unsigned int max_depth = 3;
+        // nesting of '@' and '$' through all the definitions used
+        unsigned int max_loops = 2;
+        unsigned int max_dim = 3;
+        // of the loops, the percentage that are '$', half of them bounded
+        unsigned int search_percent = 20;
+    };
+    explicit program_generator(natural seed) : program_generator(seed, options()) {}
+    program_generator(natural seed, options opts) : rng(seed), opts(opts) {}
+    // a new program, different at every call
+    std::string generate();
+    // n arguments, each at most max
+    std::vector<natural> arguments(unsigned int n, natural max);
+private:
+    struct defined
+    {
+        std::string name;
+        unsigned int dim;
+        unsigned int loops;
+    };
+    // an expression, and what it must be parenthesised for: anything but
+    // an atom to be applied, a loop to be looped over
+    struct text
+    {
+        enum class form { atom, composition, loop };
+        std::string s;
+        form f;
+    };
+    std::mt19937_64 rng;
+    options opts;
+    std::vector<defined> defs;
+    // uniform in 0..n-1
+    unsigned int pick(unsigned int n);
+    // of dimension dim, with loops nested at most loops deep
+    text expression(unsigned int dim, unsigned int depth, unsigned int loops);
+    text atom(unsigned int dim, unsigned int loops);
+    // a function to apply to dim arguments
+    text function(unsigned int dim, unsigned int depth, unsigned int loops);
+    // t as an operand of '@' or '$'
+    static std::string operand(const text& t);
+};
+
+#endif // GENERATOR_H
@@ -0,0 +1,89 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "program.h"
+
+/*
+An evaluator that can be interrupted. It keeps its own stack of frames
+instead of recursing, so run() can stop after any number of steps and pick
+up where it left off on the next call. Results are the same as those of
+expression::eval; checkpoints, memo tables, forks and closed forms are
+not used.
+The whole state can be saved to a stream and restored later on the same
+program, to survive the end of the process.
+*/
+
+class machine
+{
+public:
+    // evaluates v on operands, which must match its dimension
+    machine(std::shared_ptr<const program> prog, const variable& v, std::vector<natural> operands);
+    // continues an evaluation saved on a program with the same text
+    static std::unique_ptr<machine> restore(std::shared_ptr<const program> prog, std::istream& in);
+    void save(std::ostream& out) const;
+    // takes at most budget steps; true once the result is known
+    bool run(natural budget);
+    bool done() const noexcept
+    {
+        return finished;
+    }
+    natural result() const noexcept
+    {
+        return ret;
+    }
+    // steps taken so far, and frames on the stack
+    natural steps() const noexcept
+    {
+        return taken;
+    }
+    size_t depth() const noexcept
+    {
+        return top;
+    }
+    // what is being evaluated
+    const std::string& entry_point() const noexcept
+    {
+        return entry;
+    }
+    const std::vector<natural>& arguments() const noexcept
+    {
+        return operands;
+    }
+private:
+    enum class kind { composition, recursion, minimization, bisection, bounded };
+    struct frame
+    {
+        const expression* e = nullptr;
+        kind k = kind::composition;
+        std::vector<natural> args;
+        // composition: values of gs; recursion: (i, acc, xs); search: (n, xs)
+        std::vector<natural> values;
+        unsigned int phase = 0;
+        natural lo = 0, hi = 0, stride = 0;
+    };
+    std::shared_ptr<const program> prog;
+    std::string entry;
+    std::vector<natural> operands;
+    std::vector<frame> stack;
+    size_t top = 0;
+    // the value returned by the last frame or atom
+    natural ret = 0;
+    natural taken = 0;
+    bool finished = false;
+    explicit machine(std::shared_ptr<const program> prog) noexcept
+        : prog(std::move(prog)) {}
+    // pushes a frame for e, or sets ret at once if e is an atom
+    void call(const expression* e, const std::vector<natural>& args);
+    // follows variables from e; true if it was an atom, now evaluated
+    bool atom(const expression*& e, const std::vector<natural>& args);
+    // pushes a frame for the compound expression e
+    void push(const expression* e, const std::vector<natural>& args);
+    // starts the frame above the top, whose args are set
+    void enter(const expression* e);
+    void give(natural value);
+    // the next step of the top frame; returns the steps taken, at least
+    // one and at most budget
+    natural advance(natural budget);
+};
+
+#endif // MACHINE_H
@@ -0,0 +1,87 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+using natural = unsigned long long;
+struct variable;
+
+/*
+Results of variables, (v, xs) -> v(xs), shared by every thread evaluating a
+program. The table is split into shards by hash, each behind its own
+reader-writer lock, so that lookups of different keys rarely meet and
+lookups of the same key only share a lock. A shard that grows beyond its
+part of the capacity is emptied.
+*/
+
+class memo_table
+{
+public:
+    static constexpr size_t shard_count = 64;
+    struct stats
+    {
+        size_t hits = 0, misses = 0, evictions = 0;
+        // lookups and insertions that had to wait for a lock
+        size_t contended = 0;
+        size_t size = 0;
+        std::string to_string() const;
+    };
+    // at most about capacity results are kept
+    explicit memo_table(size_t capacity = 1 << 20);
+    std::optional<natural> find(const variable* v, const std::vector<natural>& xs);
+    void insert(const variable* v, const std::vector<natural>& xs, natural result);
+    stats statistics() const;
+    // forgets all results and resets the counters
+    void clear();
+private:
+    struct key
+    {
+        const variable* v;
+        std::vector<natural> xs;
+    };
+    // a key to look up without copying operands
+    struct key_view
+    {
+        const variable* v;
+        const std::vector<natural>* xs;
+    };
+    struct key_hash
+    {
+        using is_transparent = void;
+        size_t operator()(const key& k) const noexcept;
+        size_t operator()(const key_view& k) const noexcept;
+    };
+    struct key_equal
+    {
+        using is_transparent = void;
+        bool operator()(const key& a, const key& b) const noexcept
+        {
+            return a.v == b.v && a.xs == b.xs;
+        }
+        bool operator()(const key_view& a, const key& b) const noexcept
+        {
+            return a.v == b.v && *a.xs == b.xs;
+        }
+        bool operator()(const key& a, const key_view& b) const noexcept
+        {
+            return (*this)(b, a);
+        }
+    };
+    struct alignas(64) shard
+    {
+        mutable std::shared_mutex lock;
+        std::unordered_map<key, natural, key_hash, key_equal> results;
+        std::atomic<size_t> hits{0}, misses{0}, evictions{0}, contended{0};
+    };
+    size_t shard_capacity;
+    std::vector<shard> shards;
+    static size_t hash(const variable* v, const std::vector<natural>& xs) noexcept;
+};
+
+#endif // MEMO_H
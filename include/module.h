@@ -0,0 +1,69 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <functional>
+#include <mutex>
+#include "types.h"
+
+/*
+Modules brought in by `import "file.kl"`. A module is parsed and checked
+once and then kept compiled: its definitions, simplified, as a flat list of
+nodes in prefix order that is read back without lexing or checking. Each
+import decodes its own copy, under the names of the importing namespace.
+
+Compiled modules are kept in memory, and on disk in the cache directory
+under a hash of their source and of the options they were compiled with,
+so a library shared by many programs is compiled once and then loaded by
+all of them, wherever they find it. A compiled module also records the
+hash of every module it imports, and is compiled again when one of them
+has changed.
+*/
+
+class module_cache
+{
+public:
+    struct compiled
+    {
+        natural key = 0;
+        // where it was compiled from, and the hash of that source
+        std::string path;
+        natural source = 0;
+        // every module imported, directly or not, and the hash of its source
+        std::vector<std::pair<std::string, natural>> deps;
+        // definitions, one per line: name, dimension, then nodes
+        std::string code;
+    };
+    using compiler = std::function<compiled(std::string_view source, const std::string& path)>;
+    // an empty dir keeps compiled modules in memory only
+    explicit module_cache(std::string dir = "") : dir(std::move(dir)) {}
+    // the cache directory of the user: $XDG_CACHE_HOME/kleene or
+    // ~/.cache/kleene; empty if neither is set
+    static std::string default_dir();
+    // the module at path compiled with the given options, from the cache
+    // or by compile(); throws parse_error if the file cannot be read. A
+    // compiled module on disk that does not decode is compiled again
+    std::shared_ptr<const compiled> load(const std::string& path, natural options, const compiler& compile);
+    // the definitions of a compiled module, named prefix + their name
+    static std::vector<std::shared_ptr<variable>> decode(const compiled& m, const std::string& prefix);
+    static std::string encode(const std::vector<std::shared_ptr<variable>>& vs);
+    // the absolute path of a file, for comparing imports
+    static std::string canonical(const std::string& path);
+    static natural hash(std::string_view text, natural seed = 0xcbf29ce484222325ULL) noexcept;
+    // loads served from memory and from disk, and modules compiled
+    struct counters
+    {
+        size_t memory = 0, disk = 0, compiled = 0;
+    };
+    counters stats() const;
+private:
+    std::string dir;
+    mutable std::mutex lock;
+    std::map<natural, std::shared_ptr<const compiled>> modules;
+    counters count;
+    // whether m can stand for the module at path
+    bool up_to_date(const compiled& m, const std::string& path) const;
+    std::shared_ptr<const compiled> read(natural key) const;
+    void write(const compiled& m) const;
+};
+
+#endif // MODULE_H
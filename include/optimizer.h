@@ -0,0 +1,75 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <map>
+#include <optional>
+#include "types.h"
+
+/*
+Tree rewriting on expressions. Every rewrite preserves the value of the
+expression wherever the original expression is defined.
+
+simplify() folds compositions of constants and projections, inlines
+variables defined as a single identifier (such as id = P1_1), flattens
+nested compositions and replaces arguments that are never read by C_0.
+
+The basic operation is substitution: rewrite(e, args, m) builds an expression
+of dimension m computing e(args[0](x), ..., args[n-1](x)). The arguments
+handed down the tree are always trivial, i.e. constants or projections; any
+other argument stays in a composition. This way nothing is ever evaluated
+twice.
+*/
+
+class optimizer
+{
+public:
+    struct options
+    {
+        // specialise called variables on their constant arguments
+        bool unfold = false;
+        // unroll primitive recursions whose counter is a constant up to this
+        natural unroll_limit = 0;
+        // total number of iterations unrolled by this optimizer
+        natural unroll_budget = 4096;
+        // evaluate subterms with constant arguments that contain no '$'
+        bool fold_closed = false;
+        // steps such a subterm may take; it is kept as it is beyond that
+        natural fold_steps = 1 << 20;
+    };
+    optimizer() noexcept;
+    explicit optimizer(options opts) noexcept : opts(opts) {}
+    // e with trivial compositions folded
+    std::shared_ptr<expression> simplify(const std::shared_ptr<expression>& e);
+    // f(args[0], ..., args[n-1]) for arbitrary args of dimension dim
+    std::shared_ptr<expression> apply(const std::shared_ptr<expression>& f,
+                                      const std::vector<std::shared_ptr<expression>>& args,
+                                      unsigned int dim);
+    // residual of v where argument i is fixed to fixed[i], if it has a value
+    std::shared_ptr<variable> specialize(const std::shared_ptr<variable>& v,
+                                         const std::vector<std::optional<natural>>& fixed,
+                                         const std::string& name);
+    // whether e contains no unbounded minimization
+    bool is_total(const std::shared_ptr<expression>& e);
+    // reads(e)[i] is false if e does not depend on its i-th argument
+    std::vector<bool> reads(const std::shared_ptr<expression>& e);
+private:
+    using args_t = std::vector<std::shared_ptr<expression>>;
+    options opts;
+    natural unrolled = 0;
+    std::map<std::string, std::shared_ptr<variable>> residuals;
+    std::map<const variable*, bool> totality;
+    std::map<const variable*, std::vector<bool>> readings;
+    std::shared_ptr<expression> rewrite(const std::shared_ptr<expression>& e, const args_t& args, unsigned int dim);
+    std::shared_ptr<expression> rewrite_recursion(const std::shared_ptr<primitive_recursion>& pr, const args_t& args, unsigned int dim);
+    std::shared_ptr<expression> rewrite_call(const std::shared_ptr<expression>& e, const std::shared_ptr<variable>& v, const args_t& args, unsigned int dim);
+    std::shared_ptr<expression> compose(const std::shared_ptr<expression>& f, const args_t& gs, unsigned int dim);
+};
+
+std::shared_ptr<expression> make_constant(unsigned int dim, natural k);
+std::shared_ptr<expression> make_projection(unsigned int dim, unsigned int k);
+// whether e is a constant or a projection
+bool is_trivial(const std::shared_ptr<expression>& e) noexcept;
+// number of nodes in e, not counting the definitions of variables
+size_t node_count(const std::shared_ptr<expression>& e) noexcept;
+
+#endif // OPTIMIZER_H
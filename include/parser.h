@@ -8,73 +8,210 @@
 #include <memory>
 #include <stdexcept>
 #include <map>
+#include <optional>
+#include <string_view>
 #include "types.h"
+#include "optimizer.h"
+#include "analysis.h"
+#include "program.h"
+#include "scheduler.h"
+#include "tiering.h"
+#include "source.h"
+#include "symbols.h"
+#include "closed_form.h"
+#include "module.h"
+#include "perf_stats.h"
 
 /*
 <program>     ::= <line> {'\n'+ <line>}*
 <line>        ::= <variable> '=' <expression> [';' <comment>]
+                | 'import' '"' <file> '"' ['as' <variable>] [';' <comment>]
 <expression>  ::= <comp-exp> '@' <comp-exp>
-                | '$' <comp-exp>
+                | '$' ['!'] ['[' <expression> ']'] <comp-exp>
                 | <comp-exp>
 <comp-exp>    ::= <primary-exp> ['(' <expression> {',' <expression>}* ')']
 <primary-exp> ::= <atomic-exp> | '(' <expression> ')'
 <atomic-exp>  ::= <identifer>
 <identifer>   ::= 'C'<num>'_'<num> | 'P'<num>'_'<num> | 'S' | <variable>
-<variable> ::= {'a' | ... | 'z'}{'A' | ... | 'Z' | 'a' | ... | 'z' 
+<variable> ::= <name> {'.' <name>}*
+<name>     ::= {'a' | ... | 'z'}{'A' | ... | 'Z' | 'a' | ... | 'z' 
                                | '0' | '1' | ... | '9' | '_'}*
 <comment>  ::= {any character except newline}*
 
 White space (spaces and tabs) can appear between any two tokens and should be ignored.
+An import defines every definition of the file, relative to the importing
+file, as <namespace>.<name>, where the namespace is the name after 'as' or
+else the file name without its extension.
 */
 
 
 enum class token_t {
     NEWLINE,
     EQUAL,
-    LEFT_PAREN, RIGHT_PAREN,
-    COMMA, PR_SYM, MIN_SYM,
+    LEFT_PAREN, RIGHT_PAREN, LEFT_BRACKET, RIGHT_BRACKET,
+    COMMA, PR_SYM, MIN_SYM, MONO_MIN_SYM,
     CONST, PROJ, SUCC,
-    VARIABLE, NUM,
+    VARIABLE, NUM, STRING,
     END
 };
 std::ostream& operator<<(std::ostream& os, token_t t);
 
 
+/*
+The parser builds a program line by line. It holds the lexer state and the
+definitions seen so far; build() takes an immutable snapshot for evaluation.
+
+With a pool for parsing, the lines are first parsed into drafts by several
+workers at once, without looking up names or checking dimensions, and the
+drafts are then resolved in order. A line whose draft cannot be resolved
+is parsed again on its own, so errors and where they are reported are
+those of parsing line by line.
+*/
 class parser 
 {
-    std::string input;
+    // the storage input points into: either a string or a mapped file
+    std::string owned;
+    std::shared_ptr<const source_file> source;
+    std::string_view input;
     //cache for token values
     struct {
         token_t token;
-        size_t pos;
+        // after the token, and where it starts
+        size_t pos, start;
         int num1, num2;
-        std::string var_name;
+        std::string_view var_name;
+        unsigned int symbol;
     } cache;
-    std::vector<std::shared_ptr<variable>> program;
-    std::map<std::string, size_t> context;
-    parser(const std::string &input) noexcept : input(input) {}
+    std::vector<std::shared_ptr<variable>> defns;
+    // every identifier lexed, and for each symbol its index in defns
+    symbol_table symbols;
+    std::vector<size_t> slots;
+    // if not empty, parse() only parses what these variables refer to
+    std::vector<std::string> roots;
+    // simplifies each definition after parse_line; none if disabled
+    std::unique_ptr<optimizer> opt;
+    // whether primitive recursions keep checkpoints of their results
+    bool checkpoints = false;
+    // whether minimizations found upward closed search by bisection
+    bool fast_min = false;
+    // shared by the variables that loop; none if disabled
+    std::shared_ptr<memo_table> memo;
+    // runs expensive composition arguments in parallel; none if disabled
+    std::shared_ptr<scheduler> pool;
+    natural fork_threshold = 0;
+    // results of variables promoted to the memoised tier; none if tiering
+    // is disabled
+    std::shared_ptr<memo_table> tier_memo;
+    tiering_options tier_opts;
+    // gives definitions closed forms; none if disabled
+    std::unique_ptr<normalizer> closed;
+    analyzer ana;
+    // compiled modules, shared with the parsers of imported modules
+    std::shared_ptr<module_cache> modules;
+    std::string import_dir;
+    // namespaces imported, by hash of their source, and every module
+    // imported with the hash of its source
+    std::map<std::string, natural> namespaces;
+    std::vector<std::pair<std::string, natural>> imported;
+    // the modules whose compilation led to this parser, to catch cycles
+    std::vector<std::string> importing;
+    // parses lines in parallel before resolving them; none if disabled
+    std::shared_ptr<scheduler> parse_pool;
+    // charged with parsing and optimising; none if not profiling
+    perf_recorder* perf = nullptr;
+    // a line as parsed by a worker: its nodes in the order a parse line by
+    // line would build them, each after its operands
+    struct draft
+    {
+        enum class kind { constant, projection, successor, variable, composition, recursion, minimization, bounded };
+        struct node
+        {
+            kind k;
+            // constant and projection: the numbers; composition: the
+            // number of arguments; searches: whether monotone
+            int num1 = 0, num2 = 0;
+            std::string_view name = {};
+        };
+        std::string_view name;
+        std::vector<node> nodes;
+        // false if the line must be parsed again on its own
+        bool ok = false;
+        // the lexer after the line
+        size_t pos = 0, start = 0;
+        token_t token = token_t::END;
+    };
+    draft draft_line(size_t start);
+    void draft_expression(draft& d);
+    void draft_comp_exp(draft& d);
+    void draft_atomic_exp(draft& d);
+    // the definition of a draft; throws parse_error where a parse line by
+    // line would
+    std::shared_ptr<expression> resolve(const draft& d);
+    // adds name = rvalue, simplified and prepared
+    std::shared_ptr<variable> define(const std::string& name, std::shared_ptr<expression> rvalue);
+    // parses the lines starting at the given offsets, in order
+    void parse_lines(const std::vector<size_t>& starts);
+    // the passes that follow simplification, as set by the options
+    void prepare(const std::shared_ptr<variable>& var, const std::shared_ptr<expression>& baseline);
+    void parse_import();
+    parser(std::string owned, std::shared_ptr<const source_file> source) noexcept
+        : owned(std::move(owned)), source(std::move(source)), opt(std::make_unique<optimizer>())
+    {
+        input = this->source != nullptr ? this->source->text() : std::string_view(this->owned);
+    }
 public:
     static std::unique_ptr<parser> create(std::string input);
+    // parses the file in place, without copying it
+    static std::unique_ptr<parser> create(std::shared_ptr<const source_file> source);
     void set_input(const std::string &input);
+    void set_optimize(bool on);
+    void set_checkpoints(bool on) noexcept;
+    void set_fast_min(bool on) noexcept;
+    void set_memo(bool on);
+    // compositions fork arguments estimated to take at least threshold steps
+    void set_parallel(std::shared_ptr<scheduler> pool, natural threshold);
+    // start variables on their definitions as written and promote them as
+    // they get hot
+    void set_tiering(bool on, const tiering_options& opts = tiering_options());
+    // evaluates the arithmetic definitions it can by closed forms
+    void set_closed_forms(bool on);
+    // one line per definition given a closed form, or refused one
+    std::string closed_forms() const;
+    // where compiled modules are kept; a cache in memory by default
+    void set_module_cache(std::shared_ptr<module_cache> cache);
+    // the directory imports are relative to
+    void set_import_dir(std::string dir);
+    // makes parse() skip definitions the given variables do not depend on
+    void set_roots(std::vector<std::string> names);
+    // makes parse() parse lines on the workers of pool
+    void set_parallel_parse(std::shared_ptr<scheduler> pool);
+    // counts simplification and the passes after it in the phase
+    // "optimise" of perf, and the rest of parse() in "parse"
+    void set_perf(perf_recorder* perf) noexcept;
     // Lexer
     void next_token();
     // Parser
     std::shared_ptr<identifier> parse_identifer();
     std::unique_ptr<composition> parse_composition();
     std::unique_ptr<primitive_recursion> parse_primitive_recursion();
-    std::unique_ptr<minimization> parse_minimization();
+    std::unique_ptr<expression> parse_minimization();
     std::unique_ptr<expression> parse_expression();
     std::unique_ptr<expression> parse_comp_exp();
     std::unique_ptr<expression> parse_atomic_exp();
     std::shared_ptr<variable> parse_line();
     void parse();
+    void parse_reachable();
     std::optional<std::string> try_parse();
-    // Interpreter
-    natural eval_var(std::shared_ptr<variable> v, std::vector<natural> operands);
-    natural eval_var(std::string s, std::vector<natural> operands);
+    std::shared_ptr<const program> build() const;
+    // Specialiser: defines new_name as name with the (1-based) arguments in fixed bound
+    std::shared_ptr<variable> specialize(const std::string& name, const std::map<unsigned int, natural>& fixed, const std::string& new_name);
     // help functions
     std::shared_ptr<variable> get_variable(const std::string& name) noexcept;
     void add_variable(const std::shared_ptr<variable>& var);
+    const std::vector<std::shared_ptr<variable>>& variables() const noexcept
+    {
+        return defns;
+    }
     std::string to_string() const;
 };
 
@@ -0,0 +1,124 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using natural = unsigned long long;
+
+/*
+Counters of the processor and of the heap for profiling runs, split into
+phases such as parse, optimise and eval. Cycles, instructions, cache
+misses and branch misses are read through Linux perf_event_open as one
+group for the whole process, threads started later included, along with
+the task clock and page faults; events the kernel or the machine does not
+offer are left out and shown as absent.
+
+The heap is accounted by the global operator new and delete of
+src/heap_accounting.cpp, which count allocations, bytes allocated and the
+peak of the bytes in use while a recorder exists; only the programs that
+link it (kleene, the benchmarks that report and the tests) pay for them.
+Allocations made during parse and optimise are the expression graph;
+those made during eval are its temporaries.
+
+Built with KLEENE_NO_PERF_STATS, as for the browser, scopes do nothing
+and perf_stats.cpp is not needed, so the parser may keep its own.
+
+Entering a phase charges everything since the last switch to the phase
+left, so a phase may be entered many times and its counts add up. What
+happens outside any phase is charged to "other".
+*/
+
+class perf_recorder
+{
+public:
+    // the events counted, in the order of phase::events
+    static constexpr const char* event_names[] = {
+        "cycles", "instructions", "cache_misses", "branch_misses", "task_clock_ns", "page_faults"
+    };
+    static constexpr size_t events = std::size(event_names);
+    struct phase
+    {
+        std::string name;
+        natural entered = 0;
+        double seconds = 0;
+        // by event; meaningless for events not counted
+        natural counts[events] = {};
+        natural allocations = 0, bytes = 0;
+        // the most bytes in use at once while in the phase, counting from
+        // the start of the recorder
+        natural peak_bytes = 0;
+    };
+    // starts counting in the phase "other"; throws nothing if no counter
+    // can be opened
+    perf_recorder();
+    ~perf_recorder();
+    perf_recorder(const perf_recorder&) = delete;
+    perf_recorder& operator=(const perf_recorder&) = delete;
+    // charges what happened since the last switch to the current phase
+    // and makes name current; returns the phase left
+    std::string enter(const std::string& name);
+    // in the phase name while in scope; does nothing without a recorder
+#if !defined(KLEENE_NO_PERF_STATS)
+    class scope
+    {
+        perf_recorder* recorder;
+        std::string saved;
+    public:
+        scope(perf_recorder* recorder, const std::string& name);
+        ~scope();
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    };
+#else
+    class scope
+    {
+    public:
+        scope(perf_recorder*, const char*) noexcept {}
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    };
+#endif
+    // whether event i is counted
+    bool counted(size_t i) const noexcept
+    {
+        return index[i] >= 0;
+    }
+    // the phases so far, in the order first entered
+    std::vector<phase> phases();
+    // one line per phase
+    std::string to_string();
+    // {"events": [...], "phases": [{"name": ..., "seconds": ..., ...}]},
+    // with null for events not counted
+    std::string to_json();
+private:
+    mutable std::mutex lock;
+    // the group leader, and for each event its place in a group read
+    int leader = -1;
+    std::vector<int> fds;
+    int index[events];
+    std::vector<phase> done;
+    size_t current = 0;
+    std::chrono::steady_clock::time_point since;
+    natural last[events] = {};
+    natural last_allocations = 0, last_bytes = 0;
+    // reads the group into counts; false if there is no group
+    bool read(natural* counts) const;
+    void charge();
+};
+
+// what the operator new and delete of src/heap_accounting.cpp report to
+namespace heap_accounting
+{
+    // marks the heap as accounted
+    void hook() noexcept;
+    // whether a recorder exists, so that blocks are to be counted
+    bool counting() noexcept;
+    void allocated_block(size_t size) noexcept;
+    void freed_block(size_t size) noexcept;
+}
+
+#endif // PERF_STATS_H
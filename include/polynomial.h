@@ -0,0 +1,47 @@
+#ifndef POLYNOMIAL_H
+#define POLYNOMIAL_H
+
+#include <map>
+#include "types.h"
+
+/*
+Multivariate polynomials in x_1, x_2, ... with natural coefficients.
+Coefficient arithmetic saturates at the largest natural, which keeps
+polynomials usable as upper bounds.
+*/
+
+class polynomial
+{
+public:
+    // exponents of x_1, x_2, ...; trailing zeros are dropped
+    using monomial = std::vector<unsigned int>;
+    static constexpr natural infinity = ~natural(0);
+    std::map<monomial, natural> terms;
+    polynomial() noexcept {}
+    explicit polynomial(natural k);
+    // x_i, 1-based like projections
+    static polynomial variable(unsigned int i);
+    polynomial operator+(const polynomial& q) const;
+    polynomial operator*(const polynomial& q) const;
+    // p(qs[0], ..., qs[n-1]); variables beyond qs are taken as 0
+    polynomial substitute(const std::vector<polynomial>& qs) const;
+    bool is_zero() const noexcept
+    {
+        return terms.empty();
+    }
+    unsigned int degree() const noexcept;
+    unsigned int degree_in(unsigned int i) const noexcept;
+    // the part of p in which x_i occurs exactly d times, divided by x_i^d
+    polynomial coefficient_of(unsigned int i, unsigned int d) const;
+    natural eval(const std::vector<natural>& xs) const noexcept;
+    bool operator==(const polynomial& q) const noexcept
+    {
+        return terms == q.terms;
+    }
+    std::string to_string() const;
+};
+
+natural saturating_add(natural a, natural b) noexcept;
+natural saturating_mul(natural a, natural b) noexcept;
+
+#endif // POLYNOMIAL_H
@@ -0,0 +1,36 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <map>
+#include "types.h"
+
+/*
+A parsed program. It is immutable once built: it can be shared freely and
+every member function may be called from many threads at once.
+*/
+
+class program
+{
+    std::vector<std::shared_ptr<const variable>> defns;
+    std::map<std::string, size_t> context;
+    std::shared_ptr<memo_table> memo;
+public:
+    explicit program(const std::vector<std::shared_ptr<variable>>& vs, std::shared_ptr<memo_table> memo = nullptr);
+    std::shared_ptr<const variable> get_variable(const std::string& name) const noexcept;
+    const std::vector<std::shared_ptr<const variable>>& variables() const noexcept
+    {
+        return defns;
+    }
+    natural eval(const variable& v, const std::vector<natural>& operands) const;
+    natural eval(const std::string& name, const std::vector<natural>& operands) const;
+    // the table shared by memoised variables, or null
+    memo_table* memo_results() const noexcept
+    {
+        return memo.get();
+    }
+    std::string to_string() const;
+    // a hash of to_string(), the same for programs parsed the same way
+    natural fingerprint() const;
+};
+
+#endif // PROGRAM_H
@@ -0,0 +1,180 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using natural = unsigned long long;
+
+/*
+Progress of the '@' and '$' loops running on a thread. A watched thread
+keeps counters for each active loop, written only by itself with relaxed
+atomic stores, so that a monitor thread can read them at any time without
+stopping the evaluation. Loops on threads that are not watched cost two
+checks per iteration, and two when they start; on a thread on standby,
+each iteration also looks for a request to be watched.
+*/
+
+class thread_progress
+{
+public:
+    // loops nested deeper than this are counted but not shown
+    static constexpr size_t max_depth = 16;
+    struct loop
+    {
+        std::atomic<bool> search{false};
+        std::atomic<natural> iterations{0};
+        // '@': the counter and the value it runs up to; '$': the candidate,
+        // and for '$[b]' the bound
+        std::atomic<natural> at{0}, bound{0};
+    };
+    std::atomic<size_t> depth{0};
+    // iterations of all loops so far
+    std::atomic<natural> iterations{0};
+    loop loops[max_depth];
+};
+
+// the counters of the current thread, if it is watched
+inline thread_local thread_progress* current_progress = nullptr;
+class progress_monitor;
+// the monitor of the current thread if it is on standby, not yet watched
+inline thread_local progress_monitor* standby_monitor = nullptr;
+// whether a report was requested and not yet given
+inline std::atomic<bool> progress_requested{false};
+// watches the current thread on its standby monitor and takes the request,
+// for the caller to make again once its loop is counted; returns the
+// counters
+thread_progress* watch_on_request();
+
+// counts the iterations of one loop while in scope
+class loop_probe
+{
+    thread_progress* owner = nullptr;
+    thread_progress::loop* slot = nullptr;
+    // started on a thread on standby, so that a request may come while it
+    // runs
+    bool standby = false;
+    bool search;
+    natural bound;
+    // counts from now on if the thread is watched, or is on standby and a
+    // report was requested
+    void attach() noexcept
+    {
+        owner = current_progress;
+        bool requested = false;
+        if(owner == nullptr)
+        {
+            if(standby_monitor == nullptr || !progress_requested.load(std::memory_order_relaxed)) return;
+            owner = watch_on_request();
+            requested = true;
+        }
+        size_t d = owner->depth.load(std::memory_order_relaxed);
+        if(d < thread_progress::max_depth)
+        {
+            slot = &owner->loops[d];
+            slot->search.store(search, std::memory_order_relaxed);
+            slot->iterations.store(0, std::memory_order_relaxed);
+            slot->at.store(0, std::memory_order_relaxed);
+            slot->bound.store(bound, std::memory_order_relaxed);
+        }
+        owner->depth.store(d + 1, std::memory_order_release);
+        if(requested)
+        {
+            // taken by watch_on_request, so that the report shows this loop
+            progress_requested.store(true);
+        }
+    }
+public:
+    loop_probe(bool search, natural bound) noexcept
+        : search(search), bound(bound)
+    {
+        attach();
+        standby = owner == nullptr && standby_monitor != nullptr;
+    }
+    ~loop_probe()
+    {
+        if(owner == nullptr) return;
+        owner->depth.store(owner->depth.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+    }
+    loop_probe(const loop_probe&) = delete;
+    loop_probe& operator=(const loop_probe&) = delete;
+    // an iteration at counter or candidate at; a loop on standby is
+    // watched from the first iteration after a request, its inner loops
+    // having ended by then
+    void tick(natural at) noexcept
+    {
+        if(owner == nullptr)
+        {
+            if(!standby) return;
+            attach();
+            if(owner == nullptr) return;
+        }
+        owner->iterations.store(owner->iterations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if(slot == nullptr) return;
+        slot->iterations.store(slot->iterations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        slot->at.store(at, std::memory_order_relaxed);
+    }
+};
+
+/*
+Reports the progress of the watched threads to a stream, one line per
+thread, every interval and whenever request() is called (also from a
+signal handler). Each line gives the elapsed time, the iterations so far,
+their rate since the previous report and the active loops, outermost
+first.
+
+A monitor that is not started neither runs a thread nor watches any: the
+threads in its scopes stand by, and the first of them to start or run
+a loop after a request starts the monitor and is watched from then on.
+*/
+
+class progress_monitor
+{
+public:
+    // an interval of zero only reports on request
+    progress_monitor(std::ostream& os, std::chrono::milliseconds interval, bool started = true);
+    ~progress_monitor();
+    // watches the calling thread while in scope
+    class scope
+    {
+        progress_monitor& monitor;
+        thread_progress* saved;
+        progress_monitor* saved_standby;
+    public:
+        explicit scope(progress_monitor& monitor);
+        ~scope();
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    };
+    // async-signal-safe
+    static void request() noexcept;
+    std::string report();
+private:
+    struct watched
+    {
+        std::shared_ptr<thread_progress> counters;
+        std::chrono::steady_clock::time_point start, last;
+        natural last_iterations = 0;
+    };
+    std::ostream& os;
+    std::chrono::milliseconds interval;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::vector<watched> threads;
+    bool stopping = false;
+    std::thread reporter;
+    // starts the reporter; called with lock held
+    void start();
+    // watches the calling thread; called with lock held
+    thread_progress* watch();
+    friend thread_progress* watch_on_request();
+};
+
+#endif // PROGRESS_H
@@ -0,0 +1,78 @@
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include "types.h"
+
+/*
+Results of earlier runs, kept on disk so that other runs on this machine
+need not compute them again. A
+result is found under a hash of the structure of the definition evaluated
+and of its operands: variables are hashed through their definitions, never
+by name, so a result stays valid when definitions are renamed or when
+definitions it does not use change.
+
+The store is a single file of fixed size mapped into memory, a hash table
+of buckets of a few slots each; a full bucket forgets its least recently
+used result. Processes sharing the file lock it around every access with
+flock, which like the shared mapping only holds on a local file system:
+over NFS and the like, runs on different hosts may corrupt each other's
+slots, so the directory must not be shared between machines.
+*/
+
+// a hash of what an expression computes, as two independent halves
+struct digest
+{
+    natural a = 0, b = 0;
+    bool operator==(const digest&) const = default;
+};
+
+class structural_hash
+{
+public:
+    digest operator()(const expression& e);
+    digest operator()(const variable& v);
+private:
+    std::unordered_map<const variable*, digest> hashes;
+};
+
+class result_store
+{
+public:
+    // the store of dir, created with room for about slots results if it
+    // does not exist yet; throws std::runtime_error if it cannot be mapped
+    static std::unique_ptr<result_store> open(const std::string& dir, size_t slots = 1 << 16);
+    std::optional<natural> find(const variable& v, const std::vector<natural>& operands);
+    void store(const variable& v, const std::vector<natural>& operands, natural value);
+    // lookups of this process, and results stored and forgotten by it
+    struct counters
+    {
+        size_t hits = 0, misses = 0, stored = 0, evicted = 0;
+    };
+    counters stats() const;
+    // slots in use and in total, and hits and lookups of every process
+    // since the file was created
+    std::string to_string() const;
+    result_store(const result_store&) = delete;
+    result_store& operator=(const result_store&) = delete;
+    ~result_store();
+private:
+    struct header;
+    struct slot;
+    static constexpr size_t ways = 8;
+    int fd = -1;
+    void* base = nullptr;
+    size_t length = 0;
+    mutable std::mutex lock;
+    structural_hash hasher;
+    counters count;
+    result_store() noexcept {}
+    header& head() const noexcept;
+    // the bucket of a key, and the key of v on operands
+    slot* bucket(const digest& key) const noexcept;
+    digest key(const variable& v, const std::vector<natural>& operands);
+};
+
+#endif // RESULT_STORE_H
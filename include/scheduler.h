@@ -0,0 +1,85 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include "types.h"
+#include "analysis.h"
+
+/*
+A fork-join scheduler with work stealing. Each worker runs the tasks of its
+own deque newest first and, when it runs dry, steals the oldest task of
+another worker. Threads that are not workers hand their tasks in through
+an extra shared deque. A thread waiting in join() runs other tasks
+meanwhile, so nested forks cannot deadlock, and sleeps when there are none.
+
+Tasks forked by an evaluation run with the steps it had left, and it is
+charged for the steps they took once it has joined them, so a budget
+holds for the whole evaluation up to the tasks running at once.
+*/
+
+class scheduler
+{
+public:
+    struct task
+    {
+        std::function<void()> run;
+        std::atomic<bool> done{false};
+        std::exception_ptr error;
+        explicit task(std::function<void()> run) : run(std::move(run)) {}
+    };
+    // 0 for one worker per hardware thread
+    explicit scheduler(unsigned int threads = 0);
+    ~scheduler();
+    void spawn(const std::shared_ptr<task>& t);
+    // waits for t, rethrowing what it threw
+    void join(task& t);
+    unsigned int size() const noexcept
+    {
+        return workers.size();
+    }
+private:
+    struct alignas(64) task_queue
+    {
+        std::mutex lock;
+        std::deque<std::shared_ptr<task>> tasks;
+    };
+    // one per worker, then the shared one
+    std::vector<task_queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{0};
+    bool stopping = false;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    // the queue of the calling thread
+    size_t own_queue() const noexcept;
+    std::shared_ptr<task> take(size_t self);
+    void execute(task& t);
+};
+
+// the arguments of a composition that may be worth running as tasks
+struct fork_plan
+{
+    std::shared_ptr<scheduler> pool;
+    // arguments forked when their estimated steps reach the threshold
+    std::vector<size_t> candidates;
+    std::vector<estimate> costs;
+    natural threshold;
+};
+
+// the candidates of a bounded minimization, tried in chunks by tasks
+struct search_plan
+{
+    std::shared_ptr<scheduler> pool;
+    // steps to try one candidate, at least one
+    estimate cost;
+    // searches expected to take fewer steps stay on this thread, and a
+    // chunk is sized to take about this many
+    natural threshold;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,74 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <map>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include "program.h"
+
+/*
+Answers evaluation requests, one JSON object per line, such as
+    {"id": 7, "program": "isprime", "entry": "isprime", "args": [97], "budget": 100000}
+Only "entry" is required; "program" defaults to the first program added.
+Responses are written as soon as they are computed, so they may come out
+of order. Strings may use any JSON escape, "\u" with surrogate pairs
+included. The "id" of a request, if any, is read as a JSON value and
+written again into its response:
+    {"id": 7, "result": 1}
+    {"id": 8, "error": "Step budget exhausted"}
+*/
+
+class thread_pool
+{
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable ready;
+    bool stopping = false;
+public:
+    explicit thread_pool(unsigned int n);
+    void submit(std::function<void()> task);
+    // runs the queued tasks, then joins the workers
+    ~thread_pool();
+};
+
+class server
+{
+public:
+    struct options
+    {
+        // 0 for one per hardware thread
+        unsigned int threads = 0;
+        // steps allowed to each request; a request may ask for fewer
+        natural budget = ~natural(0);
+        // requests read but not yet answered, beyond which reading waits;
+        // 0 for four per thread
+        size_t in_flight = 0;
+    };
+    server();
+    explicit server(options opts);
+    void add_program(const std::string& name, std::shared_ptr<const program> prog);
+    // the response to a single request line
+    std::string answer(const std::string& request) const;
+    // answers every line of in on out; returns once all are answered
+    void serve(std::istream& in, std::ostream& out);
+    // accepts connections on a Unix domain socket; only returns by throwing
+    void listen(const std::string& path);
+private:
+    options opts;
+    std::map<std::string, std::shared_ptr<const program>> programs;
+    std::string default_program;
+    std::mutex flight_lock;
+    std::condition_variable landed;
+    size_t in_flight = 0;
+    // last, so that its workers are joined first
+    thread_pool pool;
+    // waits until another request may be submitted, and counts it
+    void admit();
+    // a request admitted has been answered
+    void release();
+};
+
+#endif // SERVER_H
@@ -0,0 +1,38 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <optional>
+#include "parser.h"
+#include "machine.h"
+
+/*
+A program kept between evaluations, for front ends that must stay
+responsive: update_code() parses once, eval() starts an evaluation and
+step() advances it by a bounded number of steps at a time.
+*/
+
+class session
+{
+    std::shared_ptr<const program> prog;
+    std::unique_ptr<machine> current;
+public:
+    // the parse error, if any; the session then has no program
+    std::optional<std::string> update_code(const std::string& code);
+    // starts evaluating entry; the reason if it cannot
+    std::optional<std::string> eval(const std::string& entry, const std::vector<natural>& operands);
+    // advances the evaluation by at most budget steps; true once done
+    bool step(natural budget);
+    // drops the current evaluation
+    void cancel() noexcept;
+    bool running() const noexcept
+    {
+        return current != nullptr && !current->done();
+    }
+    // the evaluation started last, if not cancelled
+    const machine* evaluation() const noexcept
+    {
+        return current.get();
+    }
+};
+
+#endif // SESSION_H
@@ -0,0 +1,32 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+/*
+The text of a source file, mapped read-only into memory so that it is never
+copied. Files that cannot be mapped (pipes, for instance) are read instead.
+*/
+
+class source_file
+{
+    const char* data = nullptr;
+    size_t length = 0;
+    // the contents if they were read rather than mapped
+    std::string contents;
+    source_file() noexcept {}
+public:
+    // null if the file cannot be opened
+    static std::shared_ptr<const source_file> open(const std::string& path);
+    std::string_view text() const noexcept
+    {
+        return data != nullptr ? std::string_view(data, length) : std::string_view(contents);
+    }
+    source_file(const source_file&) = delete;
+    source_file& operator=(const source_file&) = delete;
+    ~source_file();
+};
+
+#endif // SOURCE_H
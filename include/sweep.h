@@ -0,0 +1,31 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <functional>
+#include "types.h"
+#include "scheduler.h"
+
+/*
+Tabulates a definition over a range of one of its arguments. When the
+definition is an '@' loop and the swept argument is its counter, the loop
+runs once up to the end of the range and each accumulator on the way is a
+result, which takes as many steps as the last value alone. Otherwise every
+value is evaluated on its own, several at once on a pool of threads.
+*/
+
+struct sweep_range
+{
+    // 1-based position of the swept argument
+    unsigned int pos = 1;
+    natural lo = 0, hi = 0;
+};
+
+// the loop of v whose counter is its argument pos, if any
+const primitive_recursion* sweep_loop(const variable& v, unsigned int pos) noexcept;
+
+// calls emit(n, value) for n = lo..hi in order, where value is v on fixed
+// with n inserted at pos; returns whether the loop was reused
+bool sweep(const variable& v, const std::vector<natural>& fixed, const sweep_range& range,
+           const std::function<void(natural, natural)>& emit, scheduler& pool);
+
+#endif // SWEEP_H
@@ -0,0 +1,47 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/*
+Interned identifiers. Each distinct name gets the next integer id, so that
+names are hashed once when lexed and compared as integers afterwards.
+*/
+
+class symbol_table
+{
+    // a deque never moves its elements, so the keys of ids stay valid
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, unsigned int> ids;
+public:
+    static constexpr unsigned int none = ~0u;
+    unsigned int intern(std::string_view name)
+    {
+        auto it = ids.find(name);
+        if(it != ids.end())
+        {
+            return it->second;
+        }
+        names.emplace_back(name);
+        return ids[names.back()] = names.size() - 1;
+    }
+    // none if the name was never interned
+    unsigned int find(std::string_view name) const noexcept
+    {
+        auto it = ids.find(name);
+        return it != ids.end() ? it->second : none;
+    }
+    const std::string& name(unsigned int id) const noexcept
+    {
+        return names[id];
+    }
+    size_t size() const noexcept
+    {
+        return names.size();
+    }
+};
+
+#endif // SYMBOLS_H
@@ -0,0 +1,66 @@
+#ifndef TIERING_H
+#define TIERING_H
+
+#include <atomic>
+#include "types.h"
+
+/*
+Adaptive evaluation of a variable. Every variable starts on its definition
+as written. Once it has been called often enough it switches to the
+simplified definition, and if calls then keep coming and each takes many
+loop steps, it also remembers its results. Counters and timings are kept
+per tier, so that the gain of each promotion can be reported; promotion
+goes by the counters alone, and timings are sampled.
+*/
+
+enum class tier { baseline, optimized, memoised };
+std::ostream& operator<<(std::ostream& os, tier t);
+
+struct tiering_options
+{
+    // calls on the baseline before moving to the simplified definition
+    natural optimize_after = 16;
+    // calls on the simplified definition before memoising, if the
+    // average call took at least memoise_min_steps steps
+    natural memoise_after = 256;
+    natural memoise_min_steps = 16;
+    // one call in this many on each tier is timed, since reading the
+    // clock costs about as much as a small call
+    natural time_every = 16;
+};
+
+class tier_state
+{
+public:
+    tier_state(const variable* owner, std::shared_ptr<expression> baseline, std::shared_ptr<expression> optimized,
+               std::shared_ptr<memo_table> memo, const tiering_options& opts) noexcept;
+    natural eval(const std::vector<natural>& operands);
+    tier level() const noexcept
+    {
+        return current.load(std::memory_order_relaxed);
+    }
+    natural calls() const noexcept;
+    // estimated time saved by running on later tiers instead of the baseline
+    double saved_ms() const noexcept;
+    // calls, steps and time per tier, one line
+    std::string report() const;
+private:
+    struct counters
+    {
+        std::atomic<natural> calls{0}, steps{0};
+        // calls timed, and the time they took
+        std::atomic<natural> timed{0}, nanos{0};
+    };
+    const variable* owner;
+    std::shared_ptr<expression> baseline, optimized;
+    // none if the variable does not loop
+    std::shared_ptr<memo_table> memo;
+    tiering_options opts;
+    std::atomic<tier> current{tier::baseline};
+    counters per_tier[3];
+    void promote(tier from, natural calls) noexcept;
+    // the time of a call on a tier, from the calls timed
+    static double average_nanos(const counters& c) noexcept;
+};
+
+#endif // TIERING_H
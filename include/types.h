@@ -4,8 +4,13 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <map>
+#include <mutex>
+#include <algorithm>
 #include <stdexcept>
 #include "debug.h"
+#include "memo.h"
+#include "progress.h"
 
 using natural = unsigned long long;
 
@@ -23,6 +28,41 @@ public:
         : std::runtime_error(message) {}
 };
 
+class budget_exceeded : public interprete_error
+{
+public:
+    explicit budget_exceeded(const std::string& message)
+        : interprete_error(message) {}
+};
+
+// iterations of '@' and probes of '$' the current thread may still take
+inline thread_local natural steps_left = ~natural(0);
+
+inline void take_step()
+{
+    if(steps_left == 0)
+    {
+        throw budget_exceeded("Step budget exhausted");
+    }
+    steps_left--;
+}
+
+// allows evaluations on the current thread at most n steps while in scope
+class step_limit
+{
+    natural saved;
+public:
+    explicit step_limit(natural n) noexcept
+        : saved(steps_left)
+    {
+        steps_left = n;
+    }
+    ~step_limit()
+    {
+        steps_left = saved;
+    }
+};
+
 struct expression 
 {
     expression() noexcept {}
@@ -49,12 +89,25 @@ struct identifier
     ~identifier() = default;
 };
 
+class tier_state;
+// evaluates with the tier t has reached
+natural tiered_eval(tier_state& t, const std::vector<natural>& operands);
+class closed_form;
+// none when the closed form cannot vouch for the operands
+std::optional<natural> closed_eval(const closed_form& c, const std::vector<natural>& operands);
+
 struct variable : public identifier 
 {
     const std::string name;
     const unsigned int _dim;
-    std::unique_ptr<expression> defn;
-    variable(const std::string& name, unsigned int dim, std::unique_ptr<expression>&& defn) noexcept
+    std::shared_ptr<expression> defn;
+    // results shared by all threads; none if not memoised
+    std::shared_ptr<memo_table> memo;
+    // if present, evaluation goes through the tiers instead of defn
+    std::shared_ptr<tier_state> tiers;
+    // if present, tried before anything else
+    std::shared_ptr<const closed_form> closed;
+    variable(const std::string& name, unsigned int dim, std::shared_ptr<expression> defn) noexcept
         : identifier(), name(name), _dim(dim), defn(std::move(defn)) {}
     unsigned int dim() const noexcept override
     {
@@ -63,7 +116,25 @@ struct variable : public identifier
     natural eval(const std::vector<natural> &operands) const override
     {
         dprint("eval:", defn->to_string());
-        natural res = defn->eval(operands);
+        if(closed != nullptr)
+        {
+            if(auto res = closed_eval(*closed, operands))
+            {
+                return *res;
+            }
+        }
+        if(memo != nullptr)
+        {
+            if(auto hit = memo->find(this, operands))
+            {
+                return *hit;
+            }
+        }
+        natural res = tiers != nullptr ? tiered_eval(*tiers, operands) : defn->eval(operands);
+        if(memo != nullptr)
+        {
+            memo->insert(this, operands, res);
+        }
         dprint("eval:", to_string(), range_to_string(operands), "=>", res);
         return res;
     }
@@ -85,7 +156,7 @@ struct constant : public identifier
 {
     const unsigned int n;
     natural k;
-    constant(unsigned int n, unsigned int k) noexcept
+    constant(unsigned int n, natural k) noexcept
         : identifier(), n{n}, k{k} {}
     unsigned int dim() const noexcept override
     {
@@ -139,11 +210,18 @@ struct successor : public identifier
     }
 };
 
+struct fork_plan;
+// the values of gs, some of them computed by tasks of the plan's scheduler
+std::vector<natural> fork_eval(const fork_plan& plan, const std::vector<std::shared_ptr<expression>>& gs,
+                               const std::vector<natural>& operands);
+
 struct composition : public expression
 {
     std::shared_ptr<expression> f;
     std::vector<std::shared_ptr<expression>> gs;
     unsigned int _dim;
+    // if present, expensive arguments are evaluated in parallel
+    std::shared_ptr<fork_plan> fork;
     unsigned int dim() const noexcept override
     {
         return _dim;
@@ -176,6 +254,10 @@ struct composition : public expression
     }
     natural eval(const std::vector<natural> &operands) const override
     {
+        if(fork != nullptr)
+        {
+            return f->eval(fork_eval(*fork, gs, operands));
+        }
         std::vector<natural> vs(gs.size());
         std::transform(gs.begin(), gs.end(), vs.begin(), [&operands](std::shared_ptr<expression> g){
             return g->eval(operands);
@@ -198,11 +280,24 @@ struct composition : public expression
     }
 };
 
+// results of earlier runs of a primitive recursion h: for each tuple of
+// parameters xs, the pairs (n, h(n, xs)) that have been computed
+struct checkpoint_table
+{
+    // the table is emptied when it grows beyond this many pairs
+    static constexpr size_t capacity = 1 << 16;
+    std::mutex lock;
+    std::map<std::vector<natural>, std::map<natural, natural>> points;
+    size_t size = 0;
+};
+
 struct primitive_recursion : public expression
 {
     std::shared_ptr<expression> f;
     std::shared_ptr<expression> g;
     unsigned int _dim;
+    // if present, evaluation resumes from the nearest earlier checkpoint
+    std::unique_ptr<checkpoint_table> checkpoints;
     unsigned int dim() const noexcept override
     {
         return _dim;
@@ -223,15 +318,64 @@ struct primitive_recursion : public expression
     }
     natural eval(const std::vector<natural> &operands) const override
     {
+        if(checkpoints != nullptr)
+        {
+            return eval_from_checkpoint(operands);
+        }
         std::vector<natural> xs(operands.begin()+1, operands.end());
         std::vector<natural> ys = {0,f->eval(xs)};
         ys.insert(ys.end(), xs.begin(), xs.end());
+        loop_probe probe(false, operands[0]);
         for(ys[0] = 0; ys[0] < operands[0]; ys[0]++)
         {
+            take_step();
+            probe.tick(ys[0]);
             ys[1] = g->eval(ys);
         }
         return ys[1];
     }
+    natural eval_from_checkpoint(const std::vector<natural> &operands) const
+    {
+        std::vector<natural> xs(operands.begin()+1, operands.end());
+        std::vector<natural> ys = {0, 0};
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> guard(checkpoints->lock);
+            // looked up without inserting, so that misses do not grow the
+            // table; an entry is made only when a point is recorded
+            auto points = checkpoints->points.find(xs);
+            if(points != checkpoints->points.end())
+            {
+                auto it = points->second.upper_bound(operands[0]);
+                if(it != points->second.begin())
+                {
+                    --it;
+                    ys = {it->first, it->second};
+                    found = true;
+                }
+            }
+        }
+        if(!found)
+        {
+            ys[1] = f->eval(xs);
+        }
+        ys.insert(ys.end(), xs.begin(), xs.end());
+        loop_probe probe(false, operands[0]);
+        for(; ys[0] < operands[0]; ys[0]++)
+        {
+            take_step();
+            probe.tick(ys[0]);
+            ys[1] = g->eval(ys);
+        }
+        std::lock_guard<std::mutex> guard(checkpoints->lock);
+        if(checkpoints->size >= checkpoint_table::capacity)
+        {
+            checkpoints->points.clear();
+            checkpoints->size = 0;
+        }
+        checkpoints->size += checkpoints->points[xs].insert({ys[0], ys[1]}).second;
+        return ys[1];
+    }
     std::string to_string() const override
     {
         return f->to_string() + " @ " + g->to_string();
@@ -242,6 +386,9 @@ struct minimization : public expression
 {
     std::shared_ptr<expression> f;
     unsigned int _dim;
+    // f(n, xs) = 0 implies f(m, xs) = 0 for m >= n, so the least n
+    // can be found by galloping and bisection
+    bool monotone = false;
     unsigned int dim() const noexcept override
     {
         return _dim;
@@ -262,15 +409,131 @@ struct minimization : public expression
     {
         std::vector<natural> xs = {0};
         xs.insert(xs.end(), operands.begin(), operands.end());
-        while(f->eval(xs) != 0)
+        if(monotone)
+        {
+            return eval_bisect(xs);
+        }
+        loop_probe probe(true, 0);
+        while(take_step(), probe.tick(xs[0]), f->eval(xs) != 0)
         {
             xs[0]++;
         }
         return xs[0];
     }
+    natural eval_bisect(std::vector<natural> &xs) const
+    {
+        // f(lo) != 0 and f(hi) == 0
+        natural lo = 0, hi = 0;
+        loop_probe probe(true, 0);
+        take_step();
+        probe.tick(0);
+        if(f->eval(xs) == 0)
+        {
+            return 0;
+        }
+        for(natural step = 1; ; step *= 2)
+        {
+            xs[0] = hi = lo + step;
+            take_step();
+            probe.tick(hi);
+            if(f->eval(xs) == 0) break;
+            lo = hi;
+        }
+        while(hi - lo > 1)
+        {
+            xs[0] = lo + (hi - lo) / 2;
+            take_step();
+            probe.tick(xs[0]);
+            (f->eval(xs) == 0 ? hi : lo) = xs[0];
+        }
+        return hi;
+    }
+    std::string to_string() const override
+    {
+        return (monotone ? "$! " : "$ ") + f->to_string();
+    }
+};
+
+struct search_plan;
+// the least n < hi with f(n, xs) = 0, or hi, trying candidates in chunks
+// on the plan's scheduler; xs[0] is overwritten
+natural search_eval(const search_plan& plan, const expression& f, std::vector<natural>& xs, natural hi);
+
+struct bounded_minimization : public expression
+{
+    std::shared_ptr<expression> f;
+    std::shared_ptr<expression> bound;
+    unsigned int _dim;
+    // as in minimization
+    bool monotone = false;
+    // if present, candidates are tried in parallel
+    std::shared_ptr<search_plan> parallel;
+    unsigned int dim() const noexcept override
+    {
+        return _dim;
+    }
+    bounded_minimization(const std::shared_ptr<expression>& f, const std::shared_ptr<expression>& bound, unsigned int dim) noexcept
+    : f(f), bound(bound), _dim(dim) {}
+    static std::unique_ptr<bounded_minimization> create(const std::shared_ptr<expression>& f, const std::shared_ptr<expression>& bound)
+    {
+        // N^a --bound--> N
+        // N^{a+1} --f--> N
+        // overall: N^a --$[bound] f--> N
+        if(bound->dim() + 1 != f->dim())
+        {
+            throw parse_error("Dimension mismatch in bounded minimization: "+f->show_type()+" does not match "+bound->show_type());
+        }
+        return std::make_unique<bounded_minimization>(f, bound, bound->dim());
+    }
+    natural eval(const std::vector<natural> &operands) const override
+    {
+        natural hi = bound->eval(operands);
+        std::vector<natural> xs = {0};
+        xs.insert(xs.end(), operands.begin(), operands.end());
+        if(monotone)
+        {
+            return eval_bisect(xs, hi);
+        }
+        if(parallel != nullptr)
+        {
+            return search_eval(*parallel, *f, xs, hi);
+        }
+        loop_probe probe(true, hi);
+        for(; xs[0] < hi; xs[0]++)
+        {
+            take_step();
+            probe.tick(xs[0]);
+            if(f->eval(xs) == 0) break;
+        }
+        return xs[0];
+    }
+    natural eval_bisect(std::vector<natural> &xs, natural hi) const
+    {
+        // f(lo) != 0 and f(hi) == 0, taking f(bound) to be 0
+        natural lo = 0;
+        loop_probe probe(true, hi);
+        if(hi == 0)
+        {
+            return 0;
+        }
+        take_step();
+        probe.tick(0);
+        if(f->eval(xs) == 0)
+        {
+            return 0;
+        }
+        while(hi - lo > 1)
+        {
+            xs[0] = lo + (hi - lo) / 2;
+            take_step();
+            probe.tick(xs[0]);
+            (f->eval(xs) == 0 ? hi : lo) = xs[0];
+        }
+        return hi;
+    }
     std::string to_string() const override
     {
-        return "$ " + f->to_string();
+        return (monotone ? "$![" : "$[") + bound->to_string() + "] " + f->to_string();
     }
 };
 
@@ -297,4 +560,13 @@ struct atomic_exp : public expression
     }
 };
 
+// the identifier wrapped by an atomic expression, if it is a T
+template<typename T>
+std::shared_ptr<T> atom_cast(const std::shared_ptr<expression>& e) noexcept
+{
+    auto atom = std::dynamic_pointer_cast<atomic_exp>(e);
+    if(atom == nullptr) return nullptr;
+    return std::dynamic_pointer_cast<T>(atom->idt);
+}
+
 #endif // TYPES_H
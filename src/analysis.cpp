@@ -0,0 +1,540 @@
+#include "analysis.h"
+#include <functional>
+
+std::ostream& operator<<(std::ostream& os, trend t)
+{
+    switch (t) {
+        case trend::constant:   return os << "constant";
+        case trend::increasing: return os << "increasing";
+        case trend::decreasing: return os << "decreasing";
+        case trend::unknown:    return os << "unknown";
+    }
+    return os;
+}
+
+/****** monotonicity ******/
+
+// the trend of a(b(x)) in x
+static trend chain(trend a, trend b) noexcept
+{
+    if(a == trend::constant || b == trend::constant) return trend::constant;
+    if(a == trend::unknown || b == trend::unknown) return trend::unknown;
+    return a == b ? trend::increasing : trend::decreasing;
+}
+
+// the weakest trend that both a and b have
+static trend join(trend a, trend b) noexcept
+{
+    if(a == trend::constant) return b;
+    if(b == trend::constant) return a;
+    return a == b ? a : trend::unknown;
+}
+
+static bool at_most(trend a, trend b) noexcept
+{
+    return join(a, b) == b;
+}
+
+monotonicity analyzer::monotone(const std::shared_ptr<expression>& e)
+{
+    monotonicity res(e->dim());
+    if(auto atom = std::dynamic_pointer_cast<atomic_exp>(e))
+    {
+        if(auto v = std::dynamic_pointer_cast<variable>(atom->idt))
+        {
+            auto it = monotonicities.find(v.get());
+            if(it != monotonicities.end()) return it->second;
+            res = monotone(v->defn);
+            monotonicities.insert({v.get(), res});
+        }
+        else if(auto c = std::dynamic_pointer_cast<constant>(atom->idt))
+        {
+            res.zero = c->k == 0;
+            std::fill(res.reductive.begin(), res.reductive.end(), res.zero);
+        }
+        else if(auto p = std::dynamic_pointer_cast<projection>(atom->idt))
+        {
+            res.trends[p->k-1] = trend::increasing;
+            res.extensive[p->k-1] = res.reductive[p->k-1] = true;
+        }
+        else // successor
+        {
+            res.trends[0] = trend::increasing;
+            res.extensive[0] = res.strict[0] = true;
+        }
+        return res;
+    }
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        auto f = monotone(comp->f);
+        res.zero = f.zero;
+        std::fill(res.reductive.begin(), res.reductive.end(), res.zero);
+        for(size_t i = 0; i < comp->gs.size(); i++)
+        {
+            if(f.trends[i] == trend::constant && !f.extensive[i] && !f.reductive[i]) continue;
+            auto g = monotone(comp->gs[i]);
+            for(size_t j = 0; j < res.trends.size(); j++)
+            {
+                res.trends[j] = join(res.trends[j], chain(f.trends[i], g.trends[j]));
+                res.extensive[j] = res.extensive[j] || (f.extensive[i] && g.extensive[j]);
+                res.strict[j] = res.strict[j] || (f.strict[i] && g.extensive[j]) || (f.extensive[i] && g.strict[j]);
+                res.reductive[j] = res.reductive[j] || (f.reductive[i] && g.reductive[j]);
+            }
+        }
+        return res;
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        // h(0, xs) = f(xs), h(n+1, xs) = g(n, h(n, xs), xs)
+        auto f = monotone(pr->f), g = monotone(pr->g);
+        if(g.extensive[1])
+        {
+            res.trends[0] = trend::increasing;
+        }
+        else if(g.reductive[1])
+        {
+            res.trends[0] = trend::decreasing;
+        }
+        else if(f.zero && g.trends[1] == trend::constant && at_most(g.trends[0], trend::increasing))
+        {
+            // h(0) = 0 and h(n+1) = g(n), like pred = 0 @ P2_1
+            res.trends[0] = trend::increasing;
+        }
+        else
+        {
+            res.trends[0] = trend::unknown;
+        }
+        res.extensive[0] = g.strict[1];
+        res.reductive[0] = f.zero && (g.reductive[0] || g.reductive[1]);
+        res.zero = f.zero && (g.zero || g.reductive[1]);
+        for(size_t j = 1; j < res.trends.size(); j++)
+        {
+            res.trends[j] = at_most(g.trends[1], trend::increasing)
+                          ? join(f.trends[j-1], g.trends[j+1])
+                          : trend::unknown;
+            res.extensive[j] = f.extensive[j-1] && (g.extensive[1] || g.extensive[j+1]);
+            res.strict[j] = f.strict[j-1] && (g.extensive[1] || g.strict[j+1]);
+            res.reductive[j] = f.reductive[j-1] && (g.reductive[1] || g.reductive[j+1]);
+        }
+        return res;
+    }
+    std::fill(res.trends.begin(), res.trends.end(), trend::unknown);
+    if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        // the result is at most the bound
+        auto b = monotone(bm->bound);
+        res.zero = b.zero;
+        res.reductive = b.reductive;
+    }
+    return res;
+}
+
+bool analyzer::is_upward_closed(const std::shared_ptr<expression>& f)
+{
+    // a decreasing function of n stays 0 once it reaches 0
+    return at_most(monotone(f).trends[0], trend::decreasing);
+}
+
+/****** cost ******/
+
+unsigned int estimate::grzegorczyk() const noexcept
+{
+    // loops over compositions of S, constants and projections stay
+    // linear; polynomially bounded loops stay in E^2
+    if(depth <= 1) return depth;
+    if(value_bounded && steps_bounded) return 2;
+    return depth + 1;
+}
+
+natural estimate::cost(const std::vector<natural>& operands) const noexcept
+{
+    return steps_bounded ? steps.eval(operands) : polynomial::infinity;
+}
+
+estimate analyzer::cost(const std::shared_ptr<expression>& e)
+{
+    estimate res;
+    if(auto atom = std::dynamic_pointer_cast<atomic_exp>(e))
+    {
+        if(auto v = std::dynamic_pointer_cast<variable>(atom->idt))
+        {
+            auto it = estimates.find(v.get());
+            if(it != estimates.end()) return it->second;
+            res = cost(v->defn);
+            estimates.insert({v.get(), res});
+        }
+        else if(auto c = std::dynamic_pointer_cast<constant>(atom->idt))
+        {
+            res.value = polynomial(c->k);
+        }
+        else if(auto p = std::dynamic_pointer_cast<projection>(atom->idt))
+        {
+            res.value = polynomial::variable(p->k);
+        }
+        else // successor
+        {
+            res.value = polynomial::variable(1) + polynomial(1);
+        }
+        return res;
+    }
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        auto f = cost(comp->f);
+        res.depth = f.depth;
+        res.partial = f.partial;
+        res.value_bounded = f.value_bounded;
+        res.steps_bounded = f.steps_bounded;
+        std::vector<polynomial> values;
+        for(size_t i = 0; i < comp->gs.size(); i++)
+        {
+            auto g = cost(comp->gs[i]);
+            res.depth = std::max(res.depth, g.depth);
+            res.partial = res.partial || g.partial;
+            res.steps = res.steps + g.steps;
+            res.steps_bounded = res.steps_bounded && g.steps_bounded;
+            if(!g.value_bounded)
+            {
+                res.value_bounded = res.value_bounded && f.value.degree_in(i + 1) == 0;
+                res.steps_bounded = res.steps_bounded && f.steps.degree_in(i + 1) == 0;
+            }
+            values.push_back(g.value);
+        }
+        res.value = f.value.substitute(values);
+        res.steps = res.steps + f.steps.substitute(values);
+        return res;
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        // h(0, xs) = f(xs), h(n+1, xs) = g(n, h(n, xs), xs), where the
+        // arguments of h are x1 = n and x(j+1) = xs_j
+        auto f = cost(pr->f), g = cost(pr->g);
+        res.depth = 1 + std::max(f.depth, g.depth);
+        res.partial = f.partial || g.partial;
+        auto n = polynomial::variable(1);
+        std::vector<polynomial> fs, gs = {n, polynomial()};
+        for(unsigned int j = 1; j <= pr->f->dim(); j++)
+        {
+            fs.push_back(polynomial::variable(j + 1));
+            gs.push_back(polynomial::variable(j + 1));
+        }
+        // g(n, a, xs) = a + q(n, xs) gives h <= f + n*q; growth faster
+        // in a, like a+a, is beyond polynomials
+        res.value_bounded = f.value_bounded && g.value_bounded;
+        unsigned int d = g.value.degree_in(2);
+        if(d == 0)
+        {
+            res.value = f.value.substitute(fs) + g.value.substitute(gs);
+        }
+        else if(d == 1 && g.value.coefficient_of(2, 1) == polynomial(1))
+        {
+            res.value = f.value.substitute(fs) + n * g.value.coefficient_of(2, 0).substitute(gs);
+        }
+        else
+        {
+            res.value_bounded = false;
+        }
+        gs[1] = res.value;
+        res.steps_bounded = f.steps_bounded && g.steps_bounded && (res.value_bounded || g.steps.degree_in(2) == 0);
+        res.steps = f.steps.substitute(fs) + n * (polynomial(1) + g.steps.substitute(gs));
+        return res;
+    }
+    if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        // at most b probes of f(n, xs) with n < b, and the result is at
+        // most b, where the arguments of f are x1 = n and x(j+1) = xs_j
+        auto b = cost(bm->bound), f = cost(bm->f);
+        res.depth = 1 + std::max(b.depth, f.depth);
+        res.partial = b.partial || f.partial;
+        res.value_bounded = b.value_bounded;
+        res.value = b.value;
+        std::vector<polynomial> fs = {b.value};
+        for(unsigned int j = 1; j <= bm->dim(); j++)
+        {
+            fs.push_back(polynomial::variable(j));
+        }
+        res.steps_bounded = b.steps_bounded && b.value_bounded && f.steps_bounded;
+        res.steps = b.steps + b.value * (polynomial(1) + f.steps.substitute(fs));
+        return res;
+    }
+    if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        auto f = cost(mn->f);
+        res.depth = f.depth;
+    }
+    res.partial = true;
+    res.value_bounded = res.steps_bounded = false;
+    return res;
+}
+
+/****** value ranges ******/
+
+value_range value_range::hull(const value_range& r) const noexcept
+{
+    return {std::min(lo, r.lo), std::max(hi, r.hi), wraps || r.wraps};
+}
+
+unsigned int value_range::bits() const noexcept
+{
+    for(unsigned int b : {8u, 16u, 32u})
+    {
+        if(hi < natural(1) << b) return b;
+    }
+    return 64;
+}
+
+std::string value_range::to_string() const
+{
+    auto show = [](natural n){ return n == polynomial::infinity ? std::string("max") : std::to_string(n); };
+    return "[" + show(lo) + ", " + show(hi) + "]" + (wraps ? " wrapping" : "");
+}
+
+// loops of at most this many iterations are followed one by one
+static constexpr natural unroll_limit = 16;
+
+value_range analyzer::range(const std::shared_ptr<expression>& e, const std::vector<value_range>& xs)
+{
+    if(auto atom = std::dynamic_pointer_cast<atomic_exp>(e))
+    {
+        if(auto v = std::dynamic_pointer_cast<variable>(atom->idt))
+        {
+            auto key = std::make_pair(static_cast<const variable*>(v.get()), xs);
+            auto it = ranges.find(key);
+            value_range res = it != ranges.end() ? it->second : range(v->defn, xs);
+            ranges.emplace(key, res);
+            auto [at, fresh] = reached_at.emplace(v.get(), reached.size());
+            if(fresh)
+            {
+                reached.push_back({v.get(), xs, res});
+            }
+            else
+            {
+                auto& r = reached[at->second];
+                for(size_t i = 0; i < xs.size(); i++)
+                {
+                    r.xs[i] = r.xs[i].hull(xs[i]);
+                }
+                r.value = r.value.hull(res);
+            }
+            return res;
+        }
+        else if(auto c = std::dynamic_pointer_cast<constant>(atom->idt))
+        {
+            return value_range::point(c->k);
+        }
+        else if(auto p = std::dynamic_pointer_cast<projection>(atom->idt))
+        {
+            return xs[p->k - 1];
+        }
+        // successor: only the largest natural wraps, to 0
+        const value_range& x = xs[0];
+        if(x.hi == polynomial::infinity)
+        {
+            return {0, x.lo == x.hi ? 0 : polynomial::infinity, true};
+        }
+        return {x.lo + 1, x.hi + 1, x.wraps};
+    }
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        std::vector<value_range> ys;
+        for(const auto& g : comp->gs)
+        {
+            ys.push_back(range(g, xs));
+        }
+        return range(comp->f, ys);
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        // h(0, xs) = f(xs), h(n+1, xs) = g(n, h(n, xs), xs)
+        const value_range& n = xs[0];
+        std::vector<value_range> fs(xs.begin() + 1, xs.end()), gs = {n, {}};
+        gs.insert(gs.end(), fs.begin(), fs.end());
+        value_range f = range(pr->f, fs);
+        if(n.hi <= unroll_limit)
+        {
+            std::optional<value_range> res;
+            value_range acc = f;
+            for(natural k = 0; ; k++)
+            {
+                if(k >= n.lo)
+                {
+                    res = res ? res->hull(acc) : acc;
+                }
+                if(k == n.hi) break;
+                gs[0] = value_range::point(k);
+                gs[1] = acc;
+                acc = range(pr->g, gs);
+            }
+            res->wraps = res->wraps || n.wraps;
+            return *res;
+        }
+        // the estimate bounds the loop in the natural numbers, which is
+        // where it runs if neither f nor g on accumulators below it wraps
+        auto est = cost(e);
+        std::vector<natural> his;
+        for(const auto& x : xs)
+        {
+            his.push_back(x.hi);
+        }
+        natural bound = est.value_bounded ? est.value.eval(his) : polynomial::infinity;
+        if(bound == polynomial::infinity || f.wraps)
+        {
+            return value_range::any();
+        }
+        gs[0] = {0, n.hi - 1, n.wraps};
+        gs[1] = {0, bound, false};
+        value_range g = range(pr->g, gs);
+        if(g.wraps)
+        {
+            return value_range::any();
+        }
+        value_range res = n.lo == 0 ? f.hull(g) : g;
+        return {res.lo, std::min(res.hi, bound), n.wraps};
+    }
+    if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        // the least n < b with f(n, xs) = 0, else b
+        value_range b = range(bm->bound, xs);
+        if(b.hi == 0)
+        {
+            return b;
+        }
+        std::vector<value_range> fs = {{0, b.hi - 1, b.wraps}};
+        fs.insert(fs.end(), xs.begin(), xs.end());
+        value_range f = range(bm->f, fs);
+        bool wraps = b.wraps || f.wraps;
+        if(f.lo > 0)
+        {
+            return {b.lo, b.hi, wraps};
+        }
+        return {0, f.hi == 0 ? 0 : b.hi, wraps};
+    }
+    if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        std::vector<value_range> fs = {{}};
+        fs.insert(fs.end(), xs.begin(), xs.end());
+        value_range f = range(mn->f, fs);
+        return {0, f.hi == 0 ? 0 : polynomial::infinity, f.wraps};
+    }
+    return value_range::any();
+}
+
+/****** annotated dumps ******/
+
+static std::string describe(const estimate& est)
+{
+    std::string res = "depth " + std::to_string(est.depth) + ", ";
+    res += est.partial ? "partial" : "total, E^" + std::to_string(est.grzegorczyk());
+    return res;
+}
+
+static std::string bound(bool bounded, const polynomial& p)
+{
+    return bounded ? p.to_string() : "unbounded";
+}
+
+std::string analyzer::annotate(const std::vector<std::shared_ptr<const variable>>& vs)
+{
+    std::ostringstream os;
+    for(const auto& v : vs)
+    {
+        auto est = cost(v->defn);
+        os << v->name << " = " << v->defn->to_string() << "\n";
+        os << "    ; N^" << v->dim() << " -> N, " << describe(est) << "\n";
+        os << "    ; value <= " << bound(est.value_bounded, est.value) << "\n";
+        os << "    ; steps <= " << bound(est.steps_bounded, est.steps) << "\n";
+    }
+    return os.str();
+}
+
+std::string analyzer::annotate_ranges(const std::shared_ptr<const variable>& v, const std::vector<value_range>& xs)
+{
+    reached.clear();
+    reached_at.clear();
+    auto atom = std::make_shared<atomic_exp>(std::const_pointer_cast<variable>(v));
+    range(atom, xs);
+    std::ostringstream os;
+    for(const auto& r : reached)
+    {
+        os << r.v->name << "(";
+        for(size_t i = 0; i < r.xs.size(); i++)
+        {
+            os << (i > 0 ? ", " : "") << "x" << i + 1 << " in " << r.xs[i].to_string();
+        }
+        os << ") in " << r.value.to_string() << ", " << r.value.bits() << " bits\n";
+    }
+    return os.str();
+}
+
+static std::string escape(const std::string& s)
+{
+    std::string res;
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\') res += '\\';
+        res += c;
+    }
+    return res;
+}
+
+std::string analyzer::annotate_dot(const std::vector<std::shared_ptr<const variable>>& vs)
+{
+    std::ostringstream os;
+    size_t next_id = 0;
+    // emits the tree of e and returns the name of its root
+    std::function<std::string(const std::shared_ptr<expression>&)> node = [&](const std::shared_ptr<expression>& e){
+        std::string id = "n" + std::to_string(next_id++);
+        std::vector<std::shared_ptr<expression>> children;
+        std::string label;
+        if(auto comp = std::dynamic_pointer_cast<composition>(e))
+        {
+            label = "compose";
+            children.push_back(comp->f);
+            children.insert(children.end(), comp->gs.begin(), comp->gs.end());
+        }
+        else if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+        {
+            label = "@";
+            children = {pr->f, pr->g};
+        }
+        else if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+        {
+            label = mn->monotone ? "$!" : "$";
+            children = {mn->f};
+        }
+        else if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+        {
+            label = bm->monotone ? "$![]" : "$[]";
+            children = {bm->bound, bm->f};
+        }
+        else
+        {
+            label = e->to_string();
+        }
+        auto est = cost(e);
+        os << "    " << id << " [label=\"" << escape(label) << "\\nsteps <= ";
+        os << escape(bound(est.steps_bounded, est.steps)) << "\"];\n";
+        if(auto v = atom_cast<variable>(e))
+        {
+            os << "    " << id << " -> \"" << escape(v->name) << "\" [style=dashed];\n";
+        }
+        for(const auto& c : children)
+        {
+            std::string child = node(c);
+            os << "    " << id << " -> " << child << ";\n";
+        }
+        return id;
+    };
+    os << "digraph kleene {\n";
+    os << "    node [shape=box, fontname=\"monospace\"];\n";
+    for(const auto& v : vs)
+    {
+        auto est = cost(v->defn);
+        os << "    \"" << escape(v->name) << "\" [shape=ellipse, label=\"" << escape(v->name);
+        os << " : N^" << v->dim() << " -> N\\n" << describe(est) << "\\nvalue <= ";
+        os << escape(bound(est.value_bounded, est.value)) << "\"];\n";
+        std::string root = node(v->defn);
+        os << "    \"" << escape(v->name) << "\" -> " << root << ";\n";
+    }
+    os << "}\n";
+    return os.str();
+}
@@ -0,0 +1,590 @@
+#include "closed_form.h"
+#include <algorithm>
+#include <functional>
+#include <random>
+
+using terms = closed_form::terms;
+using form = std::shared_ptr<const closed_form>;
+
+// coefficients above this are shown as negative, and are not small
+static constexpr natural half = natural(1) << 63;
+
+static void trim(polynomial::monomial& m)
+{
+    while(!m.empty() && m.back() == 0)
+    {
+        m.pop_back();
+    }
+}
+
+static terms constant_terms(natural k)
+{
+    terms res;
+    if(k != 0)
+    {
+        res[{}] = k;
+    }
+    return res;
+}
+
+static terms variable_terms(unsigned int i)
+{
+    polynomial::monomial m(i, 0);
+    m[i-1] = 1;
+    return {{m, 1}};
+}
+
+static void accumulate(terms& p, const polynomial::monomial& m, natural c)
+{
+    // wraps like the interpreter
+    natural& slot = p[m];
+    slot += c;
+    if(slot == 0)
+    {
+        p.erase(m);
+    }
+}
+
+static terms plus(const terms& a, const terms& b)
+{
+    terms res = a;
+    for(const auto& [m, c] : b)
+    {
+        accumulate(res, m, c);
+    }
+    return res;
+}
+
+static terms times(const terms& a, const terms& b)
+{
+    terms res;
+    for(const auto& [m1, c1] : a)
+    {
+        for(const auto& [m2, c2] : b)
+        {
+            polynomial::monomial m(std::max(m1.size(), m2.size()), 0);
+            for(size_t i = 0; i < m.size(); i++)
+            {
+                m[i] = (i < m1.size() ? m1[i] : 0) + (i < m2.size() ? m2[i] : 0);
+            }
+            accumulate(res, m, c1 * c2);
+        }
+    }
+    return res;
+}
+
+// p(qs[0], ..., qs[n-1]); variables beyond qs are taken as 0
+static terms substitute(const terms& p, const std::vector<terms>& qs)
+{
+    terms res;
+    for(const auto& [m, c] : p)
+    {
+        terms term = constant_terms(c);
+        for(size_t i = 0; i < m.size(); i++)
+        {
+            for(unsigned int e = 0; e < m[i]; e++)
+            {
+                term = times(term, i < qs.size() ? qs[i] : terms());
+            }
+        }
+        res = plus(res, term);
+    }
+    return res;
+}
+
+static bool reads(const terms& p, unsigned int i)
+{
+    for(const auto& [m, c] : p)
+    {
+        if(i <= m.size() && m[i-1] != 0) return true;
+    }
+    return false;
+}
+
+// x_i becomes x_{i+by}; with by < 0, the first -by variables must be unused
+static terms shift(const terms& p, int by)
+{
+    terms res;
+    for(const auto& [monomial, c] : p)
+    {
+        auto m = monomial;
+        if(by > 0)
+        {
+            m.insert(m.begin(), by, 0);
+        }
+        else
+        {
+            m.erase(m.begin(), m.begin() + std::min<size_t>(m.size(), -by));
+        }
+        trim(m);
+        res[m] = c;
+    }
+    return res;
+}
+
+// all coefficients non-negative and far from wrapping
+static bool small(const terms& p)
+{
+    for(const auto& [m, c] : p)
+    {
+        if(c >= half) return false;
+    }
+    return true;
+}
+
+static std::string show(const terms& p, const std::function<std::string(unsigned int)>& name)
+{
+    if(p.empty())
+    {
+        return "0";
+    }
+    std::string result;
+    for(auto it = p.rbegin(); it != p.rend(); ++it)
+    {
+        const auto& [m, c] = *it;
+        bool negative = c >= half;
+        natural size = negative ? -c : c;
+        std::string term;
+        for(size_t i = 0; i < m.size(); i++)
+        {
+            if(m[i] == 0) continue;
+            if(!term.empty()) term += "*";
+            term += name(i + 1);
+            if(m[i] > 1) term += "^" + std::to_string(m[i]);
+        }
+        if(term.empty())
+        {
+            term = std::to_string(size);
+        }
+        else if(size != 1)
+        {
+            term = std::to_string(size) + "*" + term;
+        }
+        if(result.empty())
+        {
+            result = negative ? "-" + term : term;
+        }
+        else
+        {
+            result += (negative ? " - " : " + ") + term;
+        }
+    }
+    return result;
+}
+
+closed_form::closed_form(kind k, unsigned int dim, terms p, std::vector<std::shared_ptr<const closed_form>> args)
+    : k(k), dim(dim), p(std::move(p)), args(std::move(args)), scheme(compile(this->p, 1))
+{
+    if(k != kind::monus)
+    {
+        return;
+    }
+    // the coefficients are natural, so the subtrahend is largest when
+    // every operand is
+    for(unsigned int b = 1; b <= 64; b++)
+    {
+        natural m = b == 64 ? polynomial::infinity : (natural(1) << b) - 1;
+        if(scheme.eval_saturating(std::vector<natural>(dim, m)) == polynomial::infinity)
+        {
+            break;
+        }
+        exact_below = m;
+    }
+}
+
+closed_form::horner closed_form::compile(const terms& p, unsigned int from)
+{
+    horner h;
+    unsigned int var = 0;
+    for(const auto& [m, c] : p)
+    {
+        for(size_t i = from - 1; i < m.size(); i++)
+        {
+            if(m[i] != 0 && (var == 0 || i + 1 < var))
+            {
+                var = i + 1;
+            }
+        }
+    }
+    if(var == 0)
+    {
+        auto it = p.find({});
+        h.constant = it != p.end() ? it->second : 0;
+        return h;
+    }
+    // p = sum of coefficient_e * x_var^e
+    std::vector<terms> parts;
+    for(const auto& [m, c] : p)
+    {
+        unsigned int e = var <= m.size() ? m[var-1] : 0;
+        auto rest = m;
+        if(e != 0)
+        {
+            rest[var-1] = 0;
+            trim(rest);
+        }
+        if(parts.size() <= e)
+        {
+            parts.resize(e + 1);
+        }
+        parts[e][rest] = c;
+    }
+    h.var = var;
+    for(const auto& part : parts)
+    {
+        h.coeffs.push_back(compile(part, var + 1));
+    }
+    return h;
+}
+
+natural closed_form::horner::eval(const std::vector<natural>& xs) const noexcept
+{
+    if(var == 0)
+    {
+        return constant;
+    }
+    natural x = xs[var-1], res = 0;
+    for(auto it = coeffs.rbegin(); it != coeffs.rend(); ++it)
+    {
+        res = res * x + it->eval(xs);
+    }
+    return res;
+}
+
+natural closed_form::horner::eval_saturating(const std::vector<natural>& xs) const noexcept
+{
+    if(var == 0)
+    {
+        return constant;
+    }
+    natural x = xs[var-1], res = 0;
+    for(auto it = coeffs.rbegin(); it != coeffs.rend(); ++it)
+    {
+        res = saturating_add(saturating_mul(res, x), it->eval_saturating(xs));
+    }
+    return res;
+}
+
+std::optional<natural> closed_form::eval(const std::vector<natural>& xs) const
+{
+    switch(k)
+    {
+    case kind::polynomial:
+        return scheme.eval(xs);
+    case kind::apply:
+    {
+        std::vector<natural> vs(args.size());
+        for(size_t i = 0; i < args.size(); i++)
+        {
+            auto v = args[i]->eval(xs);
+            if(!v) return std::nullopt;
+            vs[i] = *v;
+        }
+        return scheme.eval(vs);
+    }
+    case kind::monus:
+    {
+        auto a = args[0]->eval(xs);
+        natural top = 0;
+        for(natural x : xs)
+        {
+            top = std::max(top, x);
+        }
+        natural b = top <= exact_below ? scheme.eval(xs) : scheme.eval_saturating(xs);
+        if(!a || b == polynomial::infinity) return std::nullopt;
+        return *a > b ? *a - b : 0;
+    }
+    case kind::branch:
+    {
+        auto c = args[0]->eval(xs);
+        if(!c) return std::nullopt;
+        return args[*c == 0 ? 1 : 2]->eval(xs);
+    }
+    }
+    return std::nullopt;
+}
+
+bool closed_form::reads(unsigned int i) const
+{
+    if(k != kind::apply && ::reads(p, i))
+    {
+        return true;
+    }
+    for(const auto& a : args)
+    {
+        if(a->reads(i)) return true;
+    }
+    return false;
+}
+
+std::string closed_form::to_string() const
+{
+    auto x = [](unsigned int i){ return "x" + std::to_string(i); };
+    switch(k)
+    {
+    case kind::polynomial:
+        return show(p, x);
+    case kind::apply:
+        return show(p, [this](unsigned int i){ return "(" + args[i-1]->to_string() + ")"; });
+    case kind::monus:
+        return "(" + args[0]->to_string() + ") -. (" + show(p, x) + ")";
+    case kind::branch:
+        return "if " + args[0]->to_string() + " = 0 then " + args[1]->to_string() + " else " + args[2]->to_string();
+    }
+    return "";
+}
+
+std::optional<natural> closed_eval(const closed_form& c, const std::vector<natural>& operands)
+{
+    return c.eval(operands);
+}
+
+/****** Derivation ******/
+
+static form make_polynomial(unsigned int dim, terms p)
+{
+    return std::make_shared<closed_form>(closed_form::kind::polynomial, dim, std::move(p), std::vector<form>());
+}
+
+static form make_apply(unsigned int dim, const terms& p, std::vector<form> args)
+{
+    // only the arguments p reads matter
+    std::vector<terms> qs(args.size());
+    for(size_t i = 0; i < args.size(); i++)
+    {
+        if(!reads(p, i + 1)) continue;
+        if(p == variable_terms(i + 1))
+        {
+            return args[i];
+        }
+        if(args[i]->k != closed_form::kind::polynomial)
+        {
+            return std::make_shared<closed_form>(closed_form::kind::apply, dim, p, std::move(args));
+        }
+        qs[i] = args[i]->p;
+    }
+    return make_polynomial(dim, substitute(p, qs));
+}
+
+static form make_monus(unsigned int dim, form a, terms b)
+{
+    if(b.empty())
+    {
+        return a;
+    }
+    // (a - b1) - b2 = a - (b1 + b2) as long as b1 + b2 is small
+    if(a->k == closed_form::kind::monus && small(plus(a->p, b)))
+    {
+        return make_monus(dim, a->args[0], plus(a->p, b));
+    }
+    return std::make_shared<closed_form>(closed_form::kind::monus, dim, std::move(b), std::vector<form>{std::move(a)});
+}
+
+static form make_branch(unsigned int dim, form c, form z, form nz)
+{
+    using kind = closed_form::kind;
+    if(c->k == kind::polynomial && !c->p.empty() && c->p.size() == 1 && c->p.begin()->first.empty())
+    {
+        return nz;
+    }
+    if(c->k == kind::polynomial && c->p.empty())
+    {
+        return z;
+    }
+    // if c = 0 then 0 else c - 1, as pred makes it
+    if(c->k == kind::polynomial && z->k == kind::polynomial && z->p.empty()
+       && nz->k == kind::polynomial && nz->p == plus(c->p, constant_terms(~natural(0))))
+    {
+        return make_monus(dim, c, constant_terms(1));
+    }
+    return std::make_shared<closed_form>(kind::branch, dim, terms(), std::vector<form>{c, z, nz});
+}
+
+normalizer::form normalizer::compose(const form& f, const std::vector<form>& gs, unsigned int dim)
+{
+    using kind = closed_form::kind;
+    switch(f->k)
+    {
+    case kind::polynomial:
+        return make_apply(dim, f->p, gs);
+    case kind::apply:
+    {
+        std::vector<form> args;
+        for(const auto& a : f->args)
+        {
+            args.push_back(compose(a, gs, dim));
+            if(args.back() == nullptr) return nullptr;
+        }
+        return make_apply(dim, f->p, std::move(args));
+    }
+    case kind::monus:
+    {
+        auto a = compose(f->args[0], gs, dim);
+        std::vector<terms> qs(gs.size());
+        for(size_t i = 0; i < gs.size(); i++)
+        {
+            if(!reads(f->p, i + 1)) continue;
+            if(gs[i]->k != kind::polynomial) return nullptr;
+            qs[i] = gs[i]->p;
+        }
+        terms b = substitute(f->p, qs);
+        if(a == nullptr || !small(b)) return nullptr;
+        return make_monus(dim, a, b);
+    }
+    case kind::branch:
+    {
+        auto c = compose(f->args[0], gs, dim), z = compose(f->args[1], gs, dim), nz = compose(f->args[2], gs, dim);
+        if(c == nullptr || z == nullptr || nz == nullptr) return nullptr;
+        return make_branch(dim, c, z, nz);
+    }
+    }
+    return nullptr;
+}
+
+// h(0, xs) = f(xs), h(n+1, xs) = g(n, h(n, xs), xs)
+normalizer::form normalizer::recursion(const form& f, const form& g, unsigned int dim)
+{
+    using kind = closed_form::kind;
+    auto x = [dim](unsigned int i){ return make_polynomial(dim, variable_terms(i)); };
+    std::vector<form> xs;
+    for(unsigned int j = 2; j <= dim; j++)
+    {
+        xs.push_back(x(j));
+    }
+    auto base = compose(f, xs, dim);
+    if(base == nullptr) return nullptr;
+    // g ignores h(n-1, xs): h = if n = 0 then f(xs) else g(n-1, 0, xs)
+    if(!g->reads(2))
+    {
+        std::vector<form> args = {make_polynomial(dim, plus(variable_terms(1), constant_terms(~natural(0)))),
+                                  make_polynomial(dim, terms())};
+        args.insert(args.end(), xs.begin(), xs.end());
+        auto step = compose(g, args, dim);
+        if(step == nullptr) return nullptr;
+        return make_branch(dim, x(1), base, step);
+    }
+    // g = acc + d(xs): h = f(xs) + n * d(xs)
+    if(g->k == kind::polynomial)
+    {
+        terms d = g->p;
+        auto it = d.find({0, 1});
+        if(it == d.end() || it->second != 1) return nullptr;
+        d.erase(it);
+        if(reads(d, 1) || reads(d, 2)) return nullptr;
+        // y1 + y2 * d(y3, ...) on f(xs), n, xs, so d keeps its variables
+        terms p = plus(variable_terms(1), times(variable_terms(2), d));
+        std::vector<form> args = {base, x(1)};
+        args.insert(args.end(), xs.begin(), xs.end());
+        return make_apply(dim, p, args);
+    }
+    // g = acc - b(xs): h = f(xs) - n * b(xs)
+    if(g->k == kind::monus && g->args[0]->k == kind::polynomial && g->args[0]->p == variable_terms(2)
+       && !reads(g->p, 1) && !reads(g->p, 2))
+    {
+        terms b = times(variable_terms(1), shift(g->p, -1));
+        if(!small(b)) return nullptr;
+        return make_monus(dim, base, b);
+    }
+    return nullptr;
+}
+
+normalizer::form normalizer::derive(const std::shared_ptr<expression>& e)
+{
+    if(auto atom = std::dynamic_pointer_cast<atomic_exp>(e))
+    {
+        if(auto v = std::dynamic_pointer_cast<variable>(atom->idt))
+        {
+            return derive(*v);
+        }
+        if(auto c = std::dynamic_pointer_cast<constant>(atom->idt))
+        {
+            return make_polynomial(c->n, constant_terms(c->k));
+        }
+        if(auto p = std::dynamic_pointer_cast<projection>(atom->idt))
+        {
+            return make_polynomial(p->n, variable_terms(p->k));
+        }
+        return make_polynomial(1, plus(variable_terms(1), constant_terms(1)));
+    }
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        auto f = derive(comp->f);
+        std::vector<form> gs;
+        for(const auto& g : comp->gs)
+        {
+            gs.push_back(derive(g));
+            if(gs.back() == nullptr) return nullptr;
+        }
+        return f != nullptr ? compose(f, gs, comp->dim()) : nullptr;
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        auto f = derive(pr->f), g = derive(pr->g);
+        return f != nullptr && g != nullptr ? recursion(f, g, pr->dim()) : nullptr;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const closed_form> normalizer::derive(const variable& v)
+{
+    auto it = forms.find(&v);
+    if(it != forms.end())
+    {
+        return it->second;
+    }
+    auto c = derive(v.defn);
+    if(c != nullptr)
+    {
+        if(auto agreed = check(v, *c))
+        {
+            log.push_back(v.name + " = " + c->to_string() + " (agrees on " + std::to_string(*agreed) + " random arguments)");
+        }
+        else
+        {
+            log.push_back(v.name + " = " + c->to_string() + " disagrees with the interpreter; not used");
+            c = nullptr;
+        }
+    }
+    forms[&v] = c;
+    return c;
+}
+
+std::optional<unsigned int> normalizer::check(const variable& v, const closed_form& c)
+{
+    std::mt19937_64 rng(v.dim());
+    std::uniform_int_distribution<natural> pick(0, opts.sample_max);
+    unsigned int agreed = 0;
+    for(unsigned int s = 0; s < opts.samples; s++)
+    {
+        std::vector<natural> xs(v.dim());
+        for(auto& x : xs)
+        {
+            x = pick(rng);
+        }
+        natural expected;
+        try
+        {
+            step_limit limit(opts.sample_steps);
+            expected = v.defn->eval(xs);
+        }
+        catch(const budget_exceeded&)
+        {
+            continue;
+        }
+        auto got = c.eval(xs);
+        if(!got) continue;
+        if(*got != expected) return std::nullopt;
+        agreed++;
+    }
+    return agreed;
+}
+
+std::string normalizer::report() const
+{
+    std::string result;
+    for(const auto& line : log)
+    {
+        result += line + "\n";
+    }
+    return result;
+}
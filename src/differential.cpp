@@ -0,0 +1,126 @@
+#include "differential.h"
+#include "machine.h"
+
+std::vector<engine> all_engines(std::shared_ptr<scheduler> pool)
+{
+    return {
+        {"optimized", [](parser&){}},
+        {"checkpoints", [](parser& p){ p.set_checkpoints(true); }},
+        {"fast-min", [](parser& p){ p.set_fast_min(true); }},
+        {"memo", [](parser& p){ p.set_memo(true); }},
+        // promoted after a few calls, so that every tier is exercised
+        {"tiering", [](parser& p){ p.set_tiering(true, {.optimize_after = 2, .memoise_after = 4, .memoise_min_steps = 1}); }},
+        {"closed-forms", [](parser& p){ p.set_closed_forms(true); }},
+        {"parallel", [pool](parser& p){ p.set_parallel(pool, 0); }},
+        {"combined", [](parser& p){
+            p.set_checkpoints(true);
+            p.set_fast_min(true);
+            p.set_memo(true);
+            p.set_closed_forms(true);
+        }},
+        {"machine", [](parser&){}, true},
+    };
+}
+
+std::string mismatch::to_string() const
+{
+    std::string args;
+    for(natural x : at.args)
+    {
+        args += (args.empty() ? "" : ", ") + std::to_string(x);
+    }
+    return engine + ": " + at.name + "(" + args + ") gave " + got + " instead of " + expected;
+}
+
+std::string differential::show(const outcome& o)
+{
+    if(auto value = std::get_if<natural>(&o))
+    {
+        return std::to_string(*value);
+    }
+    if(auto error = std::get_if<std::string>(&o))
+    {
+        return "error '" + *error + "'";
+    }
+    return "no result";
+}
+
+differential::outcome differential::run(const engine& e, const std::shared_ptr<const program>& prog, const call& c) const
+{
+    try
+    {
+        auto v = prog->get_variable(c.name);
+        if(v == nullptr)
+        {
+            throw interprete_error("Undefined variable: " + c.name);
+        }
+        if(e.on_machine)
+        {
+            machine m(prog, *v, c.args);
+            if(!m.run(fuel))
+            {
+                return std::monostate();
+            }
+            return m.result();
+        }
+        step_limit limit(fuel);
+        return prog->eval(*v, c.args);
+    }
+    catch(const budget_exceeded&)
+    {
+        return std::monostate();
+    }
+    catch(const std::exception& err)
+    {
+        return std::string(err.what());
+    }
+}
+
+std::vector<mismatch> differential::compare(const std::string& source, const std::vector<call>& calls) const
+{
+    done = out_of_fuel = 0;
+    std::vector<mismatch> found;
+    auto load = [&source](const engine& e){
+        auto p = parser::create(source);
+        e.configure(*p);
+        p->parse();
+        return p->build();
+    };
+    engine reference{"reference", [](parser& p){ p.set_optimize(false); }};
+    auto expected_prog = load(reference);
+    std::vector<outcome> expected;
+    for(const auto& c : calls)
+    {
+        expected.push_back(run(reference, expected_prog, c));
+    }
+    for(const auto& e : engines)
+    {
+        std::shared_ptr<const program> prog;
+        try
+        {
+            prog = load(e);
+        }
+        catch(const std::exception& err)
+        {
+            found.push_back({e.name, {"(parse)", {}}, "a program", "error '" + std::string(err.what()) + "'"});
+            continue;
+        }
+        for(size_t i = 0; i < calls.size(); i++)
+        {
+            auto got = run(e, prog, calls[i]);
+            if(std::holds_alternative<std::monostate>(got) || std::holds_alternative<std::monostate>(expected[i]))
+            {
+                out_of_fuel++;
+            }
+            else if(got != expected[i])
+            {
+                found.push_back({e.name, calls[i], show(expected[i]), show(got)});
+            }
+            else
+            {
+                done++;
+            }
+        }
+    }
+    return found;
+}
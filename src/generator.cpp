@@ -0,0 +1,99 @@
+#include "generator.h"
+
+unsigned int program_generator::pick(unsigned int n)
+{
+    return std::uniform_int_distribution<unsigned int>(0, n - 1)(rng);
+}
+
+std::vector<natural> program_generator::arguments(unsigned int n, natural max)
+{
+    std::uniform_int_distribution<natural> value(0, max);
+    std::vector<natural> xs(n);
+    for(auto& x : xs)
+    {
+        x = value(rng);
+    }
+    return xs;
+}
+
+std::string program_generator::operand(const text& t)
+{
+    return t.f == text::form::loop ? "(" + t.s + ")" : t.s;
+}
+
+program_generator::text program_generator::atom(unsigned int dim, unsigned int loops)
+{
+    std::string k = std::to_string(pick(3));
+    std::vector<std::string> choices = {dim == 0 ? k : "C" + std::to_string(dim) + "_" + k};
+    for(unsigned int i = 1; i <= dim; i++)
+    {
+        choices.insert(choices.end(), 2, "P" + std::to_string(dim) + "_" + std::to_string(i));
+    }
+    if(dim == 1)
+    {
+        choices.insert(choices.end(), 3, "S");
+    }
+    for(const auto& d : defs)
+    {
+        if(d.dim == dim && d.loops <= loops)
+        {
+            choices.insert(choices.end(), 2, d.name);
+        }
+    }
+    return {choices[pick(choices.size())], text::form::atom};
+}
+
+program_generator::text program_generator::function(unsigned int dim, unsigned int depth, unsigned int loops)
+{
+    if(depth > 0 && pick(4) == 0)
+    {
+        auto t = expression(dim, depth - 1, loops);
+        return t.f == text::form::atom ? t : text{"(" + t.s + ")", text::form::atom};
+    }
+    return atom(dim, loops);
+}
+
+program_generator::text program_generator::expression(unsigned int dim, unsigned int depth, unsigned int loops)
+{
+    unsigned int r = pick(10);
+    if(depth == 0 || r >= 8)
+    {
+        return atom(dim, loops);
+    }
+    if(loops > 0 && r < 3)
+    {
+        if(dim > 0 && pick(100) >= opts.search_percent)
+        {
+            auto f = expression(dim - 1, depth - 1, loops - 1);
+            auto g = expression(dim + 1, depth - 1, loops - 1);
+            return {operand(f) + " @ " + operand(g), text::form::loop};
+        }
+        auto g = expression(dim + 1, depth - 1, loops - 1);
+        if(pick(2) == 0)
+        {
+            auto b = expression(dim, depth - 1, loops - 1);
+            return {"$[" + b.s + "] " + operand(g), text::form::loop};
+        }
+        return {"$" + operand(g), text::form::loop};
+    }
+    unsigned int arity = 1 + pick(std::max(opts.max_dim, 1u));
+    std::string s = function(arity, depth, loops).s + "(";
+    for(unsigned int i = 0; i < arity; i++)
+    {
+        s += (i > 0 ? ", " : "") + expression(dim, depth - 1, loops).s;
+    }
+    return {s + ")", text::form::composition};
+}
+
+std::string program_generator::generate()
+{
+    defs.clear();
+    std::string source;
+    for(unsigned int i = 0; i < opts.definitions; i++)
+    {
+        defined d{i + 1 == opts.definitions ? "main" : "f" + std::to_string(i), pick(opts.max_dim + 1), pick(opts.max_loops + 1)};
+        source += d.name + " = " + expression(d.dim, opts.max_depth, d.loops).s + "\n";
+        defs.push_back(d);
+    }
+    return source;
+}
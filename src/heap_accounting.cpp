@@ -0,0 +1,46 @@
+#include "perf_stats.h"
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+/*
+The global operator new and delete, counting for perf_recorder. Kept out
+of parser_lib so that only the programs linking this file pay for them.
+*/
+
+static const bool hooked = (heap_accounting::hook(), true);
+
+void* operator new(std::size_t size)
+{
+    for(;;)
+    {
+        if(void* p = std::malloc(size == 0 ? 1 : size))
+        {
+            if(heap_accounting::counting())
+            {
+                heap_accounting::allocated_block(malloc_usable_size(p));
+            }
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if(handler == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    if(p != nullptr && heap_accounting::counting())
+    {
+        heap_accounting::freed_block(malloc_usable_size(p));
+    }
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
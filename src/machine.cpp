@@ -0,0 +1,490 @@
+#include "machine.h"
+#include <functional>
+#include <typeinfo>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+
+machine::machine(std::shared_ptr<const program> prog, const variable& v, std::vector<natural> operands)
+    : prog(std::move(prog)), entry(v.name), operands(std::move(operands))
+{
+    if(v.dim() != this->operands.size())
+    {
+        throw interprete_error(v.name + " expects " + std::to_string(v.dim()) + " arguments, but "
+                               + std::to_string(this->operands.size()) + " provided");
+    }
+    call(v.defn.get(), this->operands);
+    finished = top == 0;
+}
+
+void machine::give(natural value)
+{
+    top--;
+    ret = value;
+    finished = top == 0;
+}
+
+// follows variables from e; the identifier if e is an atom
+static const identifier* resolve(const expression*& e)
+{
+    while(typeid(*e) == typeid(atomic_exp))
+    {
+        auto idt = static_cast<const atomic_exp*>(e)->idt.get();
+        if(typeid(*idt) != typeid(variable))
+        {
+            return idt;
+        }
+        e = static_cast<const variable*>(idt)->defn.get();
+    }
+    return nullptr;
+}
+
+bool machine::atom(const expression*& e, const std::vector<natural>& args)
+{
+    if(auto idt = resolve(e))
+    {
+        ret = idt->eval(args);
+        return true;
+    }
+    return false;
+}
+
+void machine::call(const expression* e, const std::vector<natural>& args)
+{
+    if(!atom(e, args))
+    {
+        push(e, args);
+    }
+}
+
+void machine::push(const expression* e, const std::vector<natural>& args)
+{
+    // frames above the top are kept to reuse their vectors; args may be
+    // part of the stack, so it is copied before the stack grows
+    if(top == stack.size())
+    {
+        std::vector<natural> copy(args);
+        stack.emplace_back();
+        stack[top].args = std::move(copy);
+    }
+    else
+    {
+        stack[top].args.assign(args.begin(), args.end());
+    }
+    enter(e);
+}
+
+void machine::enter(const expression* e)
+{
+    frame& fr = stack[top++];
+    fr.e = e;
+    fr.phase = 0;
+    fr.lo = fr.hi = fr.stride = 0;
+    fr.values.clear();
+    if(typeid(*e) == typeid(composition))
+    {
+        fr.k = kind::composition;
+    }
+    else if(typeid(*e) == typeid(primitive_recursion))
+    {
+        fr.k = kind::recursion;
+        fr.values.push_back(0);
+        fr.values.push_back(0);
+        fr.values.insert(fr.values.end(), fr.args.begin() + 1, fr.args.end());
+    }
+    else if(typeid(*e) == typeid(bounded_minimization))
+    {
+        fr.k = kind::bounded;
+        fr.values.push_back(0);
+        fr.values.insert(fr.values.end(), fr.args.begin(), fr.args.end());
+    }
+    else
+    {
+        fr.k = static_cast<const minimization*>(e)->monotone ? kind::bisection : kind::minimization;
+        fr.values.push_back(0);
+        fr.values.insert(fr.values.end(), fr.args.begin(), fr.args.end());
+    }
+}
+
+bool machine::run(natural budget)
+{
+    while(!finished && budget > 0)
+    {
+        natural n = advance(budget);
+        budget -= n;
+        taken += n;
+    }
+    return finished;
+}
+
+natural machine::advance(natural budget)
+{
+    // the frame may move when call() pushes, so fields are read first
+    frame& fr = stack[top-1];
+    switch(fr.k)
+    {
+    case kind::composition:
+    {
+        auto comp = static_cast<const composition*>(fr.e);
+        if(fr.values.size() < fr.phase)
+        {
+            fr.values.push_back(ret);
+        }
+        // atoms among gs take no step of their own
+        while(fr.phase < comp->gs.size())
+        {
+            const expression* g = comp->gs[fr.phase++].get();
+            if(!atom(g, fr.args))
+            {
+                push(g, fr.args);
+                return 1;
+            }
+            fr.values.push_back(ret);
+        }
+        // f takes the place of the composition, on the values of gs
+        std::swap(fr.args, fr.values);
+        top--;
+        const expression* f = comp->f.get();
+        if(!atom(f, fr.args))
+        {
+            enter(f);
+        }
+        finished = top == 0;
+        break;
+    }
+    case kind::recursion:
+    {
+        auto pr = static_cast<const primitive_recursion*>(fr.e);
+        switch(fr.phase)
+        {
+        case 0:
+            fr.phase = 1;
+            call(pr->f.get(), std::vector<natural>(fr.values.begin() + 2, fr.values.end()));
+            break;
+        case 1:
+        case 3:
+            if(fr.phase == 3) fr.values[0]++;
+            fr.values[1] = ret;
+            [[fallthrough]];
+        case 2:
+        {
+            const expression* g = pr->g.get();
+            auto idt = resolve(g);
+            natural n = 1;
+            if(idt != nullptr)
+            {
+                // an atomic step is applied in place, a step per iteration
+                for(n = 0; fr.values[0] < fr.args[0] && n < budget; n++)
+                {
+                    fr.values[1] = idt->eval(fr.values);
+                    fr.values[0]++;
+                }
+                fr.phase = 2;
+            }
+            if(fr.values[0] == fr.args[0])
+            {
+                give(fr.values[1]);
+            }
+            else if(idt == nullptr)
+            {
+                fr.phase = 3;
+                push(g, fr.values);
+            }
+            return std::max<natural>(n, 1);
+        }
+        }
+        break;
+    }
+    case kind::minimization:
+    {
+        auto mn = static_cast<const minimization*>(fr.e);
+        if(fr.phase == 0)
+        {
+            fr.phase = 1;
+            call(mn->f.get(), fr.values);
+        }
+        else if(ret == 0)
+        {
+            give(fr.values[0]);
+        }
+        else
+        {
+            fr.values[0]++;
+            call(mn->f.get(), fr.values);
+        }
+        break;
+    }
+    case kind::bisection:
+    {
+        // as minimization::eval_bisect: f(lo) != 0 and f(hi) == 0
+        auto mn = static_cast<const minimization*>(fr.e);
+        switch(fr.phase)
+        {
+        case 0:
+            fr.phase = 1;
+            call(mn->f.get(), fr.values);
+            break;
+        case 1:
+            if(ret == 0)
+            {
+                give(0);
+                break;
+            }
+            fr.stride = 1;
+            fr.phase = 2;
+            fr.values[0] = fr.hi = fr.lo + fr.stride;
+            call(mn->f.get(), fr.values);
+            break;
+        case 2:
+            if(ret != 0)
+            {
+                fr.lo = fr.hi;
+                fr.stride *= 2;
+                fr.values[0] = fr.hi = fr.lo + fr.stride;
+                call(mn->f.get(), fr.values);
+                break;
+            }
+            fr.phase = 3;
+            [[fallthrough]];
+        case 3:
+        case 4:
+            if(fr.phase == 4)
+            {
+                (ret == 0 ? fr.hi : fr.lo) = fr.values[0];
+            }
+            if(fr.hi - fr.lo > 1)
+            {
+                fr.phase = 4;
+                fr.values[0] = fr.lo + (fr.hi - fr.lo) / 2;
+                call(mn->f.get(), fr.values);
+            }
+            else
+            {
+                give(fr.hi);
+            }
+            break;
+        }
+        break;
+    }
+    case kind::bounded:
+    {
+        // as bounded_minimization::eval, with the bound in hi
+        auto bm = static_cast<const bounded_minimization*>(fr.e);
+        switch(fr.phase)
+        {
+        case 0:
+            fr.phase = 1;
+            call(bm->bound.get(), fr.args);
+            break;
+        case 1:
+            fr.hi = ret;
+            if(fr.hi == 0)
+            {
+                give(0);
+                break;
+            }
+            fr.phase = bm->monotone ? 3 : 2;
+            call(bm->f.get(), fr.values);
+            break;
+        case 2:
+            if(ret == 0 || ++fr.values[0] == fr.hi)
+            {
+                give(fr.values[0]);
+            }
+            else
+            {
+                call(bm->f.get(), fr.values);
+            }
+            break;
+        case 3:
+        case 4:
+            if(ret == 0 && fr.phase == 3)
+            {
+                give(0);
+                break;
+            }
+            if(fr.phase == 4)
+            {
+                (ret == 0 ? fr.hi : fr.lo) = fr.values[0];
+            }
+            if(fr.hi - fr.lo > 1)
+            {
+                fr.phase = 4;
+                fr.values[0] = fr.lo + (fr.hi - fr.lo) / 2;
+                call(bm->f.get(), fr.values);
+            }
+            else
+            {
+                give(fr.hi);
+            }
+            break;
+        }
+        break;
+    }
+    }
+    return 1;
+}
+
+// every compound node of a program, numbered in an order that only
+// depends on the text of its definitions
+static std::vector<const expression*> nodes_of(const program& prog)
+{
+    std::vector<const expression*> nodes;
+    std::function<void(const expression*)> walk = [&](const expression* e){
+        if(auto comp = dynamic_cast<const composition*>(e))
+        {
+            nodes.push_back(e);
+            walk(comp->f.get());
+            for(const auto& g : comp->gs)
+            {
+                walk(g.get());
+            }
+        }
+        else if(auto pr = dynamic_cast<const primitive_recursion*>(e))
+        {
+            nodes.push_back(e);
+            walk(pr->f.get());
+            walk(pr->g.get());
+        }
+        else if(auto mn = dynamic_cast<const minimization*>(e))
+        {
+            nodes.push_back(e);
+            walk(mn->f.get());
+        }
+        else if(auto bm = dynamic_cast<const bounded_minimization*>(e))
+        {
+            nodes.push_back(e);
+            walk(bm->bound.get());
+            walk(bm->f.get());
+        }
+    };
+    for(const auto& v : prog.variables())
+    {
+        walk(v->defn.get());
+    }
+    return nodes;
+}
+
+static const char* state_header = "kleene-state 1";
+
+void machine::save(std::ostream& out) const
+{
+    auto nodes = nodes_of(*prog);
+    std::unordered_map<const expression*, size_t> index;
+    for(size_t i = 0; i < nodes.size(); i++)
+    {
+        index.emplace(nodes[i], i);
+    }
+    auto list = [&out](const std::vector<natural>& xs){
+        out << " " << xs.size();
+        for(natural x : xs)
+        {
+            out << " " << x;
+        }
+    };
+    out << state_header << "\n";
+    out << "program " << prog->fingerprint() << "\n";
+    out << "entry " << entry;
+    list(operands);
+    out << "\n" << "at " << taken << " " << ret << " " << finished << " " << top << "\n";
+    for(size_t d = 0; d < top; d++)
+    {
+        const frame& fr = stack[d];
+        out << index.at(fr.e) << " " << static_cast<int>(fr.k) << " " << fr.phase << " "
+            << fr.lo << " " << fr.hi << " " << fr.stride;
+        list(fr.args);
+        list(fr.values);
+        out << "\n";
+    }
+}
+
+std::unique_ptr<machine> machine::restore(std::shared_ptr<const program> prog, std::istream& in)
+{
+    auto fail = [](const std::string& why) -> interprete_error {
+        return interprete_error("Cannot restore evaluation: " + why);
+    };
+    auto expect = [&](const std::string& word){
+        std::string w;
+        if(!(in >> w) || w != word)
+        {
+            throw fail("'" + word + "' expected");
+        }
+    };
+    auto list = [&](std::vector<natural>& xs, size_t most){
+        size_t n;
+        if(!(in >> n) || n > most)
+        {
+            throw fail("malformed state");
+        }
+        xs.resize(n);
+        for(auto& x : xs)
+        {
+            in >> x;
+        }
+    };
+    std::string header;
+    if(!std::getline(in, header) || header != state_header)
+    {
+        throw fail("not a saved state");
+    }
+    natural hash;
+    expect("program");
+    in >> hash;
+    if(!in || hash != prog->fingerprint())
+    {
+        throw fail("it was saved for a different program");
+    }
+    std::unique_ptr<machine> m(new machine(prog));
+    expect("entry");
+    in >> m->entry;
+    list(m->operands, ~size_t(0));
+    size_t depth;
+    expect("at");
+    in >> m->taken >> m->ret >> m->finished >> depth;
+    auto nodes = nodes_of(*prog);
+    for(size_t d = 0; in && d < depth; d++)
+    {
+        size_t id;
+        int k;
+        frame fr{nullptr, kind::composition, {}, {}};
+        in >> id >> k >> fr.phase >> fr.lo >> fr.hi >> fr.stride;
+        if(!in || id >= nodes.size() || k < 0 || k > static_cast<int>(kind::bounded))
+        {
+            throw fail("malformed frame");
+        }
+        fr.e = nodes[id];
+        fr.k = static_cast<kind>(k);
+        bool fits = fr.k == kind::composition ? dynamic_cast<const composition*>(fr.e) != nullptr
+                  : fr.k == kind::recursion ? dynamic_cast<const primitive_recursion*>(fr.e) != nullptr
+                  : fr.k == kind::bounded ? dynamic_cast<const bounded_minimization*>(fr.e) != nullptr
+                  : dynamic_cast<const minimization*>(fr.e) != nullptr;
+        if(!fits)
+        {
+            throw fail("frame does not match the program");
+        }
+        // as enter() and advance() leave them: a composition has the values
+        // of the arguments before its phase, the other frames their loop
+        // variable, the accumulator of a recursion, and their arguments
+        size_t dim = fr.e->dim();
+        size_t gs = fr.k == kind::composition ? static_cast<const composition*>(fr.e)->gs.size() : 0;
+        list(fr.args, dim);
+        list(fr.values, fr.k == kind::composition ? gs : dim + 1);
+        unsigned int phases = fr.k == kind::composition ? gs
+                            : fr.k == kind::recursion ? 3
+                            : fr.k == kind::minimization ? 1 : 4;
+        bool sized = fr.args.size() == dim && fr.phase <= phases
+                  && (fr.k == kind::composition ? fr.values.size() == fr.phase || fr.values.size() + 1 == fr.phase
+                                                : fr.values.size() == dim + 1);
+        if(!in || !sized || (fr.k == kind::recursion && fr.values[0] > fr.args[0]))
+        {
+            throw fail("malformed frame");
+        }
+        m->stack.push_back(std::move(fr));
+    }
+    m->top = m->stack.size();
+    if(!in || (m->top == 0) != m->finished)
+    {
+        throw fail("malformed state");
+    }
+    return m;
+}
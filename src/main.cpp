@@ -1,19 +1,137 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <memory>
 #include <vector>
 #include <string>
+#include <map>
+#include <chrono>
+#include <filesystem>
+#include <csignal>
 #include "parser.h"
+#include "server.h"
+#include "machine.h"
+#include "sweep.h"
+#include "result_store.h"
+#include "perf_stats.h"
 
 std::string version_str = "Kleene interpreter, version 0.2.0";
 
 std::string help_str = R"(
 usage: kleene [option] file [arg] ...
+       kleene --serve [option] file ...
 Options: 
   -h,    : print this help message and exit (also --help)
   -e var : the entry point. If not specified, entry point is 'main'
   -i     : interactive mode; will run script first if entry point
            is valid (also --interactive)
+  --specialize var:pos=value
+         : define var_pos_value as var with its pos-th argument fixed
+           to value; the entry point is replaced by its specialisation.
+           May be given several times
+  --eager
+         : parse and check every definition, not only those the entry
+           point depends on
+  --no-opt
+         : keep definitions exactly as written instead of simplifying them
+  --checkpoints
+         : remember results of primitive recursions so that a call with
+           a larger counter resumes from the nearest earlier result
+  --fast-min
+         : search by galloping and bisection in minimizations whose
+           predicate provably stays 0 once it is 0 (as with '$!')
+  --memo
+         : remember results of definitions that loop, in a table shared
+           by all threads
+  --memo-stats
+         : like --memo, and report hits, misses and lock contention of
+           the table when done
+  --tiering
+         : start every definition as written and switch it to its
+           simplified, then memoised form once it has been called often
+  --tiering-stats
+         : like --tiering, and report for each definition called the
+           tier it reached, its calls and time per tier and the time
+           saved by promotion
+  --closed-forms
+         : evaluate definitions made of '@' loops over S and projections,
+           such as add, mul or sub, by a closed polynomial form, each
+           checked against the interpreter on random arguments first
+  --closed-forms-stats
+         : like --closed-forms, and list the forms found
+  --parallel n
+         : evaluate arguments of a composition that are expected to take
+           long on n threads at once (0: one per core)
+  --fork-threshold n
+         : with --parallel, the estimated number of loop steps from which
+           an argument is evaluated in parallel, and the size of the
+           chunks of a bounded search '$[b]' (default 10000)
+  --parallel-parse
+         : parse the lines of the program on several threads, those of
+           --parallel if given, and then resolve their names in order
+  --progress
+         : report the iterations of the active '@' and '$' loops and
+           their rate on stderr every second; without it, SIGUSR1
+           turns these reports on, counting from the signal on
+  --save-state path
+         : evaluate on a resumable evaluator and save its state to path
+           every minute, and when interrupted by SIGINT or SIGTERM
+  --save-every n
+         : with --save-state, save every n seconds instead
+  --resume
+         : with --save-state, continue the evaluation saved in path, if
+           any; the program, entry point and arguments must be the same
+  --module-cache dir
+         : keep compiled modules in dir instead of $XDG_CACHE_HOME/kleene
+           or ~/.cache/kleene
+  --no-module-cache
+         : compile imported modules afresh on every run
+  --cache-dir dir
+         : look the result of the entry point up in the result cache of
+           dir before evaluating it, and store it there afterwards;
+           results are found by the structure of the definitions they
+           use, whatever their names
+  --cache-size n
+         : with --cache-dir, the number of results a new cache holds
+           before it forgets the least recently used (default 65536)
+  --cache-stats
+         : with --cache-dir, report hits and misses of the cache
+  --sweep pos=lo..hi
+         : print the entry point on the given arguments with the
+           argument at pos (1-based, left out of the arguments) set to
+           each of lo, ..., hi, one "n value" line each; when pos is the
+           counter of an '@' loop, the loop runs only once
+  --analyze
+         : print each definition annotated with its '@' nesting depth,
+           Grzegorczyk level and bounds on its value and loop steps
+           in terms of its arguments x1, x2, ..., then exit
+  --analyze-dot
+         : like --analyze, as a Graphviz digraph
+  --opt-stats
+         : report node counts of each definition and the evaluation time
+           of the entry point before and after simplification
+  --ranges
+         : before evaluating, list every definition the entry point
+           reaches on its arguments (and with --sweep, on the swept range)
+           with the ranges of its arguments and values and the bits they
+           fit in; a report only, evaluation does not use it
+  --perf-stats
+         : report time, processor counters (cycles, instructions, cache
+           and branch misses, where perf_event_open offers them) and heap
+           allocations of parsing, optimising and evaluating
+  --perf-json path
+         : like --perf-stats, written to path as JSON
+  --serve
+         : load every file given and answer JSON requests, one per line,
+           like {"id": 1, "program": "isprime", "entry": "isprime",
+           "args": [97], "budget": 100000}; programs are named after
+           their files and the first one is the default
+  --threads n
+         : evaluate requests on n threads (default: one per core)
+  --budget n
+         : give up requests after n iterations of '@' and probes of '$'
+  --socket path
+         : listen on a Unix domain socket instead of stdin/stdout
 Arguments:
   file   : program read from script file. The entry point function 
            will be evaluated with the arguments passed
@@ -27,6 +145,138 @@ void show_help()
     std::cout << help_str.substr(1);
 }
 
+void show_perf_stats(perf_recorder& perf, bool to_stderr, const std::string& json_path)
+{
+    perf.enter("report");
+    if(to_stderr)
+    {
+        std::istringstream lines(perf.to_string());
+        for(std::string line; std::getline(lines, line); )
+        {
+            std::cerr << "[perf-stats] " << line << "\n";
+        }
+        std::cerr << std::flush;
+    }
+    if(!json_path.empty())
+    {
+        std::ofstream out(json_path);
+        out << perf.to_json() << "\n";
+        if(!out)
+        {
+            std::cerr << "Cannot write " << json_path << std::endl;
+        }
+    }
+}
+
+// the ranges of what v reaches on arguments in xs
+void show_ranges(const std::shared_ptr<const variable>& v, const std::vector<value_range>& xs)
+{
+    analyzer ana;
+    std::istringstream lines(ana.annotate_ranges(v, xs));
+    for(std::string line; std::getline(lines, line); )
+    {
+        std::cerr << "[ranges] " << line << "\n";
+    }
+    std::cerr << std::flush;
+}
+
+void show_opt_stats(const program& optimized, const program& reference)
+{
+    size_t before = 0, after = 0;
+    const auto& vs = optimized.variables();
+    const auto& rs = reference.variables();
+    for(size_t i = 0; i < vs.size() && i < rs.size(); i++)
+    {
+        size_t b = node_count(rs[i]->defn), a = node_count(vs[i]->defn);
+        std::cerr << "[opt-stats] " << vs[i]->name << ": " << b << " -> " << a << " nodes\n";
+        before += b;
+        after += a;
+    }
+    std::cerr << "[opt-stats] total: " << before << " -> " << after << " nodes" << std::endl;
+}
+
+void show_memo_stats(const std::string& name, const program& prog)
+{
+    if(prog.memo_results() != nullptr)
+    {
+        std::cerr << "[memo-stats] " << name << ": " << prog.memo_results()->statistics().to_string() << std::endl;
+    }
+}
+
+void show_tiering_stats(const program& prog)
+{
+    double saved = 0;
+    for(const auto& v : prog.variables())
+    {
+        if(v->tiers == nullptr || v->tiers->calls() == 0) continue;
+        std::cerr << "[tiering-stats] " << v->name << ": " << v->tiers->report() << "\n";
+        saved += v->tiers->saved_ms();
+    }
+    std::cerr << "[tiering-stats] about " << saved << " ms saved in total" << std::endl;
+}
+
+// set by SIGINT and SIGTERM while a resumable evaluation runs
+volatile std::sig_atomic_t interrupted = 0;
+
+void save_state(const machine& m, const std::string& path)
+{
+    // written aside first, so that a crash never leaves half a state
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp);
+        m.save(out);
+        if(!out.flush())
+        {
+            throw std::runtime_error("Cannot write state to " + temp);
+        }
+    }
+    std::filesystem::rename(temp, path);
+}
+
+// evaluates v(operands) on a machine that is saved to path from time to
+// time; empty if interrupted
+std::optional<natural> eval_resumable(std::shared_ptr<const program> prog, const variable& v,
+                                      const std::vector<natural>& operands, const std::string& path,
+                                      std::chrono::seconds every, bool resume)
+{
+    std::unique_ptr<machine> m;
+    std::ifstream saved(path);
+    if(resume && saved)
+    {
+        m = machine::restore(prog, saved);
+        if(m->entry_point() != v.name || m->arguments() != operands)
+        {
+            throw interprete_error("Cannot restore evaluation: " + path + " holds another entry point or arguments");
+        }
+        std::cerr << "Resuming from " << path << " after " << m->steps() << " steps" << std::endl;
+    }
+    else
+    {
+        m = std::make_unique<machine>(prog, v, operands);
+    }
+    auto on_signal = [](int){ interrupted = 1; };
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    auto next = std::chrono::steady_clock::now() + every;
+    while(!m->run(1 << 16))
+    {
+        if(interrupted || std::chrono::steady_clock::now() >= next)
+        {
+            save_state(*m, path);
+            next = std::chrono::steady_clock::now() + every;
+        }
+        if(interrupted)
+        {
+            std::cerr << "Interrupted; state saved to " << path << std::endl;
+            return std::nullopt;
+        }
+    }
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    std::filesystem::remove(path);
+    return m->result();
+}
+
 void repl(std::unique_ptr<parser> p)
 {
     std::string line;
@@ -88,6 +338,30 @@ int main(int argc, char* argv[])
     std::vector<std::string> args;
     std::unique_ptr<parser> p = nullptr;
     bool numeric_args = true;
+    bool optimize = true, opt_stats = false, checkpoints = false, fast_min = false;
+    bool memo = false, memo_stats = false, tiering = false, tiering_stats = false;
+    bool closed_forms = false, closed_forms_stats = false;
+    bool eager = false, progress = false, resume = false;
+    std::string state_path;
+    natural save_every = 60;
+    std::optional<sweep_range> sweeping;
+    std::string module_dir = module_cache::default_dir();
+    std::string cache_dir;
+    natural cache_size = 1 << 16;
+    bool cache_stats = false;
+    std::shared_ptr<scheduler> pool = nullptr;
+    unsigned int parallel_threads = 0;
+    natural fork_threshold = 10000;
+    bool parallel = false;
+    bool parallel_parse = false;
+    bool perf_stats = false, ranges = false;
+    std::string perf_json;
+    std::string analyze;
+    std::shared_ptr<const source_file> source = nullptr;
+    std::map<std::string, std::map<unsigned int, natural>> specializations;
+    bool serve = false;
+    server::options serve_opts;
+    std::string socket_path;
     // phase 1: parse argv
     if(argc <= 1)
     {
@@ -121,6 +395,212 @@ int main(int argc, char* argv[])
             {
                 interactive = true;
             }
+            else if(current_arg == "--eager")
+            {
+                eager = true;
+            }
+            else if(current_arg == "--progress")
+            {
+                progress = true;
+            }
+            else if(current_arg == "--resume")
+            {
+                resume = true;
+            }
+            else if(current_arg == "--save-state")
+            {
+                if(i + 1 >= argc)
+                {
+                    std::cerr << "Argument expected by --save-state option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+                state_path = argv[++i];
+            }
+            else if(current_arg == "--no-opt")
+            {
+                optimize = false;
+            }
+            else if(current_arg == "--checkpoints")
+            {
+                checkpoints = true;
+            }
+            else if(current_arg == "--fast-min")
+            {
+                fast_min = true;
+            }
+            else if(current_arg == "--tiering" || current_arg == "--tiering-stats")
+            {
+                tiering = true;
+                tiering_stats = tiering_stats || current_arg == "--tiering-stats";
+            }
+            else if(current_arg == "--closed-forms" || current_arg == "--closed-forms-stats")
+            {
+                closed_forms = true;
+                closed_forms_stats = closed_forms_stats || current_arg == "--closed-forms-stats";
+            }
+            else if(current_arg == "--memo" || current_arg == "--memo-stats")
+            {
+                memo = true;
+                memo_stats = memo_stats || current_arg == "--memo-stats";
+            }
+            else if(current_arg == "--analyze" || current_arg == "--analyze-dot")
+            {
+                analyze = current_arg;
+            }
+            else if(current_arg == "--opt-stats")
+            {
+                opt_stats = true;
+            }
+            else if(current_arg == "--perf-stats")
+            {
+                perf_stats = true;
+            }
+            else if(current_arg == "--ranges")
+            {
+                ranges = true;
+            }
+            else if(current_arg == "--serve")
+            {
+                serve = true;
+            }
+            else if(current_arg == "--parallel-parse")
+            {
+                parallel_parse = true;
+            }
+            else if(current_arg == "--socket" || current_arg == "--perf-json")
+            {
+                if(i + 1 >= argc)
+                {
+                    std::cerr << "Argument expected by " << current_arg << " option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+                (current_arg == "--socket" ? socket_path : perf_json) = argv[++i];
+            }
+            else if(current_arg == "--parallel" || current_arg == "--fork-threshold")
+            {
+                try
+                {
+                    natural n = std::stoull(i + 1 < argc ? argv[++i] : "");
+                    if(current_arg == "--parallel")
+                    {
+                        parallel = true;
+                        parallel_threads = n;
+                    }
+                    else
+                    {
+                        fork_threshold = n;
+                    }
+                }
+                catch(const std::logic_error&)
+                {
+                    std::cerr << "Number expected by " << current_arg << " option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+            }
+            else if(current_arg == "--threads" || current_arg == "--budget" || current_arg == "--save-every"
+                    || current_arg == "--cache-size")
+            {
+                try
+                {
+                    natural n = std::stoull(i + 1 < argc ? argv[++i] : "");
+                    if(current_arg == "--threads")
+                    {
+                        serve_opts.threads = n;
+                    }
+                    else if(current_arg == "--cache-size")
+                    {
+                        cache_size = n;
+                    }
+                    else if(current_arg == "--save-every")
+                    {
+                        save_every = n;
+                    }
+                    else
+                    {
+                        serve_opts.budget = n;
+                    }
+                }
+                catch(const std::logic_error&)
+                {
+                    std::cerr << "Number expected by " << current_arg << " option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+            }
+            else if(current_arg == "--module-cache")
+            {
+                if(i + 1 >= argc)
+                {
+                    std::cerr << "Argument expected by --module-cache option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+                module_dir = argv[++i];
+            }
+            else if(current_arg == "--no-module-cache")
+            {
+                module_dir.clear();
+            }
+            else if(current_arg == "--cache-dir")
+            {
+                if(i + 1 >= argc)
+                {
+                    std::cerr << "Argument expected by --cache-dir option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+                cache_dir = argv[++i];
+            }
+            else if(current_arg == "--cache-stats")
+            {
+                cache_stats = true;
+            }
+            else if(current_arg == "--sweep")
+            {
+                std::string spec = i + 1 < argc ? argv[++i] : "";
+                size_t eq = spec.find('='), dots = spec.find("..");
+                try
+                {
+                    if(eq == std::string::npos || dots == std::string::npos || dots < eq)
+                    {
+                        throw std::invalid_argument(spec);
+                    }
+                    sweep_range range;
+                    range.pos = std::stoul(spec.substr(0, eq));
+                    range.lo = std::stoull(spec.substr(eq+1, dots-eq-1));
+                    range.hi = std::stoull(spec.substr(dots+2));
+                    sweeping = range;
+                }
+                catch(const std::logic_error&)
+                {
+                    std::cerr << "Argument of the form pos=lo..hi expected by --sweep option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+            }
+            else if(current_arg == "--specialize")
+            {
+                std::string spec = i + 1 < argc ? argv[++i] : "";
+                size_t colon = spec.find(':'), eq = spec.find('=');
+                try
+                {
+                    if(colon == std::string::npos || eq == std::string::npos || eq < colon)
+                    {
+                        throw std::invalid_argument(spec);
+                    }
+                    unsigned int pos = std::stoul(spec.substr(colon+1, eq-colon-1));
+                    specializations[spec.substr(0, colon)][pos] = std::stoull(spec.substr(eq+1));
+                }
+                catch(const std::logic_error&)
+                {
+                    std::cerr << "Argument of the form var:pos=value expected by --specialize option\n";
+                    std::cerr << "Try `kleene -h` for more information." << std::endl;
+                    return 2;
+                }
+            }
             else
             {
                 std::cerr << "unrecognised flag: " << current_arg << "\n";
@@ -138,6 +618,30 @@ int main(int argc, char* argv[])
             }
         }
     }
+    if(sweeping && (interactive || serve || !state_path.empty()))
+    {
+        std::cerr << "--sweep cannot be combined with --interactive, --serve or --save-state\n";
+        std::cerr << "Try `kleene -h` for more information." << std::endl;
+        return 2;
+    }
+    if(cache_stats && cache_dir.empty())
+    {
+        std::cerr << "--cache-stats needs --cache-dir dir\n";
+        std::cerr << "Try `kleene -h` for more information." << std::endl;
+        return 2;
+    }
+    if(resume && state_path.empty())
+    {
+        std::cerr << "--resume needs --save-state path\n";
+        std::cerr << "Try `kleene -h` for more information." << std::endl;
+        return 2;
+    }
+    // counts from here on, threads started later included
+    std::unique_ptr<perf_recorder> perf;
+    if(perf_stats || !perf_json.empty())
+    {
+        perf = std::make_unique<perf_recorder>();
+    }
     // phase 2: open source file and parse
     if(filename.empty())
     {
@@ -154,13 +658,10 @@ int main(int argc, char* argv[])
     }
     else
     {
-        std::ifstream file(filename);
-        if(file.good())
+        source = source_file::open(filename);
+        if(source != nullptr)
         {
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            std::string code = buffer.str();
-            p = parser::create(code);
+            p = parser::create(source);
         }
         else
         {
@@ -170,7 +671,7 @@ int main(int argc, char* argv[])
     }
     // phase 3: transform arguments
     std::vector<natural> operands(args.size());
-    if(numeric_args)
+    if(numeric_args && !serve)
     {
         try {
             std::transform(args.begin(), args.end(), operands.begin(), [](std::string s){
@@ -187,14 +688,200 @@ int main(int argc, char* argv[])
         }
     }
     // phase 4: evaluate entry point
+    p->set_optimize(optimize);
+    p->set_checkpoints(checkpoints);
+    p->set_fast_min(fast_min);
+    p->set_memo(memo);
+    p->set_tiering(tiering);
+    p->set_closed_forms(closed_forms);
+    p->set_perf(perf.get());
+    auto modules = std::make_shared<module_cache>(module_dir);
+    p->set_module_cache(modules);
+    if(!filename.empty())
+    {
+        p->set_import_dir(std::filesystem::path(filename).parent_path().string());
+    }
+    // a single run only needs what the entry point uses
+    std::vector<std::string> roots;
+    if(!eager && !serve && !interactive && analyze.empty())
+    {
+        roots.push_back(entry_point);
+        for(const auto& [name, fixed] : specializations)
+        {
+            roots.push_back(name);
+        }
+        p->set_roots(roots);
+    }
+    if(parallel)
+    {
+        pool = std::make_shared<scheduler>(parallel_threads);
+        p->set_parallel(pool, fork_threshold);
+    }
+    if(parallel_parse)
+    {
+        p->set_parallel_parse(pool != nullptr ? pool : std::make_shared<scheduler>(parallel_threads));
+    }
     p->parse();
-    auto v = p->get_variable(entry_point);
+    if(closed_forms_stats)
+    {
+        std::istringstream lines(p->closed_forms());
+        for(std::string line; std::getline(lines, line); )
+        {
+            std::cerr << "[closed-forms] " << line << "\n";
+        }
+    }
+    std::shared_ptr<const program> reference = nullptr;
+    if(opt_stats)
+    {
+        auto r = source != nullptr ? parser::create(source) : parser::create("");
+        r->set_optimize(false);
+        r->set_module_cache(modules);
+        r->set_import_dir(std::filesystem::path(filename).parent_path().string());
+        r->set_roots(roots);
+        r->parse();
+        reference = r->build();
+    }
+    for(const auto& [name, fixed] : specializations)
+    {
+        std::string new_name = name;
+        for(auto [pos, value] : fixed)
+        {
+            new_name += "_" + std::to_string(pos) + "_" + std::to_string(value);
+        }
+        try
+        {
+            perf_recorder::scope optimising(perf.get(), "optimise");
+            p->specialize(name, fixed, new_name);
+        }
+        catch(const parse_error &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 2;
+        }
+        dprint("specialized:", new_name);
+        if(name == entry_point)
+        {
+            entry_point = new_name;
+        }
+    }
+    auto prog = p->build();
+    if(reference != nullptr)
+    {
+        show_opt_stats(*prog, *reference);
+    }
+    if(!analyze.empty())
+    {
+        analyzer ana;
+        std::cout << (analyze == "--analyze" ? ana.annotate(prog->variables()) : ana.annotate_dot(prog->variables()));
+        return 0;
+    }
+    if(serve)
+    {
+        server srv(serve_opts);
+        std::vector<std::pair<std::string, std::shared_ptr<const program>>> loaded;
+        loaded.emplace_back(std::filesystem::path(filename).stem().string(), prog);
+        for(const auto& f : args)
+        {
+            auto file = source_file::open(f);
+            if(file == nullptr)
+            {
+                std::cerr << "Cannot open file: " + f << std::endl;
+                return 2;
+            }
+            auto q = parser::create(file);
+            q->set_optimize(optimize);
+            q->set_checkpoints(checkpoints);
+            q->set_fast_min(fast_min);
+            q->set_memo(memo);
+            q->set_tiering(tiering);
+            q->set_closed_forms(closed_forms);
+            q->set_module_cache(modules);
+            q->set_import_dir(std::filesystem::path(f).parent_path().string());
+            if(pool != nullptr)
+            {
+                q->set_parallel(pool, fork_threshold);
+            }
+            q->parse();
+            loaded.emplace_back(std::filesystem::path(f).stem().string(), q->build());
+        }
+        for(const auto& [name, loaded_prog] : loaded)
+        {
+            srv.add_program(name, loaded_prog);
+        }
+        try
+        {
+            if(socket_path.empty())
+            {
+                srv.serve(std::cin, std::cout);
+            }
+            else
+            {
+                srv.listen(socket_path);
+            }
+        }
+        catch(const std::runtime_error& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        for(const auto& [name, loaded_prog] : loaded)
+        {
+            if(memo_stats)
+            {
+                show_memo_stats(name, *loaded_prog);
+            }
+            if(tiering_stats)
+            {
+                show_tiering_stats(*loaded_prog);
+            }
+        }
+        return 0;
+    }
+    auto v = prog->get_variable(entry_point);
     if(v == nullptr && !interactive)
     {
         std::cerr << "Entry point '" << entry_point << "' not found; abort\n";
         std::cerr << "Try `kleene -h` for more information." << std::endl;
         return 2;
     }
+    else if(v != nullptr && sweeping)
+    {
+        if(sweeping->pos < 1 || sweeping->pos > v->dim() || v->dim() != operands.size() + 1)
+        {
+            std::cerr << "Entry point '" << entry_point << "' expects " << v->dim() << " arguments,";
+            std::cerr << " but " << operands.size() << " provided besides argument " << sweeping->pos;
+            std::cerr << " to sweep; abort" << std::endl;
+            return 2;
+        }
+        if(ranges)
+        {
+            std::vector<value_range> xs;
+            for(natural x : operands)
+            {
+                xs.push_back(value_range::point(x));
+            }
+            xs.insert(xs.begin() + (sweeping->pos - 1), value_range{sweeping->lo, sweeping->hi});
+            show_ranges(v, xs);
+        }
+        progress_monitor monitor(std::cerr, std::chrono::seconds(1), progress);
+        std::signal(SIGUSR1, [](int){ progress_monitor::request(); });
+        auto workers = pool != nullptr ? pool : std::make_shared<scheduler>(parallel_threads);
+        try
+        {
+            progress_monitor::scope watching(monitor);
+            perf_recorder::scope evaluating(perf.get(), "eval");
+            sweep(*v, operands, *sweeping, [](natural n, natural value){
+                std::cout << n << " " << value << "\n";
+            }, *workers);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::signal(SIGUSR1, SIG_DFL);
+        std::cout << std::flush;
+    }
     else if(v != nullptr)
     {
         if(v->dim() != operands.size())
@@ -212,10 +899,97 @@ int main(int argc, char* argv[])
         }
         else
         {
-            natural ans = p->eval_var(v, operands);
+            if(ranges)
+            {
+                std::vector<value_range> xs;
+                for(natural x : operands)
+                {
+                    xs.push_back(value_range::point(x));
+                }
+                show_ranges(v, xs);
+            }
+            progress_monitor monitor(std::cerr, std::chrono::seconds(1), progress);
+            std::signal(SIGUSR1, [](int){ progress_monitor::request(); });
+            auto start = std::chrono::steady_clock::now();
+            natural ans;
+            // a cache that cannot be opened only costs the lookup
+            std::unique_ptr<result_store> results;
+            std::optional<natural> cached;
+            if(!cache_dir.empty())
+            {
+                try
+                {
+                    results = result_store::open(cache_dir, cache_size);
+                    cached = results->find(*v, operands);
+                }
+                catch(const std::runtime_error& e)
+                {
+                    std::cerr << "Warning: " << e.what() << std::endl;
+                }
+            }
+            if(cached)
+            {
+                ans = *cached;
+            }
+            else if(!state_path.empty())
+            {
+                try
+                {
+                    auto res = eval_resumable(prog, *v, operands, state_path, std::chrono::seconds(save_every), resume);
+                    if(!res)
+                    {
+                        return 1;
+                    }
+                    ans = *res;
+                }
+                catch(const std::exception& e)
+                {
+                    std::cerr << e.what() << std::endl;
+                    return 1;
+                }
+            }
+            else
+            {
+                progress_monitor::scope watching(monitor);
+                perf_recorder::scope evaluating(perf.get(), "eval");
+                ans = prog->eval(*v, operands);
+            }
+            std::signal(SIGUSR1, SIG_DFL);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
             std::cout << ans << std::endl;
+            if(results != nullptr && !cached)
+            {
+                results->store(*v, operands, ans);
+            }
+            if(cache_stats && results != nullptr)
+            {
+                auto c = results->stats();
+                std::cerr << "[cache-stats] " << entry_point << ": " << c.hits << " hits, " << c.misses << " misses, "
+                          << c.evicted << " evicted; " << results->to_string() << std::endl;
+            }
+            if(memo_stats)
+            {
+                show_memo_stats(entry_point, *prog);
+            }
+            if(tiering_stats)
+            {
+                show_tiering_stats(*prog);
+            }
+            auto w = reference != nullptr ? reference->get_variable(entry_point) : nullptr;
+            if(w != nullptr)
+            {
+                start = std::chrono::steady_clock::now();
+                reference->eval(*w, operands);
+                std::chrono::duration<double, std::milli> ref_elapsed = std::chrono::steady_clock::now() - start;
+                std::cerr << "[opt-stats] eval " << entry_point << ": " << ref_elapsed.count() << " ms -> ";
+                std::cerr << elapsed.count() << " ms" << std::endl;
+            }
         }
     }
+    if(perf != nullptr && !interactive)
+    {
+        show_perf_stats(*perf, perf_stats, perf_json);
+    }
     // phase 5: repl
     if(interactive)
     {
@@ -0,0 +1,105 @@
+#include "memo.h"
+#include <algorithm>
+
+size_t memo_table::hash(const variable* v, const std::vector<natural>& xs) noexcept
+{
+    // splitmix64 steps over the pointer and the operands
+    natural h = reinterpret_cast<natural>(v);
+    auto mix = [&h](natural x){
+        h += x + 0x9e3779b97f4a7c15ULL;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+    };
+    for(natural x : xs)
+    {
+        mix(x);
+    }
+    mix(xs.size());
+    return h;
+}
+
+size_t memo_table::key_hash::operator()(const key& k) const noexcept
+{
+    return hash(k.v, k.xs);
+}
+
+size_t memo_table::key_hash::operator()(const key_view& k) const noexcept
+{
+    return hash(k.v, *k.xs);
+}
+
+memo_table::memo_table(size_t capacity)
+    : shard_capacity(std::max<size_t>(1, capacity / shard_count)), shards(shard_count) {}
+
+std::optional<natural> memo_table::find(const variable* v, const std::vector<natural>& xs)
+{
+    size_t h = hash(v, xs);
+    shard& s = shards[(h >> 32) % shard_count];
+    std::shared_lock<std::shared_mutex> guard(s.lock, std::try_to_lock);
+    if(!guard.owns_lock())
+    {
+        s.contended.fetch_add(1, std::memory_order_relaxed);
+        guard.lock();
+    }
+    auto it = s.results.find(key_view{v, &xs});
+    if(it == s.results.end())
+    {
+        s.misses.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    s.hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second;
+}
+
+void memo_table::insert(const variable* v, const std::vector<natural>& xs, natural result)
+{
+    size_t h = hash(v, xs);
+    shard& s = shards[(h >> 32) % shard_count];
+    std::unique_lock<std::shared_mutex> guard(s.lock, std::try_to_lock);
+    if(!guard.owns_lock())
+    {
+        s.contended.fetch_add(1, std::memory_order_relaxed);
+        guard.lock();
+    }
+    if(s.results.size() >= shard_capacity)
+    {
+        s.results.clear();
+        s.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    s.results.emplace(key{v, xs}, result);
+}
+
+memo_table::stats memo_table::statistics() const
+{
+    stats res;
+    for(const auto& s : shards)
+    {
+        res.hits += s.hits.load(std::memory_order_relaxed);
+        res.misses += s.misses.load(std::memory_order_relaxed);
+        res.evictions += s.evictions.load(std::memory_order_relaxed);
+        res.contended += s.contended.load(std::memory_order_relaxed);
+        std::shared_lock<std::shared_mutex> guard(s.lock);
+        res.size += s.results.size();
+    }
+    return res;
+}
+
+void memo_table::clear()
+{
+    for(auto& s : shards)
+    {
+        std::unique_lock<std::shared_mutex> guard(s.lock);
+        s.results.clear();
+        s.hits = s.misses = s.evictions = s.contended = 0;
+    }
+}
+
+std::string memo_table::stats::to_string() const
+{
+    size_t lookups = hits + misses;
+    std::string rate = lookups == 0 ? "0" : std::to_string(100 * hits / lookups);
+    return std::to_string(hits) + " hits, " + std::to_string(misses) + " misses (" + rate + "% hit rate), "
+         + std::to_string(contended) + " contended, " + std::to_string(evictions) + " evictions, "
+         + std::to_string(size) + " entries";
+}
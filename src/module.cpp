@@ -0,0 +1,373 @@
+#include "module.h"
+#include <charconv>
+#include <limits>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include "source.h"
+
+static const char* module_header = "kleene-module 1";
+
+natural module_cache::hash(std::string_view text, natural seed) noexcept
+{
+    // FNV-1a
+    natural h = seed;
+    for(unsigned char c : text)
+    {
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::string module_cache::default_dir()
+{
+    if(const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+    {
+        return (std::filesystem::path(xdg) / "kleene").string();
+    }
+    if(const char* home = std::getenv("HOME"); home != nullptr && *home != '\0')
+    {
+        return (std::filesystem::path(home) / ".cache" / "kleene").string();
+    }
+    return "";
+}
+
+std::string module_cache::canonical(const std::string& path)
+{
+    std::error_code ec;
+    auto res = std::filesystem::weakly_canonical(path, ec);
+    return ec ? path : res.string();
+}
+
+module_cache::counters module_cache::stats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+/****** Encoding ******/
+
+// C n k | P n k | S | V index | O m f g1 ... gm | R f g | M monotone f
+// | B monotone bound f
+static void encode_node(std::string& out, const expression& e, const std::unordered_map<const variable*, size_t>& index)
+{
+    if(auto atom = dynamic_cast<const atomic_exp*>(&e))
+    {
+        const identifier* idt = atom->idt.get();
+        if(auto c = dynamic_cast<const constant*>(idt))
+        {
+            out += " C " + std::to_string(c->n) + " " + std::to_string(c->k);
+        }
+        else if(auto p = dynamic_cast<const projection*>(idt))
+        {
+            out += " P " + std::to_string(p->n) + " " + std::to_string(p->k);
+        }
+        else if(auto v = dynamic_cast<const variable*>(idt))
+        {
+            auto it = index.find(v);
+            if(it == index.end())
+            {
+                throw parse_error("Cannot compile module: " + v->name + " is not defined in it");
+            }
+            out += " V " + std::to_string(it->second);
+        }
+        else
+        {
+            out += " S";
+        }
+    }
+    else if(auto comp = dynamic_cast<const composition*>(&e))
+    {
+        out += " O " + std::to_string(comp->gs.size());
+        encode_node(out, *comp->f, index);
+        for(const auto& g : comp->gs)
+        {
+            encode_node(out, *g, index);
+        }
+    }
+    else if(auto pr = dynamic_cast<const primitive_recursion*>(&e))
+    {
+        out += " R";
+        encode_node(out, *pr->f, index);
+        encode_node(out, *pr->g, index);
+    }
+    else if(auto mn = dynamic_cast<const minimization*>(&e))
+    {
+        out += std::string(" M ") + (mn->monotone ? "1" : "0");
+        encode_node(out, *mn->f, index);
+    }
+    else if(auto bm = dynamic_cast<const bounded_minimization*>(&e))
+    {
+        out += std::string(" B ") + (bm->monotone ? "1" : "0");
+        encode_node(out, *bm->bound, index);
+        encode_node(out, *bm->f, index);
+    }
+}
+
+std::string module_cache::encode(const std::vector<std::shared_ptr<variable>>& vs)
+{
+    std::unordered_map<const variable*, size_t> index;
+    std::string out;
+    for(const auto& v : vs)
+    {
+        out += v->name + " " + std::to_string(v->dim());
+        encode_node(out, *v->defn, index);
+        out += "\n";
+        index.emplace(v.get(), index.size());
+    }
+    return out;
+}
+
+namespace {
+
+struct decoder
+{
+    std::string_view in;
+    size_t pos = 0;
+    const std::vector<std::shared_ptr<variable>>& vs;
+    [[noreturn]] static void fail()
+    {
+        throw parse_error("Cannot load module: malformed compiled module");
+    }
+    std::string_view word()
+    {
+        while(pos < in.size() && in[pos] == ' ') pos++;
+        size_t start = pos;
+        while(pos < in.size() && in[pos] != ' ' && in[pos] != '\n') pos++;
+        if(start == pos) fail();
+        return in.substr(start, pos - start);
+    }
+    natural number()
+    {
+        auto w = word();
+        natural n;
+        if(std::from_chars(w.data(), w.data() + w.size(), n).ec != std::errc()) fail();
+        return n;
+    }
+    std::shared_ptr<expression> node()
+    {
+        auto w = word();
+        if(w.size() != 1) fail();
+        switch(w[0])
+        {
+        case 'C':
+        {
+            natural n = number();
+            if(n > std::numeric_limits<unsigned int>::max()) fail();
+            return std::make_shared<atomic_exp>(std::make_shared<constant>(n, number()));
+        }
+        case 'P':
+        {
+            natural n = number(), k = number();
+            if(k == 0 || k > n || n > std::numeric_limits<unsigned int>::max()) fail();
+            return std::make_shared<atomic_exp>(std::make_shared<projection>(n, k));
+        }
+        case 'S':
+            return std::make_shared<atomic_exp>(std::make_shared<successor>());
+        case 'V':
+        {
+            natural i = number();
+            if(i >= vs.size()) fail();
+            return std::make_shared<atomic_exp>(vs[i]);
+        }
+        case 'O':
+        {
+            natural m = number();
+            auto f = node();
+            std::vector<std::shared_ptr<expression>> gs;
+            for(natural j = 0; j < m; j++)
+            {
+                gs.push_back(node());
+            }
+            return composition::create(f, gs);
+        }
+        case 'R':
+        {
+            auto f = node();
+            auto g = node();
+            return primitive_recursion::create(f, g);
+        }
+        case 'M':
+        {
+            bool monotone = number() != 0;
+            std::shared_ptr<minimization> res = minimization::create(node());
+            res->monotone = monotone;
+            return res;
+        }
+        case 'B':
+        {
+            bool monotone = number() != 0;
+            auto bound = node();
+            std::shared_ptr<bounded_minimization> res = bounded_minimization::create(node(), bound);
+            res->monotone = monotone;
+            return res;
+        }
+        }
+        fail();
+    }
+};
+
+}
+
+std::vector<std::shared_ptr<variable>> module_cache::decode(const compiled& m, const std::string& prefix)
+{
+    std::vector<std::shared_ptr<variable>> vs;
+    decoder d{m.code, 0, vs};
+    while(d.pos < d.in.size())
+    {
+        std::string name = prefix + std::string(d.word());
+        natural dim = d.number();
+        auto defn = d.node();
+        if(defn->dim() != dim) decoder::fail();
+        vs.push_back(std::make_shared<variable>(name, dim, defn));
+        if(d.pos < d.in.size() && d.in[d.pos] == '\n') d.pos++;
+    }
+    return vs;
+}
+
+/****** Cache ******/
+
+bool module_cache::up_to_date(const compiled& m, const std::string& path) const
+{
+    // imports are relative to the module, so a copy elsewhere may import
+    // other files
+    if(!m.deps.empty() && m.path != path)
+    {
+        return false;
+    }
+    for(const auto& [path, h] : m.deps)
+    {
+        auto file = source_file::open(path);
+        if(file == nullptr || hash(file->text()) != h)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::filesystem::path file_of(const std::string& dir, natural key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.klc", key);
+    return std::filesystem::path(dir) / name;
+}
+
+std::shared_ptr<const module_cache::compiled> module_cache::read(natural key) const
+{
+    if(dir.empty())
+    {
+        return nullptr;
+    }
+    std::ifstream in(file_of(dir, key));
+    std::string line;
+    if(!std::getline(in, line) || line != module_header)
+    {
+        return nullptr;
+    }
+    auto m = std::make_shared<compiled>();
+    std::string word;
+    size_t deps = 0;
+    in >> word >> m->key >> word >> m->source >> word >> deps;
+    if(!in || m->key != key)
+    {
+        return nullptr;
+    }
+    in.ignore();
+    std::getline(in, m->path);
+    for(size_t i = 0; i < deps && in; i++)
+    {
+        natural h;
+        std::string path;
+        in >> h;
+        in.ignore();
+        std::getline(in, path);
+        m->deps.emplace_back(path, h);
+    }
+    std::stringstream code;
+    code << in.rdbuf();
+    m->code = code.str();
+    if(!in)
+    {
+        return nullptr;
+    }
+    // a damaged file is compiled again, never trusted
+    try
+    {
+        decode(*m, "");
+    }
+    catch(const parse_error&)
+    {
+        return nullptr;
+    }
+    return m;
+}
+
+void module_cache::write(const compiled& m) const
+{
+    if(dir.empty())
+    {
+        return;
+    }
+    // a cache that cannot be written is only slower
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    auto path = file_of(dir, m.key);
+    auto tmp = path;
+    tmp += ".tmp" + std::to_string(reinterpret_cast<uintptr_t>(&m));
+    {
+        std::ofstream out(tmp);
+        out << module_header << "\n";
+        out << "key " << m.key << " source " << m.source << " deps " << m.deps.size() << "\n";
+        out << m.path << "\n";
+        for(const auto& [dep, h] : m.deps)
+        {
+            out << h << " " << dep << "\n";
+        }
+        out << m.code;
+        if(!out)
+        {
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+}
+
+std::shared_ptr<const module_cache::compiled> module_cache::load(const std::string& path, natural options, const compiler& compile)
+{
+    std::string canonical = module_cache::canonical(path);
+    auto file = source_file::open(canonical);
+    if(file == nullptr)
+    {
+        throw parse_error("Cannot open module: " + path);
+    }
+    natural source = hash(file->text());
+    natural key = hash(std::to_string(options), hash(module_header, source));
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = modules.find(key);
+        if(it != modules.end() && up_to_date(*it->second, canonical))
+        {
+            count.memory++;
+            return it->second;
+        }
+    }
+    if(auto m = read(key); m != nullptr && up_to_date(*m, canonical))
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        count.disk++;
+        return modules[key] = m;
+    }
+    compiled m = compile(file->text(), canonical);
+    m.key = key;
+    m.path = canonical;
+    m.source = source;
+    write(m);
+    auto res = std::make_shared<const compiled>(std::move(m));
+    std::lock_guard<std::mutex> guard(lock);
+    count.compiled++;
+    return modules[key] = res;
+}
@@ -0,0 +1,458 @@
+#include "optimizer.h"
+
+/****** help functions ******/
+
+std::shared_ptr<expression> make_constant(unsigned int dim, natural k)
+{
+    return std::make_shared<atomic_exp>(std::make_shared<constant>(dim, k));
+}
+
+std::shared_ptr<expression> make_projection(unsigned int dim, unsigned int k)
+{
+    return std::make_shared<atomic_exp>(std::make_shared<projection>(dim, k));
+}
+
+bool is_trivial(const std::shared_ptr<expression>& e) noexcept
+{
+    return atom_cast<constant>(e) != nullptr || atom_cast<projection>(e) != nullptr;
+}
+
+size_t node_count(const std::shared_ptr<expression>& e) noexcept
+{
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        size_t res = 1 + node_count(comp->f);
+        for(const auto& g : comp->gs)
+        {
+            res += node_count(g);
+        }
+        return res;
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        return 1 + node_count(pr->f) + node_count(pr->g);
+    }
+    if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        return 1 + node_count(mn->f);
+    }
+    if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        return 1 + node_count(bm->bound) + node_count(bm->f);
+    }
+    return 1;
+}
+
+static bool is_identity(const std::vector<std::shared_ptr<expression>>& args, unsigned int dim) noexcept
+{
+    if(args.size() != dim) return false;
+    for(unsigned int i = 0; i < dim; i++)
+    {
+        auto p = atom_cast<projection>(args[i]);
+        if(p == nullptr || p->n != dim || p->k != i + 1) return false;
+    }
+    return true;
+}
+
+// a trivial argument of dimension dim moved to dimension dim+offset,
+// leaving the first offset positions to the caller
+static std::shared_ptr<expression> shift(const std::shared_ptr<expression>& arg, unsigned int dim, unsigned int offset)
+{
+    if(auto c = atom_cast<constant>(arg))
+    {
+        return make_constant(dim + offset, c->k);
+    }
+    auto p = atom_cast<projection>(arg);
+    return make_projection(dim + offset, p->k + offset);
+}
+
+/****** optimizer ******/
+
+optimizer::optimizer() noexcept : opts() {}
+
+std::shared_ptr<expression> optimizer::simplify(const std::shared_ptr<expression>& e)
+{
+    args_t args;
+    for(unsigned int i = 1; i <= e->dim(); i++)
+    {
+        args.push_back(make_projection(e->dim(), i));
+    }
+    return rewrite(e, args, e->dim());
+}
+
+std::shared_ptr<expression> optimizer::apply(const std::shared_ptr<expression>& f, const args_t& args, unsigned int dim)
+{
+    // arguments that f never reads are not worth evaluating
+    args_t gs = args;
+    auto used = reads(f);
+    for(size_t i = 0; i < gs.size(); i++)
+    {
+        if(!used[i] && !is_trivial(gs[i]))
+        {
+            gs[i] = make_constant(dim, 0);
+        }
+    }
+    if(std::all_of(gs.begin(), gs.end(), is_trivial))
+    {
+        return rewrite(f, gs, dim);
+    }
+    // bind the constants into f; everything else (deduplicated) goes
+    // through a composition so that it is still evaluated only once
+    args_t rest;
+    for(const auto& g : gs)
+    {
+        if(atom_cast<constant>(g) == nullptr && std::find(rest.begin(), rest.end(), g) == rest.end())
+        {
+            rest.push_back(g);
+        }
+    }
+    unsigned int r = rest.size();
+    args_t inner;
+    for(const auto& g : gs)
+    {
+        if(auto c = atom_cast<constant>(g))
+        {
+            inner.push_back(make_constant(r, c->k));
+        }
+        else
+        {
+            unsigned int k = std::find(rest.begin(), rest.end(), g) - rest.begin() + 1;
+            inner.push_back(make_projection(r, k));
+        }
+    }
+    auto outer = rewrite(f, inner, r);
+    // f(h_1, ..., h_m)(rest) becomes f(h_1(rest), ..., h_m(rest)) unless
+    // that evaluates some argument more than once
+    if(auto comp = std::dynamic_pointer_cast<composition>(outer))
+    {
+        std::vector<unsigned int> readers(r, 0);
+        for(const auto& h : comp->gs)
+        {
+            auto used = reads(h);
+            for(unsigned int j = 0; j < r; j++)
+            {
+                readers[j] += used[j] && !is_trivial(rest[j]);
+            }
+        }
+        if(std::any_of(readers.begin(), readers.end(), [](unsigned int n){ return n > 1; }))
+        {
+            return compose(outer, rest, dim);
+        }
+        args_t hs;
+        if(std::all_of(comp->gs.begin(), comp->gs.end(), is_trivial))
+        {
+            for(const auto& h : comp->gs)
+            {
+                auto c = atom_cast<constant>(h);
+                hs.push_back(c ? make_constant(dim, c->k) : rest[atom_cast<projection>(h)->k-1]);
+            }
+            return compose(comp->f, hs, dim);
+        }
+        for(const auto& h : comp->gs)
+        {
+            hs.push_back(apply(h, rest, dim));
+        }
+        return apply(comp->f, hs, dim);
+    }
+    return compose(outer, rest, dim);
+}
+
+std::shared_ptr<variable> optimizer::specialize(const std::shared_ptr<variable>& v,
+                                                const std::vector<std::optional<natural>>& fixed,
+                                                const std::string& name)
+{
+    unsigned int r = std::count(fixed.begin(), fixed.end(), std::nullopt);
+    args_t args;
+    unsigned int j = 0;
+    for(const auto& x : fixed)
+    {
+        args.push_back(x ? make_constant(r, *x) : make_projection(r, ++j));
+    }
+    dprint("specialize:", name);
+    auto res = std::make_shared<variable>(name, r, rewrite(v->defn, args, r));
+    residuals[name] = res;
+    return res;
+}
+
+bool optimizer::is_total(const std::shared_ptr<expression>& e)
+{
+    if(auto v = atom_cast<variable>(e))
+    {
+        auto it = totality.find(v.get());
+        if(it != totality.end()) return it->second;
+        bool res = is_total(v->defn);
+        totality[v.get()] = res;
+        return res;
+    }
+    if(std::dynamic_pointer_cast<atomic_exp>(e))
+    {
+        return true;
+    }
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        return is_total(comp->f) && std::all_of(comp->gs.begin(), comp->gs.end(), [this](const auto& g){
+            return is_total(g);
+        });
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        return is_total(pr->f) && is_total(pr->g);
+    }
+    if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        return is_total(bm->bound) && is_total(bm->f);
+    }
+    return false;
+}
+
+std::vector<bool> optimizer::reads(const std::shared_ptr<expression>& e)
+{
+    std::vector<bool> res(e->dim(), false);
+    if(auto atom = std::dynamic_pointer_cast<atomic_exp>(e))
+    {
+        if(auto v = std::dynamic_pointer_cast<variable>(atom->idt))
+        {
+            auto it = readings.find(v.get());
+            if(it != readings.end()) return it->second;
+            res = reads(v->defn);
+            readings[v.get()] = res;
+        }
+        else if(auto p = std::dynamic_pointer_cast<projection>(atom->idt))
+        {
+            res[p->k-1] = true;
+        }
+        else if(std::dynamic_pointer_cast<successor>(atom->idt))
+        {
+            res[0] = true;
+        }
+        return res;
+    }
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        auto used = reads(comp->f);
+        for(size_t i = 0; i < comp->gs.size(); i++)
+        {
+            if(!used[i]) continue;
+            auto inner = reads(comp->gs[i]);
+            for(size_t j = 0; j < res.size(); j++)
+            {
+                res[j] = res[j] || inner[j];
+            }
+        }
+        return res;
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        // the counter bounds the loop, so it is always read
+        auto fs = reads(pr->f), gs = reads(pr->g);
+        res[0] = true;
+        for(size_t j = 1; j < res.size(); j++)
+        {
+            res[j] = fs[j-1] || gs[j+1];
+        }
+        return res;
+    }
+    if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        auto fs = reads(mn->f);
+        std::copy(fs.begin() + 1, fs.end(), res.begin());
+        return res;
+    }
+    if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        auto bs = reads(bm->bound), fs = reads(bm->f);
+        for(size_t j = 0; j < res.size(); j++)
+        {
+            res[j] = bs[j] || fs[j+1];
+        }
+        return res;
+    }
+    return std::vector<bool>(e->dim(), true);
+}
+
+std::shared_ptr<expression> optimizer::rewrite(const std::shared_ptr<expression>& e, const args_t& args, unsigned int dim)
+{
+    if(opts.fold_closed && std::all_of(args.begin(), args.end(), [](const auto& a){
+        return atom_cast<constant>(a) != nullptr;
+    }) && is_total(e))
+    {
+        std::vector<natural> operands;
+        for(const auto& a : args)
+        {
+            operands.push_back(atom_cast<constant>(a)->k);
+        }
+        try
+        {
+            step_limit limit(opts.fold_steps);
+            return make_constant(dim, e->eval(operands));
+        }
+        catch(const budget_exceeded&)
+        {
+            // too long to evaluate now: rewritten like any other term
+        }
+    }
+    if(auto atom = std::dynamic_pointer_cast<atomic_exp>(e))
+    {
+        if(auto c = std::dynamic_pointer_cast<constant>(atom->idt))
+        {
+            return make_constant(dim, c->k);
+        }
+        if(auto p = std::dynamic_pointer_cast<projection>(atom->idt))
+        {
+            return args[p->k-1];
+        }
+        if(auto v = std::dynamic_pointer_cast<variable>(atom->idt))
+        {
+            return rewrite_call(e, v, args, dim);
+        }
+        // successor
+        if(auto c = atom_cast<constant>(args[0]))
+        {
+            return make_constant(dim, c->k + 1);
+        }
+        return compose(e, args, dim);
+    }
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        auto used = reads(comp->f);
+        args_t gs;
+        for(size_t i = 0; i < comp->gs.size(); i++)
+        {
+            gs.push_back(used[i] ? rewrite(comp->gs[i], args, dim) : make_constant(dim, 0));
+        }
+        return apply(comp->f, gs, dim);
+    }
+    if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        return rewrite_recursion(pr, args, dim);
+    }
+    if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        // the search variable comes first
+        args_t xs = {make_projection(dim + 1, 1)};
+        for(const auto& a : args)
+        {
+            xs.push_back(shift(a, dim, 1));
+        }
+        auto res = std::make_shared<minimization>(rewrite(mn->f, xs, dim + 1), dim);
+        res->monotone = mn->monotone;
+        return res;
+    }
+    if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        args_t xs = {make_projection(dim + 1, 1)};
+        for(const auto& a : args)
+        {
+            xs.push_back(shift(a, dim, 1));
+        }
+        auto res = std::make_shared<bounded_minimization>(rewrite(bm->f, xs, dim + 1), rewrite(bm->bound, args, dim), dim);
+        res->monotone = bm->monotone;
+        return res;
+    }
+    return e;
+}
+
+std::shared_ptr<expression> optimizer::rewrite_recursion(const std::shared_ptr<primitive_recursion>& pr, const args_t& args, unsigned int dim)
+{
+    args_t xs(args.begin() + 1, args.end());
+    auto counter = atom_cast<constant>(args[0]);
+    if(counter && counter->k <= opts.unroll_limit && counter->k <= opts.unroll_budget - unrolled)
+    {
+        // h(n, xs) = g(n-1, g(n-2, ... g(0, f(xs), xs) ..., xs), xs)
+        unrolled += counter->k;
+        std::shared_ptr<expression> acc = rewrite(pr->f, xs, dim);
+        for(natural i = 0; i < counter->k; i++)
+        {
+            args_t ys = {make_constant(dim, i), acc};
+            ys.insert(ys.end(), xs.begin(), xs.end());
+            acc = apply(pr->g, ys, dim);
+        }
+        return acc;
+    }
+    // bind the constant parameters into f and g; the counter and
+    // the remaining parameters are passed through a composition
+    unsigned int r = std::count_if(xs.begin(), xs.end(), [](const auto& x){
+        return atom_cast<constant>(x) == nullptr;
+    });
+    args_t fs, gs = {make_projection(r + 2, 1), make_projection(r + 2, 2)}, outer = {args[0]};
+    unsigned int j = 0;
+    for(const auto& x : xs)
+    {
+        if(auto c = atom_cast<constant>(x))
+        {
+            fs.push_back(make_constant(r, c->k));
+            gs.push_back(make_constant(r + 2, c->k));
+        }
+        else
+        {
+            j++;
+            fs.push_back(make_projection(r, j));
+            gs.push_back(make_projection(r + 2, j + 2));
+            outer.push_back(x);
+        }
+    }
+    auto res = std::make_shared<primitive_recursion>(rewrite(pr->f, fs, r), rewrite(pr->g, gs, r + 2), r + 1);
+    return compose(res, outer, dim);
+}
+
+std::shared_ptr<expression> optimizer::rewrite_call(const std::shared_ptr<expression>& e, const std::shared_ptr<variable>& v, const args_t& args, unsigned int dim)
+{
+    // trivial wrappers such as id = P1_1 are inlined
+    if(std::dynamic_pointer_cast<atomic_exp>(v->defn))
+    {
+        return rewrite(v->defn, args, dim);
+    }
+    if(!opts.unfold || std::none_of(args.begin(), args.end(), [](const auto& a){
+        return atom_cast<constant>(a) != nullptr;
+    }))
+    {
+        return compose(e, args, dim);
+    }
+    // call a residual of v specialised on the constant arguments;
+    // a 0-ary residual cannot be composed, so a closed call keeps one
+    bool closed = std::all_of(args.begin(), args.end(), [](const auto& a){
+        return atom_cast<constant>(a) != nullptr;
+    });
+    if(closed && args.size() == 1)
+    {
+        return compose(e, args, dim);
+    }
+    std::vector<std::optional<natural>> fixed(args.size());
+    args_t rest;
+    std::string name = v->name + "{";
+    for(size_t i = 0; i < args.size(); i++)
+    {
+        auto c = atom_cast<constant>(args[i]);
+        if(c && !(closed && i == 0))
+        {
+            fixed[i] = c->k;
+            name += std::to_string(c->k);
+        }
+        else
+        {
+            rest.push_back(args[i]);
+            name += "_";
+        }
+        name += i + 1 < args.size() ? "," : "}";
+    }
+    auto it = residuals.find(name);
+    auto r = it != residuals.end() ? it->second : specialize(v, fixed, name);
+    return compose(std::make_shared<atomic_exp>(r), rest, dim);
+}
+
+std::shared_ptr<expression> optimizer::compose(const std::shared_ptr<expression>& f, const args_t& gs, unsigned int dim)
+{
+    if(f->dim() == dim && is_identity(gs, dim))
+    {
+        return f;
+    }
+    if(auto p = atom_cast<projection>(f))
+    {
+        return gs[p->k-1];
+    }
+    if(auto c = atom_cast<constant>(f))
+    {
+        return make_constant(dim, c->k);
+    }
+    return composition::create(f, gs);
+}
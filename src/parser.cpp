@@ -1,5 +1,7 @@
 #include "parser.h"
+#include <filesystem>
 #include <tuple>
+#include <unordered_set>
 
 std::ostream& operator<<(std::ostream& os, token_t t) {
     switch (t) {
@@ -7,14 +9,18 @@ std::ostream& operator<<(std::ostream& os, token_t t) {
         case token_t::EQUAL:      return os << "EQUAL";
         case token_t::LEFT_PAREN: return os << "LEFT_PAREN";
         case token_t::RIGHT_PAREN:return os << "RIGHT_PAREN";
+        case token_t::LEFT_BRACKET: return os << "LEFT_BRACKET";
+        case token_t::RIGHT_BRACKET: return os << "RIGHT_BRACKET";
         case token_t::COMMA:      return os << "COMMA";
         case token_t::PR_SYM:     return os << "PR_SYM";
         case token_t::MIN_SYM:    return os << "MIN_SYM";
+        case token_t::MONO_MIN_SYM: return os << "MONO_MIN_SYM";
         case token_t::CONST:      return os << "CONST";
         case token_t::PROJ:       return os << "PROJ";
         case token_t::SUCC:       return os << "SUCC";
         case token_t::VARIABLE:   return os << "VARIABLE";
         case token_t::NUM:        return os << "NUM";
+        case token_t::STRING:     return os << "STRING";
         case token_t::END:        return os << "END";
     }
     return os; // optional: silence compiler warning
@@ -22,7 +28,15 @@ std::ostream& operator<<(std::ostream& os, token_t t) {
 
 std::unique_ptr<parser> parser::create(std::string input)
 {
-    auto res = std::unique_ptr<parser>(new parser(input));
+    auto res = std::unique_ptr<parser>(new parser(std::move(input), nullptr));
+    res->cache.pos = 0;
+    res->next_token();
+    return res;
+}
+
+std::unique_ptr<parser> parser::create(std::shared_ptr<const source_file> source)
+{
+    auto res = std::unique_ptr<parser>(new parser("", std::move(source)));
     res->cache.pos = 0;
     res->next_token();
     return res;
@@ -30,11 +44,80 @@ std::unique_ptr<parser> parser::create(std::string input)
 
 void parser::set_input(const std::string &input)
 {
-    this->input = input;
+    owned = input;
+    source = nullptr;
+    this->input = owned;
     cache.pos = 0;
     next_token();
 }
 
+void parser::set_optimize(bool on)
+{
+    opt = on ? std::make_unique<optimizer>() : nullptr;
+}
+
+void parser::set_checkpoints(bool on) noexcept
+{
+    checkpoints = on;
+}
+
+void parser::set_fast_min(bool on) noexcept
+{
+    fast_min = on;
+}
+
+void parser::set_memo(bool on)
+{
+    memo = on ? std::make_shared<memo_table>() : nullptr;
+}
+
+void parser::set_tiering(bool on, const tiering_options& opts)
+{
+    tier_memo = on ? std::make_shared<memo_table>() : nullptr;
+    tier_opts = opts;
+}
+
+void parser::set_closed_forms(bool on)
+{
+    closed = on ? std::make_unique<normalizer>() : nullptr;
+}
+
+std::string parser::closed_forms() const
+{
+    return closed != nullptr ? closed->report() : "";
+}
+
+void parser::set_module_cache(std::shared_ptr<module_cache> cache)
+{
+    modules = std::move(cache);
+}
+
+void parser::set_import_dir(std::string dir)
+{
+    import_dir = std::move(dir);
+}
+
+void parser::set_roots(std::vector<std::string> names)
+{
+    roots = std::move(names);
+}
+
+void parser::set_parallel(std::shared_ptr<scheduler> pool, natural threshold)
+{
+    this->pool = std::move(pool);
+    fork_threshold = threshold;
+}
+
+void parser::set_parallel_parse(std::shared_ptr<scheduler> pool)
+{
+    parse_pool = std::move(pool);
+}
+
+void parser::set_perf(perf_recorder* perf) noexcept
+{
+    this->perf = perf;
+}
+
 /****** Lexer ******/
 
 void parser::next_token()
@@ -44,7 +127,7 @@ void parser::next_token()
         cache.pos++;
     }
 
-    if(input[cache.pos] == ';')
+    if(cache.pos < input.size() && input[cache.pos] == ';')
     {
         // Skip comment until newline or end of input
         cache.pos++; // Skip the ';'
@@ -56,6 +139,7 @@ void parser::next_token()
         return;
     }
     
+    cache.start = cache.pos;
     // Check for end of input
     if (cache.pos >= input.size()) {
         cache.token = token_t::END;
@@ -84,6 +168,16 @@ void parser::next_token()
         cache.pos++;
         break;
         
+    case '[':
+        cache.token = token_t::LEFT_BRACKET;
+        cache.pos++;
+        break;
+        
+    case ']':
+        cache.token = token_t::RIGHT_BRACKET;
+        cache.pos++;
+        break;
+        
     case ',':
         cache.token = token_t::COMMA;
         cache.pos++;
@@ -97,6 +191,11 @@ void parser::next_token()
     case '$':
         cache.token = token_t::MIN_SYM;
         cache.pos++;
+        // '$!' asserts that the search is upward closed
+        if (cache.pos < input.size() && input[cache.pos] == '!') {
+            cache.token = token_t::MONO_MIN_SYM;
+            cache.pos++;
+        }
         break;
         
     case 'C':
@@ -163,17 +262,35 @@ void parser::next_token()
         cache.token = token_t::SUCC;
         cache.pos++;
         break;
+
+    case '"':
+    {
+        // STRING: "..." on one line, kept in var_name
+        size_t start = ++cache.pos;
+        while (cache.pos < input.size() && input[cache.pos] != '"' && input[cache.pos] != '\n') {
+            cache.pos++;
+        }
+        if (cache.pos >= input.size() || input[cache.pos] != '"') {
+            throw parse_error("Expected '\"' at the end of the string");
+        }
+        cache.var_name = input.substr(start, cache.pos - start);
+        cache.token = token_t::STRING;
+        cache.pos++;
+        break;
+    }
         
     default:
         // VARIABLE: starts with lowercase, followed by alphanumerics
         if (islower(input[cache.pos])) {
-            cache.var_name.clear();
-            cache.var_name += input[cache.pos];
+            size_t start = cache.pos;
             cache.pos++;
-            while (cache.pos < input.size() && (isalnum(input[cache.pos]) || input[cache.pos] == '_')) {
-                cache.var_name += input[cache.pos];
+            // names qualified by namespaces, as in arith.add
+            while (cache.pos < input.size() && (isalnum(input[cache.pos]) || input[cache.pos] == '_'
+                   || (input[cache.pos] == '.' && cache.pos + 1 < input.size() && islower(static_cast<unsigned char>(input[cache.pos + 1]))))) {
                 cache.pos++;
             }
+            cache.var_name = input.substr(start, cache.pos - start);
+            cache.symbol = symbols.intern(cache.var_name);
             cache.token = token_t::VARIABLE;
         }
         else if(isdigit(input[cache.pos])) {
@@ -221,11 +338,11 @@ std::shared_ptr<identifier> parser::parse_identifer()
             next_token();
             break;
         case token_t::VARIABLE: // parse variable
-            result = get_variable(cache.var_name);
-            if(result == nullptr)
+            if(cache.symbol >= slots.size() || slots[cache.symbol] == std::string::npos)
             {
-                throw parse_error("Undefined variable: " + cache.var_name);
+                throw parse_error("Undefined variable: " + std::string(cache.var_name));
             }
+            result = defns[slots[cache.symbol]];
             next_token();
             break;
         default:
@@ -278,22 +395,47 @@ std::unique_ptr<primitive_recursion> parser::parse_primitive_recursion()
     return primitive_recursion::create(f, g);
 }
 
-std::unique_ptr<minimization> parser::parse_minimization()
+std::unique_ptr<expression> parser::parse_minimization()
 {
     PARSE_START("<minimization>");
-    if(cache.token != token_t::MIN_SYM) PARSE_FAIL;
+    if(cache.token != token_t::MIN_SYM && cache.token != token_t::MONO_MIN_SYM) PARSE_FAIL;
+    bool monotone = cache.token == token_t::MONO_MIN_SYM;
     next_token();
+    // '$[b] f' searches only below b
+    std::shared_ptr<expression> bound = nullptr;
+    if(cache.token == token_t::LEFT_BRACKET)
+    {
+        next_token();
+        bound = parse_expression();
+        if(bound == nullptr)
+        {
+            throw parse_error("Expect expression after '['");
+        }
+        if(cache.token != token_t::RIGHT_BRACKET)
+        {
+            throw parse_error("Expect ']' in bounded minimization");
+        }
+        next_token();
+    }
     std::shared_ptr<expression> f = parse_comp_exp();
     if(f == nullptr)
     {
         throw parse_error("Expect expression after '$'");
     }
-    return minimization::create(f);
+    if(bound != nullptr)
+    {
+        auto res = bounded_minimization::create(f, bound);
+        res->monotone = monotone;
+        return res;
+    }
+    auto res = minimization::create(f);
+    res->monotone = monotone;
+    return res;
 }
 
 /*
 <expression> ::= <comp-exp> '@' <comp-exp>
-               | '$' <comp-exp>
+               | '$' ['!'] ['[' <expression> ']'] <comp-exp>
                | <comp-exp>
 */
 std::unique_ptr<expression> parser::parse_expression()
@@ -366,12 +508,129 @@ std::unique_ptr<expression> parser::parse_atomic_exp()
     }
 }
 
+static void enable_checkpoints(const std::shared_ptr<expression>& e)
+{
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        enable_checkpoints(comp->f);
+        for(const auto& g : comp->gs)
+        {
+            enable_checkpoints(g);
+        }
+    }
+    else if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        if(pr->checkpoints == nullptr)
+        {
+            pr->checkpoints = std::make_unique<checkpoint_table>();
+        }
+        enable_checkpoints(pr->f);
+        enable_checkpoints(pr->g);
+    }
+    else if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        enable_checkpoints(mn->f);
+    }
+    else if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        enable_checkpoints(bm->bound);
+        enable_checkpoints(bm->f);
+    }
+}
+
+static void enable_forks(const std::shared_ptr<expression>& e, analyzer& ana,
+                         const std::shared_ptr<scheduler>& pool, natural threshold)
+{
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        auto plan = std::make_shared<fork_plan>();
+        plan->pool = pool;
+        plan->threshold = threshold;
+        for(size_t i = 0; i < comp->gs.size(); i++)
+        {
+            // only arguments that loop can be worth a task
+            auto est = ana.cost(comp->gs[i]);
+            if(est.depth > 0 || est.partial)
+            {
+                plan->candidates.push_back(i);
+                plan->costs.push_back(est);
+            }
+        }
+        if(plan->candidates.size() >= 2)
+        {
+            comp->fork = plan;
+        }
+        enable_forks(comp->f, ana, pool, threshold);
+        for(const auto& g : comp->gs)
+        {
+            enable_forks(g, ana, pool, threshold);
+        }
+    }
+    else if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        enable_forks(pr->f, ana, pool, threshold);
+        enable_forks(pr->g, ana, pool, threshold);
+    }
+    else if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        enable_forks(mn->f, ana, pool, threshold);
+    }
+    else if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        // a candidate past the least may diverge only if f is partial
+        auto est = ana.cost(bm->f);
+        if(!est.partial)
+        {
+            auto plan = std::make_shared<search_plan>();
+            plan->pool = pool;
+            plan->cost = est;
+            plan->threshold = threshold;
+            bm->parallel = plan;
+        }
+        enable_forks(bm->bound, ana, pool, threshold);
+        enable_forks(bm->f, ana, pool, threshold);
+    }
+}
+
+static void mark_monotone(const std::shared_ptr<expression>& e, analyzer& ana)
+{
+    if(auto comp = std::dynamic_pointer_cast<composition>(e))
+    {
+        mark_monotone(comp->f, ana);
+        for(const auto& g : comp->gs)
+        {
+            mark_monotone(g, ana);
+        }
+    }
+    else if(auto pr = std::dynamic_pointer_cast<primitive_recursion>(e))
+    {
+        mark_monotone(pr->f, ana);
+        mark_monotone(pr->g, ana);
+    }
+    else if(auto mn = std::dynamic_pointer_cast<minimization>(e))
+    {
+        mn->monotone = mn->monotone || ana.is_upward_closed(mn->f);
+        mark_monotone(mn->f, ana);
+    }
+    else if(auto bm = std::dynamic_pointer_cast<bounded_minimization>(e))
+    {
+        bm->monotone = bm->monotone || ana.is_upward_closed(bm->f);
+        mark_monotone(bm->bound, ana);
+        mark_monotone(bm->f, ana);
+    }
+}
+
 std::shared_ptr<variable> parser::parse_line()
 {
     PARSE_START("<line>");
+    if(cache.token == token_t::VARIABLE && cache.var_name == "import")
+    {
+        parse_import();
+        return nullptr;
+    }
     // parse lvalue
     if(cache.token != token_t::VARIABLE) PARSE_FAIL;
-    std::string var_name_local = std::move(cache.var_name);
+    std::string var_name_local(cache.var_name);
     next_token();
     if(cache.token != token_t::EQUAL) PARSE_FAIL;
     next_token();
@@ -381,14 +640,156 @@ std::shared_ptr<variable> parser::parse_line()
     {
         throw parse_error("Unknown expression");
     }
+    return define(var_name_local, std::move(rvalue));
+}
+
+std::shared_ptr<variable> parser::define(const std::string& name, std::shared_ptr<expression> rvalue)
+{
     // add variable to context
-    auto var = std::make_shared<variable>(var_name_local, rvalue->dim(), std::move(rvalue));
+    auto var = std::make_shared<variable>(name, rvalue->dim(), std::move(rvalue));
+    auto baseline = var->defn;
+    {
+        perf_recorder::scope optimising(perf, "optimise");
+        if(opt != nullptr)
+        {
+            var->defn = opt->simplify(var->defn);
+        }
+        prepare(var, baseline);
+    }
     add_variable(var);
     return var;
 }
 
+void parser::prepare(const std::shared_ptr<variable>& var, const std::shared_ptr<expression>& baseline)
+{
+    if(fast_min)
+    {
+        mark_monotone(var->defn, ana);
+    }
+    if(checkpoints)
+    {
+        enable_checkpoints(var->defn);
+    }
+    if(pool != nullptr)
+    {
+        enable_forks(var->defn, ana, pool, fork_threshold);
+    }
+    // looking up a loop-free definition costs about as much as running it
+    bool loops = false;
+    if(memo != nullptr || tier_memo != nullptr)
+    {
+        auto est = ana.cost(var->defn);
+        loops = est.depth > 0 || est.partial;
+    }
+    if(memo != nullptr && loops)
+    {
+        var->memo = memo;
+    }
+    if(tier_memo != nullptr)
+    {
+        var->tiers = std::make_shared<tier_state>(var.get(), baseline, var->defn, loops ? tier_memo : nullptr, tier_opts);
+    }
+    if(closed != nullptr)
+    {
+        var->closed = closed->derive(*var);
+    }
+}
+
+// 'import' '"' <file> '"' ['as' <variable>]
+void parser::parse_import()
+{
+    next_token();
+    if(cache.token != token_t::STRING)
+    {
+        throw parse_error("Expect a file name in quotes after import");
+    }
+    std::filesystem::path path(cache.var_name);
+    if(path.is_relative() && !import_dir.empty())
+    {
+        path = std::filesystem::path(import_dir) / path;
+    }
+    std::string ns = path.stem().string();
+    next_token();
+    if(cache.token == token_t::VARIABLE && cache.var_name == "as")
+    {
+        next_token();
+        if(cache.token != token_t::VARIABLE)
+        {
+            throw parse_error("Expect a name after as");
+        }
+        ns = cache.var_name;
+        next_token();
+    }
+    if(ns.empty() || !islower(static_cast<unsigned char>(ns[0]))
+       || !std::all_of(ns.begin(), ns.end(), [](unsigned char c){ return isalnum(c) || c == '_' || c == '.'; }))
+    {
+        throw parse_error("Module " + ns + " needs a name: import \"" + path.filename().string() + "\" as name");
+    }
+    if(modules == nullptr)
+    {
+        modules = std::make_shared<module_cache>();
+    }
+    std::string canonical = module_cache::canonical(path.string());
+    if(std::find(importing.begin(), importing.end(), canonical) != importing.end())
+    {
+        throw parse_error("Cyclic import of " + path.string());
+    }
+    // a module is parsed alone, with the options that change its definitions
+    auto compile = [this](std::string_view text, const std::string& file){
+        auto p = parser::create(std::string(text));
+        p->set_optimize(opt != nullptr);
+        p->set_module_cache(modules);
+        p->importing = importing;
+        p->importing.push_back(file);
+        p->set_import_dir(std::filesystem::path(file).parent_path().string());
+        if(auto err = p->try_parse())
+        {
+            err->pop_back();
+            throw parse_error("In module " + file + ":\n" + *err);
+        }
+        module_cache::compiled m;
+        m.deps = p->imported;
+        m.code = module_cache::encode(p->defns);
+        return m;
+    };
+    auto m = modules->load(path.string(), opt != nullptr, compile);
+    auto it = namespaces.find(ns);
+    if(it != namespaces.end())
+    {
+        if(it->second == m->source)
+        {
+            return;
+        }
+        throw parse_error("Namespace " + ns + " is already imported from another module");
+    }
+    namespaces.emplace(ns, m->source);
+    imported.emplace_back(canonical, m->source);
+    imported.insert(imported.end(), m->deps.begin(), m->deps.end());
+    for(const auto& var : module_cache::decode(*m, ns + "."))
+    {
+        prepare(var, var->defn);
+        add_variable(var);
+    }
+}
+
 void parser::parse()
 {
+    perf_recorder::scope parsing(perf, "parse");
+    if(!roots.empty())
+    {
+        parse_reachable();
+        return;
+    }
+    if(parse_pool != nullptr)
+    {
+        std::vector<size_t> starts{cache.start};
+        for(size_t i = input.find('\n', cache.start); i < input.size(); i = input.find('\n', i + 1))
+        {
+            starts.push_back(i + 1);
+        }
+        parse_lines(starts);
+        return;
+    }
     while(cache.token != token_t::END)
     {
         if(cache.token == token_t::NEWLINE)
@@ -408,6 +809,369 @@ void parser::parse()
     }
 }
 
+static bool is_name_char(char c)
+{
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// variables start with a lower-case letter
+static bool is_name_start(char c)
+{
+    return islower(static_cast<unsigned char>(c));
+}
+
+// Lines are indexed by the variable they define without being lexed. Then the
+// lines of the roots and of every variable named on them are parsed in their
+// original order, so that errors on those lines are reported as by a full
+// parse. Lines that do not start with "name =" are always parsed.
+void parser::parse_reachable()
+{
+    std::unordered_map<std::string_view, std::vector<size_t>> definitions;
+    std::vector<size_t> selected;
+    for(size_t start = 0; start < input.size(); )
+    {
+        size_t end = std::min(input.find('\n', start), input.size());
+        size_t i = start;
+        while(i < end && (input[i] == ' ' || input[i] == '\t' || input[i] == '\r')) i++;
+        if(i < end && input[i] != ';')
+        {
+            size_t j = i;
+            while(j < end && is_name_char(input[j])) j++;
+            size_t k = j;
+            while(k < end && (input[k] == ' ' || input[k] == '\t')) k++;
+            if(is_name_start(input[i]) && k < end && input[k] == '=')
+            {
+                definitions[input.substr(i, j - i)].push_back(start);
+            }
+            else
+            {
+                selected.push_back(start);
+            }
+        }
+        start = end + 1;
+    }
+    std::vector<std::string_view> work(roots.begin(), roots.end());
+    std::unordered_set<std::string_view> seen(work.begin(), work.end());
+    while(!work.empty())
+    {
+        auto it = definitions.find(work.back());
+        work.pop_back();
+        if(it == definitions.end()) continue;
+        for(size_t start : it->second)
+        {
+            selected.push_back(start);
+            size_t i = input.find('=', start) + 1;
+            while(i < input.size() && input[i] != '\n' && input[i] != ';')
+            {
+                if(!is_name_char(input[i]))
+                {
+                    i++;
+                    continue;
+                }
+                size_t j = i;
+                while(j < input.size() && is_name_char(input[j])) j++;
+                auto name = input.substr(i, j - i);
+                if(is_name_start(input[i]) && seen.insert(name).second)
+                {
+                    work.push_back(name);
+                }
+                i = j;
+            }
+        }
+    }
+    std::sort(selected.begin(), selected.end());
+    selected.erase(std::unique(selected.begin(), selected.end()), selected.end());
+    parse_lines(selected);
+}
+
+/****** Parallel parsing ******/
+
+// Workers parse lines with the grammar of parse_expression, but without
+// backtracking: the first token decides between '$' and the rest, and '@'
+// after a <comp-exp> makes it a recursion. Anything a line by line parse
+// would not accept throws, and the line is left to the ordered pass.
+
+parser::draft parser::draft_line(size_t start)
+{
+    draft d;
+    try
+    {
+        cache.pos = start;
+        next_token();
+        if(cache.token == token_t::NEWLINE || cache.token == token_t::END)
+        {
+            // blank: ok with no nodes
+            d.ok = true;
+            return d;
+        }
+        if(cache.token != token_t::VARIABLE || cache.var_name == "import")
+        {
+            return d;
+        }
+        d.name = cache.var_name;
+        next_token();
+        if(cache.token != token_t::EQUAL)
+        {
+            return d;
+        }
+        next_token();
+        draft_expression(d);
+        d.pos = cache.pos;
+        d.start = cache.start;
+        d.token = cache.token;
+        d.ok = cache.token == token_t::NEWLINE || cache.token == token_t::END;
+    }
+    catch(const parse_error&)
+    {
+        d.ok = false;
+    }
+    return d;
+}
+
+void parser::draft_expression(draft& d)
+{
+    if(cache.token == token_t::MIN_SYM || cache.token == token_t::MONO_MIN_SYM)
+    {
+        int monotone = cache.token == token_t::MONO_MIN_SYM;
+        next_token();
+        auto k = draft::kind::minimization;
+        if(cache.token == token_t::LEFT_BRACKET)
+        {
+            next_token();
+            draft_expression(d);
+            if(cache.token != token_t::RIGHT_BRACKET)
+            {
+                throw parse_error("Expect ']' in bounded minimization");
+            }
+            next_token();
+            k = draft::kind::bounded;
+        }
+        draft_comp_exp(d);
+        d.nodes.push_back({k, monotone});
+        return;
+    }
+    draft_comp_exp(d);
+    if(cache.token == token_t::PR_SYM)
+    {
+        next_token();
+        draft_comp_exp(d);
+        d.nodes.push_back({draft::kind::recursion});
+    }
+}
+
+void parser::draft_comp_exp(draft& d)
+{
+    draft_atomic_exp(d);
+    if(cache.token != token_t::LEFT_PAREN)
+    {
+        return;
+    }
+    next_token();
+    int args = 0;
+    while(cache.token != token_t::RIGHT_PAREN)
+    {
+        draft_expression(d);
+        args++;
+        if(cache.token == token_t::COMMA)
+        {
+            next_token();
+        }
+        else if(cache.token != token_t::RIGHT_PAREN)
+        {
+            throw parse_error("Expect ')' in compositon");
+        }
+    }
+    next_token();
+    d.nodes.push_back({draft::kind::composition, args});
+}
+
+void parser::draft_atomic_exp(draft& d)
+{
+    switch(cache.token)
+    {
+        case token_t::LEFT_PAREN:
+            next_token();
+            draft_expression(d);
+            if(cache.token != token_t::RIGHT_PAREN)
+            {
+                throw parse_error("Expect ')' after '('");
+            }
+            break;
+        case token_t::CONST:
+        case token_t::NUM:
+            d.nodes.push_back({draft::kind::constant, cache.num1, cache.num2});
+            break;
+        case token_t::PROJ:
+            d.nodes.push_back({draft::kind::projection, cache.num1, cache.num2});
+            break;
+        case token_t::SUCC:
+            d.nodes.push_back({draft::kind::successor});
+            break;
+        case token_t::VARIABLE:
+            d.nodes.push_back({draft::kind::variable, 0, 0, cache.var_name});
+            break;
+        default:
+            throw parse_error("Expect expression");
+    }
+    next_token();
+}
+
+// Nodes are built in the order the line by line parse builds them, so the
+// first that fails here is the first that fails there.
+std::shared_ptr<expression> parser::resolve(const draft& d)
+{
+    std::vector<std::shared_ptr<expression>> stack;
+    auto pop = [&stack](){
+        auto e = std::move(stack.back());
+        stack.pop_back();
+        return e;
+    };
+    for(const auto& n : d.nodes)
+    {
+        std::shared_ptr<identifier> id = nullptr;
+        switch(n.k)
+        {
+            case draft::kind::constant:
+                id = std::make_shared<constant>(n.num1, n.num2);
+                break;
+            case draft::kind::projection:
+                id = std::make_shared<projection>(n.num1, n.num2);
+                break;
+            case draft::kind::successor:
+                id = std::make_shared<successor>();
+                break;
+            case draft::kind::variable:
+            {
+                unsigned int symbol = symbols.intern(n.name);
+                if(symbol >= slots.size() || slots[symbol] == std::string::npos)
+                {
+                    throw parse_error("Undefined variable: " + std::string(n.name));
+                }
+                id = defns[slots[symbol]];
+                break;
+            }
+            case draft::kind::composition:
+            {
+                std::vector<std::shared_ptr<expression>> gs(stack.end() - n.num1, stack.end());
+                stack.resize(stack.size() - n.num1);
+                auto f = pop();
+                stack.push_back(composition::create(f, gs));
+                break;
+            }
+            case draft::kind::recursion:
+            {
+                auto g = pop();
+                auto f = pop();
+                stack.push_back(primitive_recursion::create(f, g));
+                break;
+            }
+            case draft::kind::minimization:
+            {
+                auto res = minimization::create(pop());
+                res->monotone = n.num1;
+                stack.push_back(std::move(res));
+                break;
+            }
+            case draft::kind::bounded:
+            {
+                auto f = pop();
+                auto bound = pop();
+                auto res = bounded_minimization::create(f, bound);
+                res->monotone = n.num1;
+                stack.push_back(std::move(res));
+                break;
+            }
+        }
+        if(id != nullptr)
+        {
+            stack.push_back(std::make_unique<atomic_exp>(std::move(id)));
+        }
+    }
+    return pop();
+}
+
+// The lines are drafted in chunks on the pool, then resolved and defined in
+// order. A line that did not draft, or that fails to resolve, is parsed
+// again on its own from its start, which throws the error a line by line
+// parse would with the lexer where it would leave it.
+void parser::parse_lines(const std::vector<size_t>& starts)
+{
+    std::vector<draft> drafts(parse_pool != nullptr ? starts.size() : 0);
+    if(parse_pool != nullptr)
+    {
+        size_t chunk = std::max<size_t>(1024, starts.size() / (8 * (parse_pool->size() + 1)) + 1);
+        std::vector<std::shared_ptr<scheduler::task>> tasks;
+        for(size_t lo = 0; lo < starts.size(); lo += chunk)
+        {
+            tasks.push_back(std::make_shared<scheduler::task>([this, &starts, &drafts, lo, chunk](){
+                // a lexer of its own, with its own symbols
+                parser worker("", nullptr);
+                worker.input = input;
+                for(size_t i = lo; i < std::min(lo + chunk, starts.size()); i++)
+                {
+                    drafts[i] = worker.draft_line(starts[i]);
+                }
+            }));
+            parse_pool->spawn(tasks.back());
+        }
+        // the tasks refer to drafts, so all are joined before leaving
+        std::exception_ptr error;
+        for(const auto& t : tasks)
+        {
+            try
+            {
+                parse_pool->join(*t);
+            }
+            catch(...)
+            {
+                error = error ? error : std::current_exception();
+            }
+        }
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+    for(size_t i = 0; i < starts.size(); i++)
+    {
+        if(!drafts.empty() && drafts[i].ok)
+        {
+            const draft& d = drafts[i];
+            if(d.nodes.empty())
+            {
+                continue;
+            }
+            std::shared_ptr<expression> rvalue = nullptr;
+            try
+            {
+                rvalue = resolve(d);
+            }
+            catch(const parse_error&) {}
+            if(rvalue != nullptr)
+            {
+                cache.pos = d.pos;
+                cache.start = d.start;
+                cache.token = d.token;
+                define(std::string(d.name), std::move(rvalue));
+                continue;
+            }
+        }
+        cache.pos = starts[i];
+        next_token();
+        if(cache.token == token_t::NEWLINE || cache.token == token_t::END)
+        {
+            continue;
+        }
+        parse_line();
+        if(cache.token != token_t::NEWLINE && cache.token != token_t::END)
+        {
+            throw parse_error("Expected end of line");
+        }
+    }
+    cache.pos = input.size();
+    cache.token = token_t::END;
+}
+
 std::optional<std::string> parser::try_parse()
 {
     try
@@ -418,9 +1182,8 @@ std::optional<std::string> parser::try_parse()
     catch(const parse_error &err)
     {
         std::ostringstream os;
-        char var = input[cache.pos];
         if(cache.pos>0) cache.pos--;
-        while(isspace(input[cache.pos]) && cache.pos > 0)
+        while(cache.pos > 0 && cache.pos < input.size() && isspace(input[cache.pos]))
             cache.pos--;
         size_t line_num = std::count(input.begin(), input.begin() + std::min(cache.pos, input.size()), '\n');
         os << "In line " << line_num << ":\n";
@@ -434,7 +1197,7 @@ std::optional<std::string> parser::try_parse()
         if (end == std::string::npos)
             end = input.size();
         
-        os << input.substr(start, end - start) + "\n";
+        os << input.substr(start, end - start) << "\n";
         os << std::string(cache.pos-start,' ')+"^ ";
         os << cache.token << " here\n";
         os << "parse error: " << err.what() << std::endl;
@@ -442,31 +1205,43 @@ std::optional<std::string> parser::try_parse()
     }
 }
 
-/****** interpreter ******/
-
-natural parser::eval_var(std::shared_ptr<variable> v, std::vector<natural> operands)
+std::shared_ptr<const program> parser::build() const
 {
-    return v->eval(operands);
+    return std::make_shared<const program>(defns, memo);
 }
 
-natural parser::eval_var(std::string s, std::vector<natural> operands)
+/****** specialiser ******/
+
+std::shared_ptr<variable> parser::specialize(const std::string& name, const std::map<unsigned int, natural>& fixed, const std::string& new_name)
 {
-    std::shared_ptr<variable> v = get_variable(s);
+    std::shared_ptr<variable> v = get_variable(name);
     if(v == nullptr)
     {
-        throw parse_error("eval_var: Undefined variable: " + s);
+        throw parse_error("specialize: Undefined variable: " + name);
+    }
+    std::vector<std::optional<natural>> args(v->dim());
+    for(auto [pos, value] : fixed)
+    {
+        if(pos == 0 || pos > v->dim())
+        {
+            throw parse_error("specialize: " + v->show_type() + " has no argument " + std::to_string(pos));
+        }
+        args[pos-1] = value;
     }
-    return v->eval(operands);
+    optimizer opt({.unfold = true, .unroll_limit = 16, .fold_closed = true});
+    auto res = opt.specialize(v, args, new_name);
+    add_variable(res);
+    return res;
 }
 
 /****** help funtions ******/
 
 std::shared_ptr<variable> parser::get_variable(const std::string &name) noexcept
 {
-    auto it = context.find(name);
-    if(it != context.end())
+    unsigned int id = symbols.find(name);
+    if(id < slots.size() && slots[id] != std::string::npos)
     {
-        return program[it->second];
+        return defns[slots[id]];
     }
     else
     {
@@ -476,18 +1251,23 @@ std::shared_ptr<variable> parser::get_variable(const std::string &name) noexcept
 
 void parser::add_variable(const std::shared_ptr<variable> &var)
 {
-    if(context.find(var->name) != context.end())
+    unsigned int id = symbols.intern(var->name);
+    if(id >= slots.size())
+    {
+        slots.resize(id + 1, std::string::npos);
+    }
+    if(slots[id] != std::string::npos)
     {
         throw parse_error("Redefinition of variable: " + var->name);
     }
-    context[var->name] = program.size();
-    program.push_back(var);
+    slots[id] = defns.size();
+    defns.push_back(var);
 }
 
 std::string parser::to_string() const
 {
     std::string result;
-    for(const auto& var : program)
+    for(const auto& var : defns)
     {
         //result += "; " + var->to_string(true) + "\n";
         result += var->to_string() + " = " + var->defn->to_string();
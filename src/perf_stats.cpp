@@ -0,0 +1,287 @@
+#include "perf_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/****** Heap accounting ******/
+
+namespace
+{
+
+// recorders alive; nothing is counted when none is
+std::atomic<int> recording{0};
+std::atomic<natural> allocations{0}, allocated{0};
+// bytes in use may go below zero when blocks allocated before the first
+// recorder are freed
+std::atomic<long long> in_use{0}, peak{0};
+// whether this program links the heap hooks
+std::atomic<bool> hooked{false};
+
+}
+
+void heap_accounting::hook() noexcept
+{
+    hooked.store(true, std::memory_order_relaxed);
+}
+
+bool heap_accounting::counting() noexcept
+{
+    return recording.load(std::memory_order_relaxed) != 0;
+}
+
+void heap_accounting::allocated_block(size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated.fetch_add(size, std::memory_order_relaxed);
+    long long now = in_use.fetch_add(size, std::memory_order_relaxed) + size;
+    long long seen = peak.load(std::memory_order_relaxed);
+    while(now > seen && !peak.compare_exchange_weak(seen, now, std::memory_order_relaxed)) {}
+}
+
+void heap_accounting::freed_block(size_t size) noexcept
+{
+    in_use.fetch_sub(size, std::memory_order_relaxed);
+}
+
+/****** Counters ******/
+
+#if defined(__linux__)
+
+static const std::pair<uint32_t, uint64_t> event_codes[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+static_assert(std::size(event_codes) == perf_recorder::events);
+
+static int open_event(uint32_t type, uint64_t config, int group) noexcept
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // threads started after opening are counted too
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+#else
+
+// no counters elsewhere; the clock and the heap are still accounted
+static int open_event(uint32_t, uint64_t, int) noexcept
+{
+    return -1;
+}
+
+static const std::pair<uint32_t, uint64_t> event_codes[perf_recorder::events] = {};
+
+#endif
+
+perf_recorder::perf_recorder()
+{
+    for(size_t i = 0; i < events; i++)
+    {
+        int fd = open_event(event_codes[i].first, event_codes[i].second, leader);
+        index[i] = fd >= 0 ? static_cast<int>(fds.size()) : -1;
+        if(fd >= 0)
+        {
+            fds.push_back(fd);
+            leader = leader >= 0 ? leader : fd;
+        }
+    }
+    recording.fetch_add(1);
+    peak.store(in_use.load());
+    last_allocations = allocations.load();
+    last_bytes = allocated.load();
+    read(last);
+    since = std::chrono::steady_clock::now();
+    done.push_back({"other", 1});
+}
+
+perf_recorder::~perf_recorder()
+{
+    recording.fetch_sub(1);
+#if defined(__linux__)
+    for(int fd : fds)
+    {
+        ::close(fd);
+    }
+#endif
+}
+
+bool perf_recorder::read(natural* counts) const
+{
+#if defined(__linux__)
+    if(leader < 0)
+    {
+        return false;
+    }
+    // nr, time enabled, time running, then a value per event
+    std::vector<uint64_t> buf(3 + fds.size());
+    if(::read(leader, buf.data(), buf.size() * sizeof(uint64_t)) < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+    {
+        return false;
+    }
+    // scaled up when the events had to share the counters
+    double scale = buf[2] > 0 && buf[2] < buf[1] ? static_cast<double>(buf[1]) / buf[2] : 1.0;
+    for(size_t i = 0; i < events; i++)
+    {
+        if(index[i] >= 0 && static_cast<uint64_t>(index[i]) < buf[0])
+        {
+            counts[i] = static_cast<natural>(buf[3 + index[i]] * scale);
+        }
+    }
+    return true;
+#else
+    (void)counts;
+    return false;
+#endif
+}
+
+void perf_recorder::charge()
+{
+    phase& ph = done[current];
+    natural now[events] = {};
+    if(read(now))
+    {
+        for(size_t i = 0; i < events; i++)
+        {
+            ph.counts[i] += now[i] - last[i];
+            last[i] = now[i];
+        }
+    }
+    natural a = allocations.load(), b = allocated.load();
+    ph.allocations += a - last_allocations;
+    ph.bytes += b - last_bytes;
+    last_allocations = a;
+    last_bytes = b;
+    ph.peak_bytes = std::max<natural>(ph.peak_bytes, std::max(peak.exchange(in_use.load()), 0LL));
+    auto t = std::chrono::steady_clock::now();
+    ph.seconds += std::chrono::duration<double>(t - since).count();
+    since = t;
+}
+
+std::string perf_recorder::enter(const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    charge();
+    std::string left = done[current].name;
+    auto it = std::find_if(done.begin(), done.end(), [&name](const phase& ph){ return ph.name == name; });
+    if(it == done.end())
+    {
+        it = done.insert(done.end(), phase{name});
+    }
+    it->entered++;
+    current = it - done.begin();
+    return left;
+}
+
+#if !defined(KLEENE_NO_PERF_STATS)
+
+perf_recorder::scope::scope(perf_recorder* recorder, const std::string& name)
+    : recorder(recorder)
+{
+    if(recorder != nullptr)
+    {
+        saved = recorder->enter(name);
+    }
+}
+
+perf_recorder::scope::~scope()
+{
+    if(recorder != nullptr)
+    {
+        recorder->enter(saved);
+    }
+}
+
+#endif
+
+std::vector<perf_recorder::phase> perf_recorder::phases()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    charge();
+    return done;
+}
+
+static std::string bytes(natural n)
+{
+    std::ostringstream os;
+    os.precision(3);
+    if(n >= 1 << 20)
+    {
+        os << n / 1048576.0 << " MiB";
+    }
+    else
+    {
+        os << n / 1024.0 << " KiB";
+    }
+    return os.str();
+}
+
+std::string perf_recorder::to_string()
+{
+    std::ostringstream os;
+    for(const auto& ph : phases())
+    {
+        os << ph.name << ": " << ph.seconds * 1000 << " ms";
+        for(size_t i = 0; i < events; i++)
+        {
+            if(counted(i))
+            {
+                os << ", " << ph.counts[i] << " " << event_names[i];
+            }
+        }
+        os << ", " << ph.allocations << " allocations of " << bytes(ph.bytes) << ", peak " << bytes(ph.peak_bytes) << "\n";
+    }
+    if(leader < 0)
+    {
+        os << "no counters: perf_event_open is not available\n";
+    }
+    if(!hooked.load(std::memory_order_relaxed))
+    {
+        os << "no heap accounting: not linked with src/heap_accounting.cpp\n";
+    }
+    return os.str();
+}
+
+std::string perf_recorder::to_json()
+{
+    std::ostringstream os;
+    os << "{\"events\": [";
+    for(size_t i = 0; i < events; i++)
+    {
+        os << (i > 0 ? ", " : "") << "\"" << event_names[i] << "\"";
+    }
+    os << "], \"phases\": [";
+    bool first = true;
+    for(const auto& ph : phases())
+    {
+        os << (first ? "" : ", ") << "{\"name\": \"" << ph.name << "\", \"entered\": " << ph.entered
+           << ", \"seconds\": " << ph.seconds;
+        for(size_t i = 0; i < events; i++)
+        {
+            os << ", \"" << event_names[i] << "\": " << (counted(i) ? std::to_string(ph.counts[i]) : "null");
+        }
+        os << ", \"allocations\": " << ph.allocations << ", \"bytes\": " << ph.bytes
+           << ", \"peak_bytes\": " << ph.peak_bytes << "}";
+        first = false;
+    }
+    os << "]}";
+    return os.str();
+}
@@ -0,0 +1,185 @@
+#include "polynomial.h"
+
+natural saturating_add(natural a, natural b) noexcept
+{
+    return a + b < a ? polynomial::infinity : a + b;
+}
+
+natural saturating_mul(natural a, natural b) noexcept
+{
+    if(a != 0 && b > polynomial::infinity / a) return polynomial::infinity;
+    return a * b;
+}
+
+static void trim(polynomial::monomial& m) noexcept
+{
+    while(!m.empty() && m.back() == 0)
+    {
+        m.pop_back();
+    }
+}
+
+polynomial::polynomial(natural k)
+{
+    if(k != 0)
+    {
+        terms[{}] = k;
+    }
+}
+
+polynomial polynomial::variable(unsigned int i)
+{
+    polynomial res;
+    monomial m(i, 0);
+    m[i-1] = 1;
+    res.terms[m] = 1;
+    return res;
+}
+
+polynomial polynomial::operator+(const polynomial& q) const
+{
+    polynomial res = *this;
+    for(const auto& [m, c] : q.terms)
+    {
+        res.terms[m] = saturating_add(res.terms[m], c);
+    }
+    return res;
+}
+
+polynomial polynomial::operator*(const polynomial& q) const
+{
+    polynomial res;
+    for(const auto& [m1, c1] : terms)
+    {
+        for(const auto& [m2, c2] : q.terms)
+        {
+            monomial m(std::max(m1.size(), m2.size()), 0);
+            for(size_t i = 0; i < m.size(); i++)
+            {
+                m[i] = (i < m1.size() ? m1[i] : 0) + (i < m2.size() ? m2[i] : 0);
+            }
+            res.terms[m] = saturating_add(res.terms[m], saturating_mul(c1, c2));
+        }
+    }
+    return res;
+}
+
+polynomial polynomial::substitute(const std::vector<polynomial>& qs) const
+{
+    polynomial res;
+    for(const auto& [m, c] : terms)
+    {
+        polynomial term(c);
+        for(size_t i = 0; i < m.size(); i++)
+        {
+            for(unsigned int e = 0; e < m[i]; e++)
+            {
+                term = term * (i < qs.size() ? qs[i] : polynomial());
+            }
+        }
+        res = res + term;
+    }
+    return res;
+}
+
+unsigned int polynomial::degree() const noexcept
+{
+    unsigned int res = 0;
+    for(const auto& [m, c] : terms)
+    {
+        unsigned int d = 0;
+        for(auto e : m)
+        {
+            d += e;
+        }
+        res = std::max(res, d);
+    }
+    return res;
+}
+
+unsigned int polynomial::degree_in(unsigned int i) const noexcept
+{
+    unsigned int res = 0;
+    for(const auto& [m, c] : terms)
+    {
+        if(i <= m.size())
+        {
+            res = std::max(res, m[i-1]);
+        }
+    }
+    return res;
+}
+
+polynomial polynomial::coefficient_of(unsigned int i, unsigned int d) const
+{
+    polynomial res;
+    for(const auto& [m, c] : terms)
+    {
+        if((i <= m.size() ? m[i-1] : 0) != d) continue;
+        monomial rest = m;
+        if(i <= rest.size())
+        {
+            rest[i-1] = 0;
+        }
+        trim(rest);
+        res.terms[rest] = saturating_add(res.terms[rest], c);
+    }
+    return res;
+}
+
+natural polynomial::eval(const std::vector<natural>& xs) const noexcept
+{
+    natural res = 0;
+    for(const auto& [m, c] : terms)
+    {
+        natural term = c;
+        for(size_t i = 0; i < m.size(); i++)
+        {
+            for(unsigned int e = 0; e < m[i]; e++)
+            {
+                term = saturating_mul(term, i < xs.size() ? xs[i] : 0);
+            }
+        }
+        res = saturating_add(res, term);
+    }
+    return res;
+}
+
+std::string polynomial::to_string() const
+{
+    if(terms.empty())
+    {
+        return "0";
+    }
+    // highest degree first
+    std::vector<std::pair<monomial, natural>> sorted(terms.rbegin(), terms.rend());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b){
+        polynomial pa, pb;
+        pa.terms.insert(a);
+        pb.terms.insert(b);
+        return pa.degree() > pb.degree();
+    });
+    std::string result;
+    for(const auto& [m, c] : sorted)
+    {
+        std::string term;
+        for(size_t i = 0; i < m.size(); i++)
+        {
+            if(m[i] == 0) continue;
+            if(!term.empty()) term += "*";
+            term += "x" + std::to_string(i + 1);
+            if(m[i] > 1) term += "^" + std::to_string(m[i]);
+        }
+        std::string coeff = c == infinity ? "inf" : std::to_string(c);
+        if(term.empty())
+        {
+            term = coeff;
+        }
+        else if(c != 1)
+        {
+            term = coeff + "*" + term;
+        }
+        result += (result.empty() ? "" : " + ") + term;
+    }
+    return result;
+}
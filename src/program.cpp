@@ -0,0 +1,66 @@
+#include "program.h"
+
+program::program(const std::vector<std::shared_ptr<variable>>& vs, std::shared_ptr<memo_table> memo)
+    : memo(std::move(memo))
+{
+    for(const auto& v : vs)
+    {
+        context[v->name] = defns.size();
+        defns.push_back(v);
+    }
+}
+
+std::shared_ptr<const variable> program::get_variable(const std::string& name) const noexcept
+{
+    auto it = context.find(name);
+    if(it != context.end())
+    {
+        return defns[it->second];
+    }
+    else
+    {
+        return nullptr;
+    }
+}
+
+natural program::eval(const variable& v, const std::vector<natural>& operands) const
+{
+    if(v.dim() != operands.size())
+    {
+        throw interprete_error(v.name + " expects " + std::to_string(v.dim()) + " arguments, but "
+                               + std::to_string(operands.size()) + " provided");
+    }
+    return v.eval(operands);
+}
+
+natural program::eval(const std::string& name, const std::vector<natural>& operands) const
+{
+    auto v = get_variable(name);
+    if(v == nullptr)
+    {
+        throw interprete_error("eval: Undefined variable: " + name);
+    }
+    return eval(*v, operands);
+}
+
+std::string program::to_string() const
+{
+    std::string result;
+    for(const auto& var : defns)
+    {
+        result += var->to_string() + " = " + var->defn->to_string();
+        result += "\n";
+    }
+    return result;
+}
+
+natural program::fingerprint() const
+{
+    // FNV-1a
+    natural h = 0xcbf29ce484222325ULL;
+    for(unsigned char c : to_string())
+    {
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    return h;
+}
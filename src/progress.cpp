@@ -0,0 +1,148 @@
+#include "progress.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+progress_monitor::progress_monitor(std::ostream& os, std::chrono::milliseconds interval, bool started)
+    : os(os), interval(interval)
+{
+    if(started)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        start();
+    }
+}
+
+void progress_monitor::start()
+{
+    reporter = std::thread([this]{
+        // signal handlers cannot notify, so requests are polled
+        const auto poll = std::chrono::milliseconds(100);
+        auto next = std::chrono::steady_clock::now() + this->interval;
+        std::unique_lock<std::mutex> guard(lock);
+        while(!stopping)
+        {
+            wake.wait_for(guard, poll);
+            auto now = std::chrono::steady_clock::now();
+            bool due = this->interval.count() > 0 && now >= next;
+            if(!progress_requested.exchange(false) && !due) continue;
+            if(due)
+            {
+                next = now + this->interval;
+            }
+            guard.unlock();
+            std::string lines = report();
+            this->os << lines << std::flush;
+            guard.lock();
+        }
+    });
+}
+
+progress_monitor::~progress_monitor()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if(reporter.joinable())
+    {
+        reporter.join();
+    }
+}
+
+thread_progress* progress_monitor::watch()
+{
+    auto counters = std::make_shared<thread_progress>();
+    current_progress = counters.get();
+    auto now = std::chrono::steady_clock::now();
+    threads.push_back({std::move(counters), now, now});
+    return current_progress;
+}
+
+thread_progress* watch_on_request()
+{
+    progress_monitor& monitor = *standby_monitor;
+    standby_monitor = nullptr;
+    std::lock_guard<std::mutex> guard(monitor.lock);
+    progress_requested.store(false);
+    if(!monitor.reporter.joinable())
+    {
+        monitor.start();
+    }
+    return monitor.watch();
+}
+
+progress_monitor::scope::scope(progress_monitor& monitor)
+    : monitor(monitor), saved(current_progress), saved_standby(standby_monitor)
+{
+    std::lock_guard<std::mutex> guard(monitor.lock);
+    if(monitor.reporter.joinable())
+    {
+        monitor.watch();
+    }
+    else
+    {
+        current_progress = nullptr;
+        standby_monitor = &monitor;
+    }
+}
+
+progress_monitor::scope::~scope()
+{
+    std::lock_guard<std::mutex> guard(monitor.lock);
+    auto& ts = monitor.threads;
+    ts.erase(std::remove_if(ts.begin(), ts.end(), [](const watched& w){
+        return w.counters.get() == current_progress;
+    }), ts.end());
+    current_progress = saved;
+    standby_monitor = saved_standby;
+}
+
+void progress_monitor::request() noexcept
+{
+    progress_requested.store(true);
+}
+
+std::string progress_monitor::report()
+{
+    std::ostringstream oss;
+    std::lock_guard<std::mutex> guard(lock);
+    auto now = std::chrono::steady_clock::now();
+    for(auto& w : threads)
+    {
+        const thread_progress& c = *w.counters;
+        natural total = c.iterations.load(std::memory_order_relaxed);
+        std::chrono::duration<double> elapsed = now - w.start, since = now - w.last;
+        double rate = since.count() > 0 ? (total - w.last_iterations) / since.count() : 0;
+        w.last = now;
+        w.last_iterations = total;
+        oss << "[progress] " << std::fixed << std::setprecision(1) << elapsed.count() << " s: "
+            << total << " iterations, " << std::setprecision(0) << rate << "/s";
+        size_t depth = c.depth.load(std::memory_order_acquire);
+        for(size_t d = 0; d < depth && d < thread_progress::max_depth; d++)
+        {
+            const auto& l = c.loops[d];
+            oss << (d == 0 ? "; " : " > ");
+            if(l.search.load(std::memory_order_relaxed))
+            {
+                oss << "$ at " << l.at.load(std::memory_order_relaxed);
+                if(natural bound = l.bound.load(std::memory_order_relaxed))
+                {
+                    oss << "/" << bound;
+                }
+            }
+            else
+            {
+                oss << "@ " << l.at.load(std::memory_order_relaxed) << "/" << l.bound.load(std::memory_order_relaxed);
+            }
+            oss << " (" << l.iterations.load(std::memory_order_relaxed) << ")";
+        }
+        if(depth > thread_progress::max_depth)
+        {
+            oss << " > " << depth - thread_progress::max_depth << " more";
+        }
+        oss << "\n";
+    }
+    return oss.str();
+}
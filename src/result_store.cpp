@@ -0,0 +1,277 @@
+#include "result_store.h"
+#include <cerrno>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/****** Hashing ******/
+
+static natural mix(natural h) noexcept
+{
+    // the finaliser of splitmix64
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+static digest& feed(digest& d, natural x) noexcept
+{
+    d.a = mix(d.a ^ x);
+    d.b = mix(d.b + x * 0x9e3779b97f4a7c15ULL + 1);
+    return d;
+}
+
+static digest& feed(digest& d, const digest& e) noexcept
+{
+    return feed(feed(d, e.a), e.b);
+}
+
+digest structural_hash::operator()(const expression& e)
+{
+    digest d{0x6b6c65656e65ULL, 0x7374727563747572ULL};
+    if(auto atom = dynamic_cast<const atomic_exp*>(&e))
+    {
+        const identifier* idt = atom->idt.get();
+        if(auto c = dynamic_cast<const constant*>(idt))
+        {
+            feed(feed(feed(d, 'C'), c->n), c->k);
+        }
+        else if(auto p = dynamic_cast<const projection*>(idt))
+        {
+            feed(feed(feed(d, 'P'), p->n), p->k);
+        }
+        else if(auto v = dynamic_cast<const variable*>(idt))
+        {
+            // a call is its callee's definition, whatever its name
+            feed(feed(d, 'V'), (*this)(*v));
+        }
+        else
+        {
+            feed(d, 'S');
+        }
+    }
+    else if(auto comp = dynamic_cast<const composition*>(&e))
+    {
+        feed(feed(feed(d, 'O'), comp->gs.size()), (*this)(*comp->f));
+        for(const auto& g : comp->gs)
+        {
+            feed(d, (*this)(*g));
+        }
+    }
+    else if(auto pr = dynamic_cast<const primitive_recursion*>(&e))
+    {
+        feed(feed(feed(d, 'R'), (*this)(*pr->f)), (*this)(*pr->g));
+    }
+    else if(auto mn = dynamic_cast<const minimization*>(&e))
+    {
+        feed(feed(feed(d, 'M'), mn->monotone), (*this)(*mn->f));
+    }
+    else if(auto bm = dynamic_cast<const bounded_minimization*>(&e))
+    {
+        feed(feed(feed(feed(d, 'B'), bm->monotone), (*this)(*bm->bound)), (*this)(*bm->f));
+    }
+    return d;
+}
+
+digest structural_hash::operator()(const variable& v)
+{
+    auto it = hashes.find(&v);
+    if(it != hashes.end())
+    {
+        return it->second;
+    }
+    digest d = (*this)(*v.defn);
+    hashes.emplace(&v, d);
+    return d;
+}
+
+/****** The store ******/
+
+static constexpr natural store_magic = 0x6b6c2d7265732031ULL;
+
+struct result_store::header
+{
+    natural magic, slots;
+    // stamps of use, and what every process found in the store
+    natural clock, hits, lookups, used;
+    natural reserved[2];
+};
+
+struct result_store::slot
+{
+    natural a, b, value;
+    // when it was last used; 0 if empty
+    natural stamp;
+};
+
+namespace
+{
+
+// excludes other processes while in scope
+class file_lock
+{
+    int fd;
+public:
+    explicit file_lock(int fd) noexcept : fd(fd)
+    {
+        while(::flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+    }
+    ~file_lock()
+    {
+        ::flock(fd, LOCK_UN);
+    }
+};
+
+}
+
+std::unique_ptr<result_store> result_store::open(const std::string& dir, size_t slots)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::string path = (std::filesystem::path(dir) / "results.klr").string();
+    std::unique_ptr<result_store> res(new result_store());
+    res->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(res->fd < 0)
+    {
+        throw std::runtime_error("Cannot open result cache " + path);
+    }
+    file_lock guard(res->fd);
+    struct stat st;
+    if(::fstat(res->fd, &st) != 0)
+    {
+        throw std::runtime_error("Cannot open result cache " + path);
+    }
+    bool fresh = st.st_size == 0;
+    size_t count = std::max<size_t>(slots / ways, 1) * ways;
+    res->length = fresh ? sizeof(header) + count * sizeof(slot) : st.st_size;
+    if(fresh && ::ftruncate(res->fd, res->length) != 0)
+    {
+        throw std::runtime_error("Cannot allocate result cache " + path);
+    }
+    if(res->length < sizeof(header))
+    {
+        throw std::runtime_error(path + " is not a result cache");
+    }
+    void* p = ::mmap(nullptr, res->length, PROT_READ | PROT_WRITE, MAP_SHARED, res->fd, 0);
+    if(p == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map result cache " + path);
+    }
+    res->base = p;
+    header& h = res->head();
+    if(fresh)
+    {
+        h.magic = store_magic;
+        h.slots = count;
+    }
+    else if(h.magic != store_magic || h.slots == 0 || h.slots % ways != 0
+            || res->length != sizeof(header) + h.slots * sizeof(slot))
+    {
+        throw std::runtime_error(path + " is not a result cache");
+    }
+    return res;
+}
+
+result_store::~result_store()
+{
+    if(base != nullptr)
+    {
+        ::munmap(base, length);
+    }
+    if(fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+result_store::header& result_store::head() const noexcept
+{
+    return *static_cast<header*>(base);
+}
+
+result_store::slot* result_store::bucket(const digest& key) const noexcept
+{
+    natural buckets = head().slots / ways;
+    auto slots = reinterpret_cast<slot*>(static_cast<char*>(base) + sizeof(header));
+    return slots + (key.a % buckets) * ways;
+}
+
+digest result_store::key(const variable& v, const std::vector<natural>& operands)
+{
+    digest d = hasher(v);
+    feed(d, operands.size());
+    for(natural x : operands)
+    {
+        feed(d, x);
+    }
+    return d;
+}
+
+std::optional<natural> result_store::find(const variable& v, const std::vector<natural>& operands)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    digest k = key(v, operands);
+    file_lock exclusive(fd);
+    header& h = head();
+    h.lookups++;
+    slot* s = bucket(k);
+    slot* found = std::find_if(s, s + ways, [&k](const slot& x){
+        return x.stamp != 0 && x.a == k.a && x.b == k.b;
+    });
+    if(found != s + ways)
+    {
+        found->stamp = ++h.clock;
+        h.hits++;
+        count.hits++;
+        return found->value;
+    }
+    count.misses++;
+    return std::nullopt;
+}
+
+void result_store::store(const variable& v, const std::vector<natural>& operands, natural value)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    digest k = key(v, operands);
+    file_lock exclusive(fd);
+    header& h = head();
+    slot* s = bucket(k);
+    // the same key, else an empty slot, else the least recently used
+    slot* target = std::find_if(s, s + ways, [&k](const slot& x){
+        return x.stamp != 0 && x.a == k.a && x.b == k.b;
+    });
+    if(target == s + ways)
+    {
+        target = std::min_element(s, s + ways, [](const slot& x, const slot& y){
+            return x.stamp < y.stamp;
+        });
+    }
+    if(target->stamp == 0)
+    {
+        h.used++;
+    }
+    else if(target->a != k.a || target->b != k.b)
+    {
+        count.evicted++;
+    }
+    *target = {k.a, k.b, value, ++h.clock};
+    count.stored++;
+}
+
+result_store::counters result_store::stats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+std::string result_store::to_string() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    file_lock exclusive(fd);
+    const header& h = head();
+    return std::to_string(h.used) + " of " + std::to_string(h.slots) + " slots used, "
+         + std::to_string(h.hits) + " hits in " + std::to_string(h.lookups) + " lookups";
+}
@@ -0,0 +1,304 @@
+#include "scheduler.h"
+
+// the scheduler a worker thread belongs to, and its queue
+static thread_local const scheduler* current = nullptr;
+static thread_local size_t current_queue = 0;
+
+scheduler::scheduler(unsigned int threads)
+    : queues((threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())) + 1)
+{
+    for(size_t i = 0; i + 1 < queues.size(); i++)
+    {
+        workers.emplace_back([this, i]{
+            current = this;
+            current_queue = i;
+            while(true)
+            {
+                if(auto t = take(i))
+                {
+                    execute(*t);
+                    continue;
+                }
+                std::unique_lock<std::mutex> guard(sleep_lock);
+                wake.wait(guard, [this]{ return stopping || pending > 0; });
+                if(stopping && pending == 0)
+                {
+                    return;
+                }
+            }
+        });
+    }
+}
+
+scheduler::~scheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(auto& w : workers)
+    {
+        w.join();
+    }
+}
+
+size_t scheduler::own_queue() const noexcept
+{
+    return current == this ? current_queue : queues.size() - 1;
+}
+
+void scheduler::spawn(const std::shared_ptr<task>& t)
+{
+    // counted first, so that pending never drops below the tasks queued
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        pending++;
+    }
+    auto& q = queues[own_queue()];
+    {
+        std::lock_guard<std::mutex> guard(q.lock);
+        q.tasks.push_back(t);
+    }
+    wake.notify_one();
+}
+
+std::shared_ptr<scheduler::task> scheduler::take(size_t self)
+{
+    {
+        auto& q = queues[self];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if(!q.tasks.empty())
+        {
+            auto t = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            pending--;
+            return t;
+        }
+    }
+    for(size_t k = 1; k < queues.size(); k++)
+    {
+        auto& q = queues[(self + k) % queues.size()];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if(!q.tasks.empty())
+        {
+            auto t = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            pending--;
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+void scheduler::execute(task& t)
+{
+    try
+    {
+        t.run();
+    }
+    catch(...)
+    {
+        t.error = std::current_exception();
+    }
+    t.done.store(true, std::memory_order_release);
+    // threads in join() sleep with the workers
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+    }
+    wake.notify_all();
+}
+
+void scheduler::join(task& t)
+{
+    size_t self = own_queue();
+    while(!t.done.load(std::memory_order_acquire))
+    {
+        if(auto other = take(self))
+        {
+            execute(*other);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        wake.wait(guard, [this, &t]{ return t.done.load(std::memory_order_acquire) || pending > 0; });
+    }
+    if(t.error)
+    {
+        std::rethrow_exception(t.error);
+    }
+}
+
+// runs body with the steps the parent had left when it forked, and adds
+// those it took to spent, whether it finishes or throws
+template<class F>
+static void metered(natural budget, std::atomic<natural>& spent, F&& body)
+{
+    step_limit limit(budget);
+    try
+    {
+        body();
+    }
+    catch(...)
+    {
+        spent.fetch_add(budget - steps_left, std::memory_order_relaxed);
+        throw;
+    }
+    spent.fetch_add(budget - steps_left, std::memory_order_relaxed);
+}
+
+// charges the current thread for the steps its tasks took
+static void charge(natural spent)
+{
+    if(spent > steps_left)
+    {
+        steps_left = 0;
+        throw budget_exceeded("Step budget exhausted");
+    }
+    steps_left -= spent;
+}
+
+std::vector<natural> fork_eval(const fork_plan& plan, const std::vector<std::shared_ptr<expression>>& gs,
+                               const std::vector<natural>& operands)
+{
+    std::vector<natural> vs(gs.size());
+    std::vector<bool> forked(gs.size(), false);
+    std::vector<std::shared_ptr<scheduler::task>> tasks;
+    std::atomic<natural> spent{0};
+    size_t heavy = 0;
+    for(size_t k = 0; k < plan.candidates.size(); k++)
+    {
+        if(plan.costs[k].cost(operands) < plan.threshold) continue;
+        // the first heavy argument is left to this thread
+        if(heavy++ == 0) continue;
+        size_t i = plan.candidates[k];
+        forked[i] = true;
+        // a task may take as many steps as its parent has left, and the
+        // parent is charged for them once joined
+        tasks.push_back(std::make_shared<scheduler::task>(
+            [g = gs[i].get(), out = &vs[i], &operands, &spent, budget = steps_left]{
+                metered(budget, spent, [&]{ *out = g->eval(operands); });
+            }));
+        plan.pool->spawn(tasks.back());
+    }
+    std::exception_ptr error;
+    try
+    {
+        for(size_t i = 0; i < gs.size(); i++)
+        {
+            if(!forked[i])
+            {
+                vs[i] = gs[i]->eval(operands);
+            }
+        }
+    }
+    catch(...)
+    {
+        error = std::current_exception();
+    }
+    // the tasks refer to operands and vs, so all are joined before leaving
+    for(const auto& t : tasks)
+    {
+        try
+        {
+            plan.pool->join(*t);
+        }
+        catch(...)
+        {
+            if(!error) error = std::current_exception();
+        }
+    }
+    if(error)
+    {
+        std::rethrow_exception(error);
+    }
+    charge(spent.load());
+    return vs;
+}
+
+natural search_eval(const search_plan& plan, const expression& f, std::vector<natural>& xs, natural hi)
+{
+    std::atomic<natural> found{hi};
+    // tries ys[0] = lo, lo+1, ... below end until some candidate found
+    // earlier is reached
+    auto scan = [&f, &found](std::vector<natural>& ys, natural lo, natural end, loop_probe* probe){
+        for(ys[0] = lo; ys[0] < end && ys[0] < found.load(std::memory_order_relaxed); ys[0]++)
+        {
+            take_step();
+            if(probe != nullptr) probe->tick(ys[0]);
+            if(f.eval(ys) == 0)
+            {
+                natural seen = found.load(std::memory_order_relaxed);
+                while(ys[0] < seen && !found.compare_exchange_weak(seen, ys[0], std::memory_order_relaxed)) {}
+                return;
+            }
+        }
+    };
+    loop_probe probe(true, hi);
+    xs[0] = hi;
+    natural each = saturating_add(plan.cost.cost(xs), 1);
+    if(saturating_mul(hi, each) < plan.threshold)
+    {
+        scan(xs, 0, hi, &probe);
+        return found.load();
+    }
+    // rounds of one chunk per worker and one for this thread, so the
+    // search stops soon after the round holding the least candidate
+    natural chunk = std::max<natural>(plan.threshold / each, 1);
+    natural lanes = plan.pool->size() + 1;
+    for(natural start = 0; start < hi; )
+    {
+        natural end = start + std::min(hi - start, saturating_mul(chunk, lanes));
+        std::vector<std::shared_ptr<scheduler::task>> tasks;
+        std::vector<natural> starts;
+        std::atomic<natural> spent{0};
+        for(natural a = start + chunk; a > start && a < end; a += chunk)
+        {
+            starts.push_back(a);
+            tasks.push_back(std::make_shared<scheduler::task>(
+                [&scan, &spent, ys = xs, a, b = a + std::min(chunk, end - a), budget = steps_left]() mutable {
+                    metered(budget, spent, [&]{ scan(ys, a, b, nullptr); });
+                }));
+            plan.pool->spawn(tasks.back());
+        }
+        // an error counts only if no candidate before it was found
+        std::exception_ptr error;
+        natural error_at = hi;
+        try
+        {
+            scan(xs, start, start + std::min(chunk, end - start), &probe);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+            error_at = start;
+        }
+        // the tasks refer to scan, so all are joined before leaving
+        for(size_t i = 0; i < tasks.size(); i++)
+        {
+            try
+            {
+                plan.pool->join(*tasks[i]);
+            }
+            catch(...)
+            {
+                if(starts[i] < error_at)
+                {
+                    error = std::current_exception();
+                    error_at = starts[i];
+                }
+            }
+        }
+        natural least = found.load();
+        if(error && error_at < least)
+        {
+            std::rethrow_exception(error);
+        }
+        charge(spent.load());
+        if(least < hi)
+        {
+            return least;
+        }
+        start = end;
+    }
+    return hi;
+}
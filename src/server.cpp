@@ -0,0 +1,515 @@
+#include "server.h"
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+thread_pool::thread_pool(unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        workers.emplace_back([this]{
+            while(true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    ready.wait(guard, [this]{ return stopping || !tasks.empty(); });
+                    if(tasks.empty())
+                    {
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        });
+    }
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push(std::move(task));
+    }
+    ready.notify_one();
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for(auto& w : workers)
+    {
+        w.join();
+    }
+}
+
+static std::string quote(const std::string& s)
+{
+    std::string res = "\"";
+    for(char c : s)
+    {
+        switch(c)
+        {
+            case '"':  res += "\\\""; break;
+            case '\\': res += "\\\\"; break;
+            case '\n': res += "\\n"; break;
+            case '\t': res += "\\t"; break;
+            case '\r': res += "\\r"; break;
+            default:
+                if(static_cast<unsigned char>(c) < 0x20)
+                {
+                    const char* hex = "0123456789abcdef";
+                    res += std::string("\\u00") + hex[c >> 4] + hex[c & 15];
+                }
+                else
+                {
+                    res += c;
+                }
+                break;
+        }
+    }
+    return res + "\"";
+}
+
+// just enough JSON for flat request objects
+struct json_reader
+{
+    const std::string& s;
+    size_t i = 0;
+    void skip_space()
+    {
+        while(i < s.size() && std::isspace(static_cast<unsigned char>(s[i]))) i++;
+    }
+    void expect(char c)
+    {
+        skip_space();
+        if(i >= s.size() || s[i] != c)
+        {
+            throw std::invalid_argument(std::string("expected '") + c + "' at column " + std::to_string(i + 1));
+        }
+        i++;
+    }
+    bool next_is(char c)
+    {
+        skip_space();
+        return i < s.size() && s[i] == c;
+    }
+    std::string read_string()
+    {
+        expect('"');
+        std::string res;
+        while(i < s.size() && s[i] != '"')
+        {
+            if(s[i] == '\\' && i + 1 < s.size())
+            {
+                i++;
+                switch(s[i])
+                {
+                    case 'n': res += '\n'; break;
+                    case 't': res += '\t'; break;
+                    case 'r': res += '\r'; break;
+                    case 'b': res += '\b'; break;
+                    case 'f': res += '\f'; break;
+                    case 'u': append_utf8(res, read_code_point()); continue;
+                    default:  res += s[i]; break;
+                }
+            }
+            else
+            {
+                res += s[i];
+            }
+            i++;
+        }
+        expect('"');
+        return res;
+    }
+    // the four hex digits after "\\u", at i
+    unsigned int read_hex4()
+    {
+        if(i + 5 > s.size())
+        {
+            throw std::invalid_argument("expected four hex digits at column " + std::to_string(i + 2));
+        }
+        unsigned int u = 0;
+        for(size_t j = i + 1; j < i + 5; j++)
+        {
+            int d = std::isdigit(static_cast<unsigned char>(s[j])) ? s[j] - '0'
+                  : std::isxdigit(static_cast<unsigned char>(s[j])) ? std::tolower(static_cast<unsigned char>(s[j])) - 'a' + 10
+                  : -1;
+            if(d < 0)
+            {
+                throw std::invalid_argument("expected four hex digits at column " + std::to_string(i + 2));
+            }
+            u = u * 16 + d;
+        }
+        i += 5;
+        return u;
+    }
+    // a "\\u" escape at i, joined with the low half that must follow a
+    // high surrogate; leaves i after it
+    char32_t read_code_point()
+    {
+        size_t at = i;
+        char32_t u = read_hex4();
+        if(u >= 0xDC00 && u <= 0xDFFF)
+        {
+            throw std::invalid_argument("unpaired surrogate at column " + std::to_string(at));
+        }
+        if(u >= 0xD800 && u <= 0xDBFF)
+        {
+            if(i + 1 >= s.size() || s[i] != '\\' || s[i + 1] != 'u')
+            {
+                throw std::invalid_argument("unpaired surrogate at column " + std::to_string(at));
+            }
+            i++;
+            char32_t low = read_hex4();
+            if(low < 0xDC00 || low > 0xDFFF)
+            {
+                throw std::invalid_argument("unpaired surrogate at column " + std::to_string(at));
+            }
+            u = 0x10000 + ((u - 0xD800) << 10) + (low - 0xDC00);
+        }
+        return u;
+    }
+    static void append_utf8(std::string& res, char32_t u)
+    {
+        if(u < 0x80)
+        {
+            res += static_cast<char>(u);
+        }
+        else if(u < 0x800)
+        {
+            res += static_cast<char>(0xC0 | (u >> 6));
+            res += static_cast<char>(0x80 | (u & 0x3F));
+        }
+        else if(u < 0x10000)
+        {
+            res += static_cast<char>(0xE0 | (u >> 12));
+            res += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+            res += static_cast<char>(0x80 | (u & 0x3F));
+        }
+        else
+        {
+            res += static_cast<char>(0xF0 | (u >> 18));
+            res += static_cast<char>(0x80 | ((u >> 12) & 0x3F));
+            res += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+            res += static_cast<char>(0x80 | (u & 0x3F));
+        }
+    }
+    natural read_natural()
+    {
+        skip_space();
+        size_t start = i;
+        while(i < s.size() && std::isdigit(static_cast<unsigned char>(s[i]))) i++;
+        if(start == i)
+        {
+            throw std::invalid_argument("expected a natural number at column " + std::to_string(i + 1));
+        }
+        return std::stoull(s.substr(start, i - start));
+    }
+    // any value, parsed and written again, so that it can be copied into
+    // a response as it stands
+    std::string read_value()
+    {
+        skip_space();
+        if(i >= s.size())
+        {
+            throw std::invalid_argument("expected a value at column " + std::to_string(i + 1));
+        }
+        if(s[i] == '"')
+        {
+            return quote(read_string());
+        }
+        if(s[i] == '[' || s[i] == '{')
+        {
+            bool object = s[i] == '{';
+            char close = object ? '}' : ']';
+            std::string res(1, s[i++]);
+            while(!next_is(close))
+            {
+                if(res.size() > 1) res += ", ";
+                if(object)
+                {
+                    res += quote(read_string());
+                    expect(':');
+                    res += ": ";
+                }
+                res += read_value();
+                if(!next_is(close)) expect(',');
+            }
+            expect(close);
+            return res + close;
+        }
+        for(const char* word : {"true", "false", "null"})
+        {
+            if(s.compare(i, std::strlen(word), word) == 0)
+            {
+                i += std::strlen(word);
+                return word;
+            }
+        }
+        return read_number();
+    }
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    std::string read_number()
+    {
+        size_t start = i;
+        auto digits = [this]{
+            size_t from = i;
+            while(i < s.size() && std::isdigit(static_cast<unsigned char>(s[i]))) i++;
+            return i > from;
+        };
+        if(i < s.size() && s[i] == '-') i++;
+        if(i < s.size() && s[i] == '0') i++;
+        else if(!digits()) i = start;
+        if(i > start && i < s.size() && s[i] == '.')
+        {
+            i++;
+            if(!digits()) i = start;
+        }
+        if(i > start && i < s.size() && (s[i] == 'e' || s[i] == 'E'))
+        {
+            i++;
+            if(i < s.size() && (s[i] == '+' || s[i] == '-')) i++;
+            if(!digits()) i = start;
+        }
+        if(i == start || s[i - 1] == '-')
+        {
+            i = start;
+            throw std::invalid_argument("expected a value at column " + std::to_string(i + 1));
+        }
+        return s.substr(start, i - start);
+    }
+};
+
+server::server() : server(options()) {}
+
+static unsigned int pool_size(const server::options& opts)
+{
+    return opts.threads != 0 ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+server::server(options opts)
+    : opts(opts), pool(pool_size(opts))
+{
+    if(this->opts.in_flight == 0)
+    {
+        this->opts.in_flight = 4 * pool_size(opts);
+    }
+}
+
+void server::admit()
+{
+    std::unique_lock<std::mutex> guard(flight_lock);
+    landed.wait(guard, [this]{ return in_flight < opts.in_flight; });
+    in_flight++;
+}
+
+void server::release()
+{
+    {
+        std::lock_guard<std::mutex> guard(flight_lock);
+        in_flight--;
+    }
+    landed.notify_one();
+}
+
+void server::add_program(const std::string& name, std::shared_ptr<const program> prog)
+{
+    if(programs.empty())
+    {
+        default_program = name;
+    }
+    programs[name] = std::move(prog);
+}
+
+std::string server::answer(const std::string& request) const
+{
+    std::string id, program_name = default_program, entry, result;
+    std::vector<natural> args;
+    natural budget = opts.budget;
+    try
+    {
+        json_reader r{request};
+        r.expect('{');
+        while(!r.next_is('}'))
+        {
+            std::string key = r.read_string();
+            r.expect(':');
+            if(key == "id")
+            {
+                id = r.read_value();
+            }
+            else if(key == "program")
+            {
+                program_name = r.read_string();
+            }
+            else if(key == "entry")
+            {
+                entry = r.read_string();
+            }
+            else if(key == "budget")
+            {
+                budget = std::min(budget, r.read_natural());
+            }
+            else if(key == "args")
+            {
+                r.expect('[');
+                while(!r.next_is(']'))
+                {
+                    args.push_back(r.read_natural());
+                    if(!r.next_is(']')) r.expect(',');
+                }
+                r.expect(']');
+            }
+            else
+            {
+                r.read_value();
+            }
+            if(!r.next_is('}')) r.expect(',');
+        }
+        r.expect('}');
+        auto it = programs.find(program_name);
+        if(it == programs.end())
+        {
+            throw interprete_error("Unknown program: " + program_name);
+        }
+        step_limit limit(budget);
+        result = "\"result\": " + std::to_string(it->second->eval(entry, args));
+    }
+    catch(const std::invalid_argument& e)
+    {
+        result = "\"error\": " + quote(std::string("Bad request: ") + e.what());
+    }
+    catch(const std::out_of_range& e)
+    {
+        result = "\"error\": " + quote("Bad request: number out of range");
+    }
+    catch(const std::runtime_error& e)
+    {
+        result = "\"error\": " + quote(e.what());
+    }
+    // anything else, such as running out of memory, fails the request alone
+    catch(const std::exception& e)
+    {
+        result = "\"error\": " + quote(std::string("Internal error: ") + e.what());
+    }
+    catch(...)
+    {
+        result = "\"error\": " + quote("Internal error");
+    }
+    return "{" + (id.empty() ? "" : "\"id\": " + id + ", ") + result + "}";
+}
+
+void server::serve(std::istream& in, std::ostream& out)
+{
+    std::mutex lock;
+    std::condition_variable done;
+    size_t pending = 0;
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        admit();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            pending++;
+        }
+        pool.submit([&, line]{
+            std::string response = answer(line);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                out << response << std::endl;
+                if(--pending == 0)
+                {
+                    done.notify_all();
+                }
+            }
+            release();
+        });
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&]{ return pending == 0; });
+}
+
+// a client of listen(); closed once the client has hung up and every
+// request it sent has been answered
+struct connection
+{
+    int fd;
+    std::mutex lock;
+    explicit connection(int fd) noexcept : fd(fd) {}
+    void write(std::string s)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        s += '\n';
+        for(size_t sent = 0; sent < s.size(); )
+        {
+            ssize_t n = ::send(fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0) return;
+            sent += n;
+        }
+    }
+    ~connection()
+    {
+        ::close(fd);
+    }
+};
+
+void server::listen(const std::string& path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path))
+    {
+        throw std::runtime_error("serve: socket path too long: " + path);
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(path.c_str());
+    if(fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0)
+    {
+        throw std::runtime_error("serve: cannot listen on " + path + ": " + std::strerror(errno));
+    }
+    while(true)
+    {
+        int client = ::accept(fd, nullptr, nullptr);
+        if(client < 0)
+        {
+            if(errno == EINTR) continue;
+            ::close(fd);
+            throw std::runtime_error(std::string("serve: accept: ") + std::strerror(errno));
+        }
+        std::thread([this, conn = std::make_shared<connection>(client)]{
+            std::string buffer;
+            char chunk[4096];
+            ssize_t n;
+            while((n = ::read(conn->fd, chunk, sizeof(chunk))) > 0)
+            {
+                buffer.append(chunk, n);
+                size_t start = 0, end;
+                while((end = buffer.find('\n', start)) != std::string::npos)
+                {
+                    std::string line = buffer.substr(start, end - start);
+                    start = end + 1;
+                    if(line.find_first_not_of(" \t\r") == std::string::npos) continue;
+                    admit();
+                    pool.submit([this, conn, line]{
+                        conn->write(answer(line));
+                        release();
+                    });
+                }
+                buffer.erase(0, start);
+            }
+        }).detach();
+    }
+}
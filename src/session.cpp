@@ -0,0 +1,45 @@
+#include "session.h"
+
+std::optional<std::string> session::update_code(const std::string& code)
+{
+    cancel();
+    prog = nullptr;
+    auto p = parser::create(code);
+    auto errmsg = p->try_parse();
+    if(!errmsg)
+    {
+        prog = p->build();
+    }
+    return errmsg;
+}
+
+std::optional<std::string> session::eval(const std::string& entry, const std::vector<natural>& operands)
+{
+    cancel();
+    if(prog == nullptr)
+    {
+        return "No program";
+    }
+    auto v = prog->get_variable(entry);
+    if(v == nullptr)
+    {
+        return "Entry point '" + entry + "' not found";
+    }
+    if(v->dim() != operands.size())
+    {
+        return "Entry point '" + entry + "' expects " + std::to_string(v->dim()) + " arguments, but "
+               + std::to_string(operands.size()) + " provided";
+    }
+    current = std::make_unique<machine>(prog, *v, operands);
+    return std::nullopt;
+}
+
+bool session::step(natural budget)
+{
+    return current != nullptr && current->run(budget);
+}
+
+void session::cancel() noexcept
+{
+    current = nullptr;
+}
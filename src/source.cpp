@@ -0,0 +1,48 @@
+#include "source.h"
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+std::shared_ptr<const source_file> source_file::open(const std::string& path)
+{
+    auto res = std::shared_ptr<source_file>(new source_file());
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd >= 0)
+    {
+        struct stat st;
+        if(::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p != MAP_FAILED)
+            {
+                res->data = static_cast<const char*>(p);
+                res->length = st.st_size;
+            }
+        }
+        ::close(fd);
+        if(res->data != nullptr)
+        {
+            return res;
+        }
+    }
+    std::ifstream file(path);
+    if(!file.good())
+    {
+        return nullptr;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    res->contents = buffer.str();
+    return res;
+}
+
+source_file::~source_file()
+{
+    if(data != nullptr)
+    {
+        ::munmap(const_cast<char*>(data), length);
+    }
+}
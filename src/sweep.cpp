@@ -0,0 +1,104 @@
+#include "sweep.h"
+
+const primitive_recursion* sweep_loop(const variable& v, unsigned int pos) noexcept
+{
+    if(pos != 1)
+    {
+        return nullptr;
+    }
+    // aliases such as f = g loop as g does
+    const expression* e = v.defn.get();
+    while(auto atom = dynamic_cast<const atomic_exp*>(e))
+    {
+        auto w = dynamic_cast<const variable*>(atom->idt.get());
+        if(w == nullptr)
+        {
+            return nullptr;
+        }
+        e = w->defn.get();
+    }
+    return dynamic_cast<const primitive_recursion*>(e);
+}
+
+bool sweep(const variable& v, const std::vector<natural>& fixed, const sweep_range& range,
+           const std::function<void(natural, natural)>& emit, scheduler& pool)
+{
+    if(v.dim() != fixed.size() + 1 || range.pos < 1 || range.pos > v.dim())
+    {
+        throw interprete_error(v.name + " expects " + std::to_string(v.dim()) + " arguments, but "
+                               + std::to_string(fixed.size()) + " provided besides the swept one");
+    }
+    auto pr = sweep_loop(v, range.pos);
+    if(range.lo > range.hi)
+    {
+        return pr != nullptr;
+    }
+    if(pr != nullptr)
+    {
+        // the accumulator after n iterations is the value at n
+        std::vector<natural> ys = {0, pr->f->eval(fixed)};
+        ys.insert(ys.end(), fixed.begin(), fixed.end());
+        loop_probe probe(false, range.hi);
+        for(ys[0] = 0; ; ys[0]++)
+        {
+            if(ys[0] >= range.lo)
+            {
+                emit(ys[0], ys[1]);
+            }
+            if(ys[0] == range.hi)
+            {
+                break;
+            }
+            take_step();
+            probe.tick(ys[0]);
+            ys[1] = pr->g->eval(ys);
+        }
+        return true;
+    }
+    // a few values per worker at a time, emitted in order as they are joined
+    natural window = std::max(pool.size(), 1u) * 4;
+    for(natural start = range.lo; ; start += window)
+    {
+        natural count = std::min(window - 1, range.hi - start) + 1;
+        std::vector<natural> values(count);
+        std::vector<std::shared_ptr<scheduler::task>> tasks;
+        for(natural j = 0; j < count; j++)
+        {
+            tasks.push_back(std::make_shared<scheduler::task>([&v, &fixed, &values, &range, start, j](){
+                std::vector<natural> operands(fixed);
+                operands.insert(operands.begin() + (range.pos - 1), start + j);
+                values[j] = v.eval(operands);
+            }));
+            pool.spawn(tasks.back());
+        }
+        std::exception_ptr error;
+        for(natural j = 0; j < count; j++)
+        {
+            // every task is joined before values goes away, even on errors
+            try
+            {
+                pool.join(*tasks[j]);
+                if(error == nullptr)
+                {
+                    emit(start + j, values[j]);
+                }
+            }
+            catch(...)
+            {
+                if(error == nullptr)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if(error != nullptr)
+        {
+            std::rethrow_exception(error);
+        }
+        if(range.hi - start < window)
+        {
+            break;
+        }
+    }
+    return false;
+}
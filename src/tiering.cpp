@@ -0,0 +1,129 @@
+#include "tiering.h"
+#include <chrono>
+#include <iomanip>
+
+std::ostream& operator<<(std::ostream& os, tier t)
+{
+    switch(t)
+    {
+        case tier::baseline:  return os << "baseline";
+        case tier::optimized: return os << "optimized";
+        case tier::memoised:  return os << "memoised";
+        default:              return os << "unknown";
+    }
+}
+
+tier_state::tier_state(const variable* owner, std::shared_ptr<expression> baseline, std::shared_ptr<expression> optimized,
+                       std::shared_ptr<memo_table> memo, const tiering_options& opts) noexcept
+    : owner(owner), baseline(std::move(baseline)), optimized(std::move(optimized)), memo(std::move(memo)), opts(opts) {}
+
+void tier_state::promote(tier from, natural calls) noexcept
+{
+    tier to = from;
+    if(from == tier::baseline && calls >= opts.optimize_after)
+    {
+        to = tier::optimized;
+    }
+    else if(from == tier::optimized && memo != nullptr && calls >= opts.memoise_after
+            && per_tier[1].steps.load(std::memory_order_relaxed) >= opts.memoise_min_steps * calls)
+    {
+        to = tier::memoised;
+    }
+    if(to != from)
+    {
+        current.compare_exchange_strong(from, to, std::memory_order_relaxed);
+    }
+}
+
+natural tier_state::eval(const std::vector<natural>& operands)
+{
+    tier t = level();
+    auto& c = per_tier[static_cast<int>(t)];
+    natural calls = c.calls.fetch_add(1, std::memory_order_relaxed) + 1;
+    bool timing = opts.time_every <= 1 || (calls - 1) % opts.time_every == 0;
+    std::chrono::steady_clock::time_point start;
+    if(timing)
+    {
+        start = std::chrono::steady_clock::now();
+    }
+    natural before = steps_left;
+    auto finish = [&]{
+        c.steps.fetch_add(before - steps_left, std::memory_order_relaxed);
+        if(timing)
+        {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            c.nanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+            c.timed.fetch_add(1, std::memory_order_relaxed);
+        }
+        promote(t, calls);
+    };
+    if(t == tier::memoised)
+    {
+        if(auto hit = memo->find(owner, operands))
+        {
+            finish();
+            return *hit;
+        }
+    }
+    natural res = (t == tier::baseline ? baseline : optimized)->eval(operands);
+    if(t == tier::memoised)
+    {
+        memo->insert(owner, operands, res);
+    }
+    finish();
+    return res;
+}
+
+natural tiered_eval(tier_state& t, const std::vector<natural>& operands)
+{
+    return t.eval(operands);
+}
+
+natural tier_state::calls() const noexcept
+{
+    natural res = 0;
+    for(const auto& c : per_tier)
+    {
+        res += c.calls.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+double tier_state::average_nanos(const counters& c) noexcept
+{
+    natural timed = c.timed.load(std::memory_order_relaxed);
+    return timed == 0 ? 0 : double(c.nanos.load(std::memory_order_relaxed)) / timed;
+}
+
+double tier_state::saved_ms() const noexcept
+{
+    if(per_tier[0].timed.load(std::memory_order_relaxed) == 0)
+    {
+        return 0;
+    }
+    double base_avg = average_nanos(per_tier[0]);
+    double saved = 0;
+    for(int k = 1; k < 3; k++)
+    {
+        natural calls = per_tier[k].calls.load(std::memory_order_relaxed);
+        saved += calls * (base_avg - average_nanos(per_tier[k]));
+    }
+    return saved / 1e6;
+}
+
+std::string tier_state::report() const
+{
+    std::ostringstream oss;
+    oss << level();
+    for(int k = 0; k < 3; k++)
+    {
+        natural calls = per_tier[k].calls.load(std::memory_order_relaxed);
+        if(calls == 0) continue;
+        oss << "; " << static_cast<tier>(k) << ": " << calls << " calls, "
+            << per_tier[k].steps.load(std::memory_order_relaxed) / calls << " steps and "
+            << std::fixed << std::setprecision(2) << average_nanos(per_tier[k]) / 1e3
+            << " us per call";
+    }
+    oss << "; about " << std::fixed << std::setprecision(3) << saved_ms() << " ms saved";
+    return oss.str();
+}
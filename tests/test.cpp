@@ -1,5 +1,18 @@
 #include <iostream>
+#include <thread>
+#include <set>
+#include <fstream>
+#include <filesystem>
+#include <csignal>
 #include "parser.h"
+#include "server.h"
+#include "session.h"
+#include "embed.h"
+#include "sweep.h"
+#include "generator.h"
+#include "differential.h"
+#include "result_store.h"
+#include "perf_stats.h"
 
 std::string str = R"(
 pred = 0 @ P2_1 ;; x ~> x-1
@@ -18,6 +31,1000 @@ div = $rsub(S(mul(P3_3,P3_1)),P3_2)
 mod = rsub(mul(P2_2, div(P2_1, P2_2)), P2_1)
 )";
 
+int failures = 0;
+
+void check(bool cond, const std::string& what)
+{
+    if(!cond)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+void test_specialize()
+{
+    auto p = parser::create(str);
+    p->parse();
+    auto prog = p->build();
+    auto mod7 = p->specialize("mod", {{2, 7}}, "mod7");
+    check(mod7->dim() == 1, "mod7 is unary");
+    for(natural x = 0; x < 30; x++)
+    {
+        check(mod7->eval({x}) == prog->eval("mod", {x, 7}), "mod7(" + std::to_string(x) + ")");
+    }
+    auto if1 = p->specialize("if", {{1, 0}, {3, 5}}, "if1");
+    check(if1->eval({9}) == prog->eval("if", {0, 9, 5}), "if1(9)");
+    auto div = p->specialize("div", {{1, 100}, {2, 7}}, "div100");
+    check(div->dim() == 0 && div->eval({}) == prog->eval("div", {100, 7}), "div100");
+    auto mul = p->specialize("mul", {{1, 6}, {2, 7}}, "mul42");
+    check(atom_cast<constant>(mul->defn) != nullptr && mul->eval({}) == 42, "mul42 is folded");
+    auto huge = p->specialize("mul", {{1, 1000000000}, {2, 1000000000}}, "mulhuge");
+    check(huge->dim() == 0 && atom_cast<constant>(huge->defn) == nullptr, "terms too long to evaluate are not folded");
+}
+
+void test_simplify()
+{
+    auto p = parser::create(str);
+    p->parse();
+    auto q = parser::create(str);
+    q->set_optimize(false);
+    q->parse();
+    auto prog = p->build();
+    for(const auto& v : q->variables())
+    {
+        std::vector<natural> operands(v->dim(), 1);
+        for(natural x = 1; x < 6; x++)
+        {
+            operands[0] = x;
+            check(prog->eval(v->name, operands) == v->eval(operands), "simplified " + v->name);
+        }
+    }
+    p->set_input("a = C3_0(mul, add, minus3(P2_1))");
+    check(node_count(p->parse_line()->defn) == 1, "constant composition is folded");
+    p->set_input("b = (id(P2_1))(add, P2_2)");
+    check(p->parse_line()->defn->to_string() == "add", "projections and wrappers are folded");
+    p->set_input("c = (add(P1_1, P1_1))(mul(P1_1, P1_1))");
+    auto c = p->parse_line()->defn->to_string();
+    check(c.find("mul") == c.rfind("mul"), "arguments read twice are evaluated once");
+}
+
+void test_checkpoints()
+{
+    auto p = parser::create(str);
+    p->set_checkpoints(true);
+    p->parse();
+    auto q = parser::create(str);
+    q->parse();
+    auto fast = p->build(), slow = q->build();
+    // descending and then ascending counters, so that both fresh runs
+    // and resumed runs are compared
+    for(natural x : {9, 4, 0, 3, 7, 12, 12, 5})
+    {
+        for(natural y = 1; y < 4; y++)
+        {
+            check(fast->eval("mul", {x, y}) == slow->eval("mul", {x, y}), "checkpointed mul");
+            check(fast->eval("div", {x, y}) == slow->eval("div", {x, y}), "checkpointed div");
+            check(fast->eval("mod", {x, y}) == slow->eval("mod", {x, y}), "checkpointed mod");
+        }
+    }
+    // a run stopped before recording leaves no entry for its parameters
+    auto add = std::dynamic_pointer_cast<primitive_recursion>(p->get_variable("add")->defn);
+    check(add != nullptr && add->checkpoints != nullptr, "add keeps checkpoints");
+    if(add != nullptr && add->checkpoints != nullptr)
+    {
+        try
+        {
+            step_limit limit(2);
+            fast->eval("add", {1000, 77777});
+        }
+        catch(const budget_exceeded&) {}
+        check(add->checkpoints->points.count({77777}) == 0, "a lookup inserts no checkpoint");
+        check(fast->eval("add", {10, 77777}) == 77787 && add->checkpoints->points.count({77777}) == 1,
+              "a finished run records its checkpoint");
+    }
+}
+
+void test_fast_min()
+{
+    auto p = parser::create(str);
+    p->set_fast_min(true);
+    p->parse();
+    auto q = parser::create(str);
+    q->parse();
+    auto fast = p->build(), slow = q->build();
+    for(std::string name : {"div3cell", "div"})
+    {
+        auto mn = std::dynamic_pointer_cast<minimization>(fast->get_variable(name)->defn);
+        check(mn != nullptr && mn->monotone, name + " searches by bisection");
+    }
+    for(natural x = 0; x < 40; x++)
+    {
+        check(fast->eval("div3cell", {x}) == slow->eval("div3cell", {x}), "fast div3cell");
+        for(natural y = 1; y < 5; y++)
+        {
+            check(fast->eval("div", {x, y}) == slow->eval("div", {x, y}), "fast div");
+        }
+    }
+    p->set_input("isqrt = pred($!rsub(mul(P2_1, P2_1), S(P2_2)))");
+    auto isqrt = p->parse_line();
+    check(isqrt->defn->to_string().find("$!") != std::string::npos, "'$!' is kept");
+    check(isqrt->eval({99}) == 9 && isqrt->eval({100}) == 10, "asserted isqrt");
+}
+
+void test_analyze()
+{
+    auto p = parser::create(str);
+    p->parse();
+    analyzer ana;
+    auto add = ana.cost(std::make_shared<atomic_exp>(p->get_variable("add")));
+    check(add.depth == 1 && add.grzegorczyk() == 1 && add.value.to_string() == "x1 + x2", "add is linear");
+    auto mul = ana.cost(std::make_shared<atomic_exp>(p->get_variable("mul")));
+    check(mul.depth == 2 && mul.grzegorczyk() == 2 && mul.value.to_string() == "x1*x2", "mul is quadratic");
+    check(mul.cost({3, 4}) == 15, "mul(3, 4) takes at most 15 steps");
+    auto div = ana.cost(std::make_shared<atomic_exp>(p->get_variable("div")));
+    check(div.partial && !div.steps_bounded, "div is partial");
+    p->set_input("exp = C1_1 @ add(P3_2, P3_2)");
+    auto exp = ana.cost(std::make_shared<atomic_exp>(p->parse_line()));
+    check(!exp.value_bounded && exp.grzegorczyk() == 3, "exp is exponential");
+}
+
+void test_ranges()
+{
+    auto p = parser::create(str);
+    p->parse();
+    p->set_input("below = $[P1_1] C2_1");
+    p->parse_line();
+    p->set_input("exp = C1_1 @ add(P3_2, P3_2)");
+    p->parse_line();
+    analyzer ana;
+    auto range = [&ana, &p](const std::string& name, std::vector<value_range> xs){
+        return ana.range(std::make_shared<atomic_exp>(p->get_variable(name)), xs);
+    };
+    auto mul = range("mul", {value_range::point(6), value_range::point(7)});
+    check(mul.lo <= 42 && mul.hi >= 42 && !mul.wraps && mul.bits() == 8, "mul(6, 7) in 8 bits");
+    auto big = range("mul", {{0, 100000}, {0, 100000}});
+    check(big.hi == 10000000000ull && big.bits() == 64 && !big.wraps, "mul below 100000 in 64 bits");
+    check(range("below", {{5, 9}}) == value_range{5, 9, false}, "a search that finds nothing returns its bound");
+    check(range("exp", {value_range::point(100)}) == value_range::any(), "exp grows beyond polynomials");
+    check(range("add", {value_range::point(1), {}}).wraps, "add on any natural may wrap");
+    check(ana.annotate_ranges(p->get_variable("mul"), {value_range::point(6), value_range::point(7)})
+          .find("mul(x1 in [6, 6], x2 in [7, 7]) in ") != std::string::npos, "ranges are dumped");
+    // every value of generated programs lies in its range
+    for(natural seed = 1; seed <= 10; seed++)
+    {
+        program_generator gen(seed);
+        auto q = parser::create(gen.generate());
+        q->parse();
+        auto prog = q->build();
+        analyzer a;
+        for(const auto& v : q->variables())
+        {
+            std::vector<value_range> box(v->dim(), {0, 3, false});
+            auto r = a.range(std::make_shared<atomic_exp>(v), box);
+            for(int i = 0; i < 4; i++)
+            {
+                auto xs = gen.arguments(v->dim(), 3);
+                try
+                {
+                    step_limit limit(20000);
+                    natural x = prog->eval(v->name, xs);
+                    check(r.wraps || (r.lo <= x && x <= r.hi), "seed " + std::to_string(seed) + ": " + v->name + " in " + r.to_string());
+                }
+                catch(const budget_exceeded&) {}
+            }
+        }
+    }
+}
+
+void test_bounded_minimization()
+{
+    // div searches no further than its dividend, so it also stops on 0
+    std::string bounded = str + "bdiv = $[S(P2_1)] rsub(S(mul(P3_3,P3_1)),P3_2)\n"
+                                "isqrt = pred($[S(P1_1)] rsub(mul(P2_1, P2_1), S(P2_2)))\n";
+    auto p = parser::create(bounded);
+    p->parse();
+    auto prog = p->build();
+    check(prog->eval("bdiv", {9, 0}) == 10, "bounded search gives its bound");
+    check(prog->eval("isqrt", {99}) == 9 && prog->eval("isqrt", {100}) == 10, "bounded isqrt");
+    analyzer ana;
+    auto est = ana.cost(std::make_shared<atomic_exp>(p->get_variable("bdiv")));
+    check(!est.partial && est.steps_bounded && est.value.to_string() == "x1 + 1", "bounded search is total");
+    auto q = parser::create(bounded);
+    q->set_parallel(std::make_shared<scheduler>(3), 10);
+    q->parse();
+    auto bm = std::dynamic_pointer_cast<bounded_minimization>(q->get_variable("bdiv")->defn);
+    check(bm != nullptr && bm->parallel != nullptr, "bounded search runs in chunks");
+    auto r = parser::create(bounded);
+    r->set_fast_min(true);
+    r->parse();
+    auto chunked = q->build(), fast = r->build();
+    for(natural x = 0; x < 40; x++)
+    {
+        for(natural y = 0; y < 5; y++)
+        {
+            natural expected = y == 0 && x >= 2 ? x + 1 : prog->eval("div", {x, y});
+            check(prog->eval("bdiv", {x, y}) == expected, "bounded div");
+            check(chunked->eval("bdiv", {x, y}) == expected, "chunked bounded div");
+            check(fast->eval("bdiv", {x, y}) == expected, "bisected bounded div");
+        }
+    }
+    try
+    {
+        step_limit limit(100);
+        chunked->eval("bdiv", {1000, 0});
+        check(false, "chunks keep the step budget");
+    }
+    catch(const budget_exceeded&) {}
+    natural taken;
+    {
+        step_limit limit(1000000000);
+        chunked->eval("bdiv", {1000, 0});
+        taken = 1000000000 - steps_left;
+    }
+    try
+    {
+        step_limit limit(taken - 1);
+        chunked->eval("bdiv", {1000, 0});
+        check(false, "chunks share the step budget");
+    }
+    catch(const budget_exceeded&) {}
+    auto m = std::make_unique<machine>(prog, *prog->get_variable("bdiv"), std::vector<natural>{23, 4});
+    m->run(~natural(0));
+    check(m->result() == 6, "bounded search on the machine");
+}
+
+void test_shared_program()
+{
+    auto p = parser::create(str);
+    p->set_checkpoints(true);
+    p->parse();
+    auto prog = p->build();
+    // the parser may go on without disturbing the program
+    p->set_input("mul = P2_1");
+    check(p->try_parse().has_value() && prog->eval("mul", {6, 7}) == 42, "program outlives its parser");
+    std::vector<natural> expected;
+    for(natural x = 0; x < 24; x++)
+    {
+        expected.push_back(prog->eval("mod", {x * 7, 5}) + prog->eval("div", {x, 3}));
+    }
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(8, 0);
+    for(size_t t = 0; t < mismatches.size(); t++)
+    {
+        threads.emplace_back([&, t]{
+            for(natural x = 0; x < expected.size(); x++)
+            {
+                natural y = (x + t) % expected.size();
+                if(prog->eval("mod", {y * 7, 5}) + prog->eval("div", {y, 3}) != expected[y])
+                {
+                    mismatches[t]++;
+                }
+            }
+        });
+    }
+    for(auto& t : threads)
+    {
+        t.join();
+    }
+    for(int m : mismatches)
+    {
+        check(m == 0, "concurrent evaluation");
+    }
+    try
+    {
+        prog->eval("mul", {1});
+        check(false, "arity is checked");
+    }
+    catch(const interprete_error&) {}
+}
+
+void test_memo()
+{
+    auto p = parser::create(str);
+    p->set_memo(true);
+    p->parse();
+    auto q = parser::create(str);
+    q->parse();
+    auto memoised = p->build(), plain = q->build();
+    check(p->get_variable("div")->memo != nullptr && p->get_variable("id")->memo == nullptr, "only loops are memoised");
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(4, 0);
+    for(size_t t = 0; t < mismatches.size(); t++)
+    {
+        threads.emplace_back([&, t]{
+            for(natural x = 0; x < 30; x++)
+            {
+                if(memoised->eval("mod", {x, 1 + (x + t) % 5}) != plain->eval("mod", {x, 1 + (x + t) % 5}))
+                {
+                    mismatches[t]++;
+                }
+            }
+        });
+    }
+    for(auto& t : threads)
+    {
+        t.join();
+    }
+    for(int m : mismatches)
+    {
+        check(m == 0, "memoised evaluation");
+    }
+    auto stats = memoised->memo_results()->statistics();
+    check(stats.hits > 0 && stats.size > 0 && stats.size <= stats.misses, "memo statistics");
+    memo_table small(memo_table::shard_count);
+    for(natural x = 0; x < 1000; x++)
+    {
+        small.insert(nullptr, {x}, x + 1);
+    }
+    auto small_stats = small.statistics();
+    check(small_stats.size <= memo_table::shard_count && small_stats.evictions > 0, "memo table is bounded");
+    check(small.find(nullptr, {999}) == natural(1000), "latest result is kept");
+}
+
+void test_parallel()
+{
+    auto p = parser::create(str);
+    p->set_parallel(std::make_shared<scheduler>(3), 10);
+    p->parse();
+    p->set_input("both = add(mul(P2_1, P2_2), mod(P2_1, P2_2))");
+    auto both = p->parse_line();
+    auto comp = std::dynamic_pointer_cast<composition>(both->defn);
+    check(comp != nullptr && comp->fork != nullptr, "loops are forked");
+    auto q = parser::create(str);
+    q->parse();
+    auto forked = p->build(), serial = q->build();
+    for(natural x = 0; x < 25; x++)
+    {
+        for(natural y = 1; y < 7; y += 2)
+        {
+            check(forked->eval("both", {x, y}) == serial->eval("mul", {x, y}) + serial->eval("mod", {x, y}), "forked both");
+            check(forked->eval("mod", {x, y}) == serial->eval("mod", {x, y}), "forked mod");
+        }
+    }
+    try
+    {
+        step_limit limit(100);
+        forked->eval("both", {100, 100});
+        check(false, "forked tasks keep the step budget");
+    }
+    catch(const budget_exceeded&) {}
+    // the steps of the tasks count against the budget of their parent
+    natural taken;
+    {
+        step_limit limit(1000000000);
+        forked->eval("both", {30, 30});
+        taken = 1000000000 - steps_left;
+    }
+    {
+        natural expected = serial->eval("mul", {30, 30});
+        step_limit limit(taken);
+        check(forked->eval("both", {30, 30}) == expected, "forked both within its steps");
+        check(steps_left == 0, "parents are charged for their tasks");
+    }
+    try
+    {
+        step_limit limit(taken - 1);
+        forked->eval("both", {30, 30});
+        check(false, "forked tasks share the step budget");
+    }
+    catch(const budget_exceeded&) {}
+}
+
+void test_tiering()
+{
+    auto p = parser::create(str);
+    p->set_tiering(true, {.optimize_after = 4, .memoise_after = 8, .memoise_min_steps = 1});
+    p->parse();
+    auto q = parser::create(str);
+    q->parse();
+    auto tiered = p->build(), plain = q->build();
+    for(natural x = 0; x < 30; x++)
+    {
+        check(tiered->eval("mod", {x % 10, 3}) == plain->eval("mod", {x % 10, 3}), "tiered mod");
+    }
+    auto mod = tiered->get_variable("mod");
+    check(mod->tiers->level() == tier::memoised && mod->tiers->calls() == 30, "mod is memoised");
+    check(tiered->get_variable("minus3")->tiers->level() == tier::baseline, "minus3 is cold");
+    check(mod->tiers->report().find("memoised: 18 calls") != std::string::npos && mod->tiers->report().find(" us per call") != std::string::npos,
+          "tiers are timed by samples: " + mod->tiers->report());
+}
+
+void test_closed_forms()
+{
+    auto p = parser::create(str);
+    p->set_closed_forms(true);
+    p->parse();
+    auto q = parser::create(str);
+    q->parse();
+    auto closed = p->build(), plain = q->build();
+    for(const auto& name : {"add", "mul", "pred", "minus3", "rsub", "sub", "if"})
+    {
+        check(closed->get_variable(name)->closed != nullptr, std::string(name) + " has a closed form");
+    }
+    check(closed->get_variable("div")->closed == nullptr, "div has no closed form");
+    check(closed->get_variable("mul")->closed->to_string() == "x1*x2", "mul is x1*x2");
+    check(closed->get_variable("minus3")->closed->to_string() == "(x1) -. (3)", "minus3 is x1 -. 3");
+    for(natural x = 0; x < 12; x++)
+    {
+        for(natural y = 1; y < 12; y++)
+        {
+            for(auto name : {"mul", "sub", "mod", "div3cell"})
+            {
+                std::vector<natural> xs = {x, y};
+                xs.resize(plain->get_variable(name)->dim());
+                check(closed->eval(name, xs) == plain->eval(name, xs), std::string(name) + " by its closed form");
+            }
+        }
+    }
+    // far beyond what the loops could count to
+    check(closed->eval("mul", {3000000000, 3000000000}) == 9000000000000000000ull, "mul on large arguments");
+    check(closed->eval("rsub", {natural(1) << 40, 5}) == 0, "rsub on large arguments");
+    p->set_input("subsq = rsub(mul(P2_2, P2_2), P2_1)");
+    p->parse_line();
+    natural root = (natural(1) << 32) - 1;
+    check(p->build()->eval("subsq", {~natural(0), root}) == ~natural(0) - root * root, "subtrahend just in range");
+    check(p->closed_forms().find("mul = x1*x2") != std::string::npos, "closed forms are reported");
+}
+
+void test_sweep()
+{
+    auto p = parser::create(str);
+    p->parse();
+    auto prog = p->build();
+    scheduler pool(2);
+    auto table = [&](const std::string& name, const std::vector<natural>& fixed, sweep_range range, bool reused){
+        std::vector<std::pair<natural, natural>> rows;
+        bool res = sweep(*prog->get_variable(name), fixed, range, [&rows](natural n, natural value){
+            rows.emplace_back(n, value);
+        }, pool);
+        check(res == reused, name + (reused ? " reuses its loop" : " is evaluated point by point"));
+        check(rows.size() == range.hi - range.lo + 1, name + " swept over the whole range");
+        for(auto [n, value] : rows)
+        {
+            auto xs = fixed;
+            xs.insert(xs.begin() + (range.pos - 1), n);
+            check(value == prog->eval(name, xs), name + " swept at " + std::to_string(n));
+        }
+    };
+    table("mul", {7}, {1, 0, 20}, true);
+    table("mul", {7}, {2, 3, 20}, false);
+    table("mod", {5}, {1, 0, 25}, false);
+    table("pred", {}, {1, 0, 9}, true);
+    table("minus3", {}, {1, 2, 9}, false);
+    bool called = false;
+    sweep(*prog->get_variable("mul"), {7}, {1, 5, 4}, [&called](natural, natural){ called = true; }, pool);
+    check(!called, "empty sweep");
+}
+
+void test_differential()
+{
+    check(program_generator(7).generate() == program_generator(7).generate(), "generated programs are reproducible");
+    program_generator big(7, {.definitions = 300, .max_depth = 4});
+    auto p = parser::create(big.generate());
+    check(p->try_parse() == std::nullopt && p->variables().size() == 300, "large generated program parses");
+    differential harness(all_engines(std::make_shared<scheduler>(2)), 20000);
+    size_t compared = 0;
+    for(natural seed = 1; seed <= 15; seed++)
+    {
+        program_generator gen(seed);
+        std::string source = gen.generate();
+        auto q = parser::create(source);
+        q->parse();
+        std::vector<call> calls;
+        for(const auto& v : q->variables())
+        {
+            calls.push_back({v->name, gen.arguments(v->dim(), 6)});
+            calls.push_back({v->name, gen.arguments(v->dim(), 6)});
+        }
+        for(const auto& m : harness.compare(source, calls))
+        {
+            check(false, "seed " + std::to_string(seed) + ": " + m.to_string());
+        }
+        compared += harness.compared();
+    }
+    check(compared > 500, "engines compared on generated programs");
+}
+
+void test_modules()
+{
+    auto dir = std::filesystem::temp_directory_path() / "kleene_test_modules";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "lib");
+    auto write = [&dir](const std::string& name, const std::string& text){
+        std::ofstream(dir / name) << text;
+    };
+    write("lib/arith.kl", str);
+    write("lib/more.kl", "import \"arith.kl\"\nsq = arith.mul(P1_1, P1_1)\n");
+    write("cycle.kl", "import \"cycle.kl\"\n");
+    std::string main = "import \"lib/more.kl\" as m\nimport \"lib/arith.kl\"\nmain = m.sq(arith.sub(P1_1, C1_7))\n";
+    auto load = [&dir](const std::string& text, const std::shared_ptr<module_cache>& cache){
+        auto p = parser::create(text);
+        p->set_module_cache(cache);
+        p->set_import_dir(dir.string());
+        auto err = p->try_parse();
+        return err ? *err : std::to_string(p->build()->eval("main", {23}));
+    };
+    auto cache = std::make_shared<module_cache>((dir / "cache").string());
+    check(load(main, cache) == "256", "imported definitions");
+    check(cache->stats().compiled == 2 && cache->stats().memory == 1, "modules are compiled once");
+    auto p = parser::create(main);
+    p->set_module_cache(cache);
+    p->set_import_dir(dir.string());
+    p->parse();
+    check(p->get_variable("m.arith.div") != nullptr && p->get_variable("arith.div") != nullptr, "nested namespaces");
+    auto fresh = std::make_shared<module_cache>((dir / "cache").string());
+    check(load(main, fresh) == "256" && fresh->stats().disk == 2 && fresh->stats().compiled == 0, "modules are loaded from disk");
+    write("lib/arith.kl", str + "extra = S\n");
+    auto stale = std::make_shared<module_cache>((dir / "cache").string());
+    check(load(main, stale) == "256" && stale->stats().compiled == 2, "modules importing a changed module are compiled again");
+    // a projection out of range in every compiled module on disk
+    for(const auto& entry : std::filesystem::directory_iterator(dir / "cache"))
+    {
+        std::stringstream text;
+        text << std::ifstream(entry.path()).rdbuf();
+        std::string code = text.str();
+        for(size_t at = code.find(" P 3 2"); at != std::string::npos; at = code.find(" P 3 2", at))
+        {
+            code.replace(at, 6, " P 3 9");
+        }
+        std::ofstream(entry.path()) << code;
+    }
+    auto damaged = std::make_shared<module_cache>((dir / "cache").string());
+    check(load(main, damaged) == "256" && damaged->stats().compiled == 2, "damaged modules are compiled again");
+    check(load("import \"cycle.kl\"\nmain = S", cache).find("Cyclic import") != std::string::npos, "cyclic import");
+    check(load("import \"none.kl\"\nmain = S", cache).find("Cannot open module") != std::string::npos, "missing module");
+    check(load("import \"lib/arith.kl\"\nimport \"lib/more.kl\" as arith\n", cache).find("already imported") != std::string::npos, "namespace clash");
+    write("lib/bad.kl", "ok = S\nbad = S(P2_1, P2_2)\n");
+    check(load("import \"lib/bad.kl\"\nmain = S", cache).find("Arity mismatch") != std::string::npos, "errors in modules");
+    std::filesystem::remove_all(dir);
+}
+
+void test_result_store()
+{
+    auto dir = std::filesystem::temp_directory_path() / "kleene_test_results";
+    std::filesystem::remove_all(dir);
+    auto p = parser::create(str);
+    p->parse();
+    auto prog = p->build();
+    // the same definitions under other names, among unrelated ones
+    auto q = parser::create("pred = 0 @ P2_1\nunused = S(S)\nplus = P1_1 @ S(P3_2)\n"
+                            "times = C1_0 @ plus(P3_3, P3_2)\n");
+    q->parse();
+    auto renamed = q->build();
+    {
+        auto store = result_store::open(dir.string(), 16);
+        check(!store->find(*prog->get_variable("mul"), {6, 7}), "empty store");
+        store->store(*prog->get_variable("mul"), {6, 7}, 42);
+        check(store->find(*prog->get_variable("mul"), {6, 7}) == natural(42), "stored result");
+        check(!store->find(*prog->get_variable("mul"), {7, 6}), "operands are part of the key");
+        check(store->find(*renamed->get_variable("times"), {6, 7}) == natural(42), "renamed definitions share results");
+        check(!store->find(*prog->get_variable("add"), {6, 7}), "definitions are told apart");
+    }
+    // the file keeps the size it was created with
+    auto store = result_store::open(dir.string(), 1 << 10);
+    check(store->find(*prog->get_variable("mul"), {6, 7}) == natural(42), "results persist");
+    for(natural x = 0; x < 100; x++)
+    {
+        store->store(*prog->get_variable("add"), {x, x}, 2 * x);
+    }
+    check(store->stats().evicted == 100 - 16 + 1, "a full store forgets results");
+    check(store->find(*prog->get_variable("add"), {99, 99}) == natural(198), "recent results are kept");
+    std::filesystem::remove_all(dir);
+}
+
+void test_perf_stats()
+{
+    perf_recorder perf;
+    auto p = parser::create(str);
+    p->set_perf(&perf);
+    p->parse();
+    {
+        perf_recorder::scope phase(&perf, "eval");
+        std::vector<char> block(1 << 20, 1);
+        check(p->build()->eval("mul", {6, 7}) == 42 && block[12345] == 1, "eval under a recorder");
+    }
+    auto phases = perf.phases();
+    auto find = [&phases](const std::string& name){
+        return std::find_if(phases.begin(), phases.end(), [&name](const auto& ph){ return ph.name == name; });
+    };
+    auto parse = find("parse"), optimise = find("optimise"), eval = find("eval");
+    check(parse != phases.end() && optimise != phases.end() && eval != phases.end(), "phases are recorded");
+    if(parse == phases.end() || optimise == phases.end() || eval == phases.end())
+    {
+        return;
+    }
+    check(optimise->entered == p->variables().size() && parse->entered > optimise->entered, "a phase adds up its entries");
+    check(parse->allocations > 0 && eval->bytes >= 1 << 20 && eval->peak_bytes >= 1 << 20, "allocations are counted");
+    std::string json = perf.to_json();
+    check(json.starts_with("{\"events\": [\"cycles\"") && json.find("\"name\": \"optimise\"") != std::string::npos,
+          "counters as JSON");
+    check(json.find("\"task_clock_ns\": null") == std::string::npos || !perf.counted(4), "counted events are not null");
+}
+
+void test_source()
+{
+    auto path = std::filesystem::temp_directory_path() / "kleene_test_source.kl";
+    {
+        std::ofstream out(path);
+        out << str << "main = mul(6, 7) ; no newline at the end";
+    }
+    auto source = source_file::open(path.string());
+    check(source != nullptr && source->text().size() == std::filesystem::file_size(path), "source is mapped");
+    auto p = parser::create(source);
+    source = nullptr;
+    p->parse();
+    check(p->build()->eval("main", {}) == 42, "parsed in place");
+    std::filesystem::remove(path);
+    check(source_file::open(path.string()) == nullptr, "missing source");
+    symbol_table symbols;
+    std::string name = "div";
+    unsigned int id = symbols.intern(name);
+    name = "mod";
+    check(symbols.intern("mod") == id + 1 && symbols.find("div") == id && symbols.name(id) == "div", "symbols are interned");
+    check(symbols.find("sub") == symbol_table::none, "unknown symbol");
+}
+
+void test_reachable()
+{
+    auto p = parser::create(str);
+    p->set_roots({"mod"});
+    p->parse();
+    check(p->get_variable("div3cell") == nullptr && p->get_variable("if") == nullptr, "unused definitions are skipped");
+    auto q = parser::create(str);
+    q->parse();
+    for(natural x = 0; x < 20; x++)
+    {
+        check(p->build()->eval("mod", {x, 3}) == q->build()->eval("mod", {x, 3}), "reachable mod");
+    }
+    std::string broken = "bad = P1_1 @ S\n" + str + "main = mod(7, later) ; comment\nlater = 3\n";
+    auto lazy = parser::create(broken);
+    lazy->set_roots({"div"});
+    check(!lazy->try_parse().has_value(), "unused errors are not reported");
+    lazy = parser::create(broken);
+    lazy->set_roots({"main"});
+    auto eager = parser::create(broken.substr(broken.find('\n') + 1));
+    auto lazy_error = lazy->try_parse(), eager_error = eager->try_parse();
+    check(lazy_error.has_value() && eager_error.has_value() && lazy_error->find("Undefined variable: later") != std::string::npos,
+          "reachable errors are reported");
+    // the same message, but one line further down
+    std::string l = lazy_error.value_or(""), e = eager_error.value_or("");
+    check(l.substr(l.find('\n')) == e.substr(e.find('\n')), "errors are unchanged");
+}
+
+void test_parallel_parse()
+{
+    auto pool = std::make_shared<scheduler>(3);
+    auto parse = [&pool](const std::string& source, bool parallel){
+        auto p = parser::create(source);
+        if(parallel)
+        {
+            p->set_parallel_parse(pool);
+        }
+        return p;
+    };
+    std::string big = program_generator(11, {.definitions = 3000, .max_depth = 4}).generate();
+    for(const std::string& source : {str, big})
+    {
+        auto p = parse(source, true), q = parse(source, false);
+        check(!p->try_parse().has_value() && !q->try_parse().has_value() && p->to_string() == q->to_string(),
+              "parallel parse builds the same definitions");
+    }
+    auto p = parse(str, true), q = parse(str, false);
+    p->parse();
+    q->parse();
+    natural expected = q->build()->eval("mod", {17, 5});
+    check(p->build()->eval("mod", {17, 5}) == expected, "parallel mod");
+    // errors and where they are reported are those of a parse line by line
+    for(const char* error : {"main = mod(7, later)\nlater = 3\n", "mul = P1_1\n", "bad = add(P1_1)\n",
+                                    "bad = add(P2_1, P2_2) @ \n", "bad = P3_4\n", "bad = #\n", "= add\n",
+                                    "bad = $[P1_1] P2_2) ; comment\n", "import \"missing.kl\"\n"})
+    {
+        std::string source = str + error + "fine = S\n";
+        auto p = parse(source, true), q = parse(source, false);
+        auto parallel_error = p->try_parse(), serial_error = q->try_parse();
+        check(parallel_error.has_value() && parallel_error == serial_error, std::string("parallel parse error: ") + error);
+    }
+    p = parse(str, true);
+    p->set_roots({"mod"});
+    p->parse();
+    check(p->get_variable("if") == nullptr && p->build()->eval("mod", {17, 5}) == expected, "parallel parse of what is reachable");
+}
+
+void test_session()
+{
+    auto p = parser::create(str);
+    p->set_fast_min(true);
+    p->parse();
+    auto prog = p->build();
+    // one step at a time, and bisection frames too
+    for(natural x = 0; x < 12; x++)
+    {
+        for(std::string name : {"div3cell", "mod"})
+        {
+            std::vector<natural> operands = name == "mod" ? std::vector<natural>{x, 4} : std::vector<natural>{x};
+            machine m(prog, *prog->get_variable(name), operands);
+            while(!m.run(1)) {}
+            check(m.result() == prog->eval(name, operands), "machine " + name);
+        }
+    }
+    session s;
+    check(s.update_code("f = P1_1 @").has_value() && s.eval("f", {}) == "No program", "session without program");
+    check(!s.update_code(str).has_value(), "session parses");
+    check(s.eval("nothing", {}).has_value() && s.eval("mul", {1}).has_value() && !s.running(), "bad entry points");
+    check(!s.eval("mul", {6, 7}) && !s.step(10) && s.running(), "evaluation is sliced");
+    while(!s.step(10)) {}
+    check(s.evaluation()->result() == 42 && s.evaluation()->steps() > 10, "sliced result");
+    check(!s.eval("mul", {1000, 1000}) && !s.step(100), "long evaluation");
+    s.cancel();
+    check(!s.running() && s.evaluation() == nullptr && !s.step(100), "cancelled");
+}
+
+void test_resume()
+{
+    auto build = [](bool fast){
+        auto p = parser::create(str);
+        p->set_fast_min(fast);
+        p->parse();
+        return p->build();
+    };
+    for(bool fast : {false, true})
+    {
+        auto prog = build(fast);
+        auto m = std::make_unique<machine>(prog, *prog->get_variable("mod"), std::vector<natural>{100, 7});
+        std::string saved;
+        // saved and restored on a program parsed anew every few steps
+        while(!m->run(37))
+        {
+            std::ostringstream out;
+            m->save(out);
+            saved = out.str();
+            std::istringstream in(saved);
+            auto next = machine::restore(build(fast), in);
+            check(next->steps() == m->steps() && next->depth() == m->depth(), "restored frames");
+            m = std::move(next);
+        }
+        check(m->result() == prog->eval("mod", {100, 7}) && m->entry_point() == "mod", "resumed result");
+        std::istringstream other(saved);
+        bool rejected = false;
+        try
+        {
+            machine::restore(build(!fast), other);
+        }
+        catch(const interprete_error&)
+        {
+            rejected = true;
+        }
+        check(rejected, "state of another program is rejected");
+    }
+    // the top frame without its arguments
+    auto prog = build(false);
+    machine m(prog, *prog->get_variable("mod"), {100, 7});
+    m.run(37);
+    std::ostringstream out;
+    m.save(out);
+    std::string saved = out.str();
+    saved.pop_back();
+    size_t line = saved.rfind('\n') + 1;
+    std::istringstream frame(saved.substr(line));
+    std::string damaged = saved.substr(0, line), word;
+    for(int i = 0; i < 6 && frame >> word; i++)
+    {
+        damaged += word + " ";
+    }
+    size_t args;
+    frame >> args;
+    for(size_t i = 0; i < args && frame >> word; i++) {}
+    damaged += "0";
+    std::getline(frame, word);
+    damaged += word + "\n";
+    std::istringstream in(damaged);
+    bool rejected = false;
+    try
+    {
+        machine::restore(prog, in);
+    }
+    catch(const interprete_error& e)
+    {
+        rejected = std::string(e.what()).find("malformed frame") != std::string::npos;
+    }
+    check(rejected && args > 0, "frames of the wrong size are rejected");
+}
+
+constexpr embed::fixed_string embedded = R"(
+pred = 0 @ P2_1 ;; x ~> x-1
+minus3 = pred(pred(pred))
+id = P1_1
+div3cell = $(id @ minus3(P3_2))
+add = id @ S(P3_2)
+mul = C1_0 @ add(P3_3, P3_2)
+rsub = P1_1 @ pred(P3_2) ; (a,b) ~> b-a
+div = $rsub(S(mul(P3_3,P3_1)),P3_2)
+fast_div = $!rsub(S(mul(P3_3,P3_1)),P3_2)
+bounded_div = $[S(P2_1)] rsub(S(mul(P3_3,P3_1)),P3_2)
+fast_bounded_div = $![S(P2_1)] rsub(S(mul(P3_3,P3_1)),P3_2)
+main = mul(6, 7)
+)";
+using embedded_lib = embed::program<embedded>;
+static_assert(embedded_lib::function<"main">() == 42);
+static_assert(embedded_lib::function<"div">(100, 7) == 15 && embedded_lib::function<"fast_div">(100, 7) == 15);
+static_assert(embedded_lib::function<"bounded_div">(100, 0) == 101 && embedded_lib::function<"fast_bounded_div">(100, 7) == 15);
+
+void test_embed()
+{
+    auto p = parser::create(embedded.text);
+    p->parse();
+    auto prog = p->build();
+    for(natural x = 0; x < 30; x++)
+    {
+        check(embedded_lib::function<"div3cell">(x) == prog->eval("div3cell", {x}), "embedded div3cell");
+        for(natural y = 1; y < 6; y++)
+        {
+            check(embedded_lib::function<"div">(x, y) == prog->eval("div", {x, y}), "embedded div");
+            check(embedded_lib::function<"fast_div">(x, y) == prog->eval("div", {x, y}), "embedded fast_div");
+            check(embedded_lib::function<"fast_bounded_div">(x, y) == prog->eval("bounded_div", {x, y}), "embedded fast_bounded_div");
+        }
+    }
+}
+
+void test_progress()
+{
+    auto p = parser::create(str);
+    p->set_optimize(false);
+    p->parse();
+    auto prog = p->build();
+    std::ostringstream quiet;
+    std::atomic<bool> done{false};
+    std::string seen;
+    // gone before the standby monitor below, whose request its reporter
+    // would otherwise take
+    {
+        progress_monitor monitor(quiet, std::chrono::milliseconds(0));
+        check(monitor.report().empty(), "no thread watched");
+        std::thread worker([&]{
+            progress_monitor::scope watching(monitor);
+            try
+            {
+                step_limit limit(10000000);
+                prog->eval("div", {1000000, 1});
+            }
+            catch(const budget_exceeded&) {}
+            done = true;
+        });
+        while(!done && seen.find("$ at") == std::string::npos)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            seen = monitor.report();
+        }
+        worker.join();
+        check(seen.find("iterations") != std::string::npos && seen.find("/s; $ at") != std::string::npos,
+              "search candidate is reported: " + seen);
+        check(monitor.report().empty(), "thread no longer watched");
+    }
+    // a monitor not started watches the threads in its scope once asked
+    progress_monitor standby(quiet, std::chrono::milliseconds(0), false);
+    done = false;
+    std::thread waiting([&]{
+        progress_monitor::scope watching(standby);
+        try
+        {
+            step_limit limit(10000000);
+            prog->eval("div", {1000000, 1});
+        }
+        catch(const budget_exceeded&) {}
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    check(standby.report().empty(), "threads stand by until a report is requested");
+    progress_monitor::request();
+    seen.clear();
+    while(!done && seen.find("iterations") == std::string::npos)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        seen = standby.report();
+    }
+    waiting.join();
+    check(seen.find("iterations") != std::string::npos, "a request starts watching: " + seen);
+    // a search already running when the signal comes, with no inner loop
+    // to start, is watched from its next candidate on
+    auto q = parser::create("f = $ C2_1\n");
+    q->set_optimize(false);
+    q->parse();
+    auto endless = q->build();
+    progress_monitor signalled(quiet, std::chrono::milliseconds(0), false);
+    done = false;
+    std::thread spinning([&]{
+        progress_monitor::scope watching(signalled);
+        try
+        {
+            step_limit limit(100000000);
+            endless->eval("f", {3});
+        }
+        catch(const budget_exceeded&) {}
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    auto previous = std::signal(SIGUSR1, [](int){ progress_monitor::request(); });
+    std::raise(SIGUSR1);
+    std::signal(SIGUSR1, previous);
+    seen.clear();
+    while(!done && seen.find("$ at") == std::string::npos)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        seen = signalled.report();
+    }
+    bool running = !done;
+    spinning.join();
+    check(running && seen.find("; $ at") != std::string::npos && seen.find("$ at 0 ") == std::string::npos,
+          "a running search is reported on a signal: " + seen);
+}
+
+void test_server()
+{
+    auto p = parser::create(str);
+    p->parse();
+    server srv({.threads = 3, .budget = 100000});
+    srv.add_program("test", p->build());
+    std::istringstream in(R"({"id": 1, "entry": "mul", "args": [6, 7]}
+{"id": "two", "program": "test", "entry": "div", "args": [100, 7]}
+
+{"id": 3, "entry": "mul", "args": [1000, 1000]}
+{"id": 4, "entry": "mul", "args": [10, 10], "budget": 50}
+{"id": 5, "entry": "nothing", "args": []}
+{"id": 6, "program": "other", "entry": "mul", "args": [1, 1]}
+{"id": 7, "args": [1, 2], "entry": "mod", "extra": {"a": [1, "]"]}}
+{"entry": [})");
+    std::ostringstream out;
+    srv.serve(in, out);
+    std::set<std::string> got;
+    std::istringstream lines(out.str());
+    for(std::string line; std::getline(lines, line); )
+    {
+        got.insert(line);
+    }
+    std::set<std::string> expected = {
+        R"({"id": 1, "result": 42})",
+        R"({"id": "two", "result": 15})",
+        R"({"id": 3, "error": "Step budget exhausted"})",
+        R"({"id": 4, "error": "Step budget exhausted"})",
+        R"({"id": 5, "error": "eval: Undefined variable: nothing"})",
+        R"({"id": 6, "error": "Unknown program: other"})",
+        R"({"id": 7, "result": 1})",
+        R"({"error": "Bad request: expected '\"' at column 11"})",
+    };
+    check(got == expected, "server responses");
+    check(srv.answer(R"({"id": "a\"}, \"x", "entry": "\u006dul", "args": [6, 7]})") == R"({"id": "a\"}, \"x", "result": 42})",
+          "\\u escapes are decoded and the id is written back escaped");
+    check(srv.answer(R"({"id": {"k" : [1,-2.5e3,null]}, "entry": "mul", "args": [1, 1]})")
+              == R"({"id": {"k": [1, -2.5e3, null]}, "result": 1})",
+          "a structured id is written back");
+    check(srv.answer(R"({"id": 1, "result": 2} , "entry": "mul"})") == R"({"id": 1, "error": "eval: Undefined variable: "})",
+          "an id ends at its value");
+    check(srv.answer(R"({"id": nope, "entry": "mul"})") == R"({"error": "Bad request: expected a value at column 8"})",
+          "an id that is not JSON is rejected");
+    check(srv.answer(R"({"entry": "\ud83d\ude00"})") == "{\"error\": \"eval: Undefined variable: \xF0\x9F\x98\x80\"}",
+          "surrogate pairs are decoded");
+    check(srv.answer(R"({"entry": "\ud83d"})").starts_with(R"({"error": "Bad request: unpaired surrogate)"),
+          "an unpaired surrogate is rejected");
+    // reading waits for answers once a request is in flight
+    server one({.threads = 2, .in_flight = 1});
+    one.add_program("test", p->build());
+    std::string requests;
+    for(int i = 0; i < 20; i++)
+    {
+        requests += R"({"entry": "mul", "args": [6, 7]})" "\n";
+    }
+    std::istringstream many(requests);
+    std::ostringstream answers;
+    one.serve(many, answers);
+    std::string expected_answers;
+    for(int i = 0; i < 20; i++)
+    {
+        expected_answers += R"({"result": 42})" "\n";
+    }
+    check(answers.str() == expected_answers, "requests in flight are bounded");
+}
+
 const char* run_program(const char* code, const char* entry, const char* input)
 {
     static std::string result;
@@ -36,7 +1043,7 @@ const char* run_program(const char* code, const char* entry, const char* input)
         }
         else
         {
-            natural output = p->eval_var(std::string(entry), operands);
+            natural output = p->build()->eval(std::string(entry), operands);
             result = std::to_string(output);
         }
     } catch (const std::invalid_argument& e) {
@@ -70,5 +1077,31 @@ int main(int argc, char* argv[])
 //    std::cout << p->eval_var("div", {100,7}) << std::endl;
     std::cout << run_program("main = S(2)\n"
                              "id = P1_1 $", "div", "100 7");
-    return 0;
+    std::cout << std::endl;
+    test_specialize();
+    test_simplify();
+    test_checkpoints();
+    test_fast_min();
+    test_analyze();
+    test_ranges();
+    test_bounded_minimization();
+    test_shared_program();
+    test_server();
+    test_memo();
+    test_parallel();
+    test_tiering();
+    test_closed_forms();
+    test_sweep();
+    test_differential();
+    test_modules();
+    test_result_store();
+    test_perf_stats();
+    test_source();
+    test_reachable();
+    test_parallel_parse();
+    test_session();
+    test_progress();
+    test_resume();
+    test_embed();
+    return failures == 0 ? 0 : 1;
 }